@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <stdint.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <time.h>
+#include <zlib.h>
+}
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <climits>
+#include <string>
+
+#include "common.hxx"
+
+/*
+ * Archives written front to back, for when the output can't be seeked (i.e.
+ * a pipe), which libzip needs. Entries come in converted, and usually deflated
+ * already by a worker, so all that's left to do here is frame them.
+ */
+
+/**
+ * Deflates all of the input into out, which needs room for all of it (i.e.
+ * from deflateBound), and finishes the stream. zlib counts in 32 bits, so
+ * bigger buffers are fed through a piece at a time. Returns how much was
+ * written, or -1 if it couldn't finish.
+ */
+ptrdiff_t deflate_all(struct z_stream_s *stream, const char *in, size_t in_length, char *out, size_t out_length)
+{
+	size_t in_left = in_length, out_left = out_length;
+	int rc;
+	do {
+		uInt in_piece = (uInt)std::min<size_t>(in_left, UINT_MAX);
+		uInt out_piece = (uInt)std::min<size_t>(out_left, UINT_MAX);
+		stream->next_in = (Bytef*)in + (in_length - in_left);
+		stream->avail_in = in_piece;
+		stream->next_out = (Bytef*)out + (out_length - out_left);
+		stream->avail_out = out_piece;
+		rc = deflate(stream, in_piece == in_left ? Z_FINISH : Z_NO_FLUSH);
+		in_left -= in_piece - stream->avail_in;
+		out_left -= out_piece - stream->avail_out;
+	} while (rc == Z_OK && out_left > 0);
+	return rc == Z_STREAM_END ? (ptrdiff_t)(out_length - out_left) : -1;
+}
+
+static void put_u16le(std::string &out, uint16_t value)
+{
+	out.push_back((char)value);
+	out.push_back((char)(value >> 8));
+}
+
+static void put_u32le(std::string &out, uint32_t value)
+{
+	put_u16le(out, (uint16_t)value);
+	put_u16le(out, (uint16_t)(value >> 16));
+}
+
+static void put_u64le(std::string &out, uint64_t value)
+{
+	put_u32le(out, (uint32_t)value);
+	put_u32le(out, (uint32_t)(value >> 32));
+}
+
+ArchiveWriter::ArchiveWriter(int fd) : sink(fd)
+{
+}
+
+void ArchiveWriter::write(const std::string &data)
+{
+	this->sink.write(data);
+	this->offset += data.size();
+}
+
+/**
+ * Writes out whatever is still pending. Returns false if any write failed,
+ * with errno set to why.
+ */
+bool ArchiveWriter::flush()
+{
+	this->sink.flush();
+	if (this->sink.error != 0) {
+		errno = this->sink.error;
+		return false;
+	}
+	return true;
+}
+
+#define ZIP_LOCAL_HEADER      0x04034b50
+#define ZIP_CENTRAL_HEADER    0x02014b50
+#define ZIP_END               0x06054b50
+#define ZIP64_END             0x06064b50
+#define ZIP64_END_LOCATOR     0x07064b50
+#define ZIP_EXTRA_ZIP64       0x0001
+#define ZIP_EXTRA_TIMESTAMP   0x5455
+// Made on Unix by 4.5 (for Zip64), so the permissions are used
+#define ZIP_VERSION_MADE_BY   ((3 << 8) | 45)
+#define ZIP_VERSION_NEEDED    20
+#define ZIP64_VERSION_NEEDED  45
+#define ZIP_METHOD_STORE      0
+#define ZIP_METHOD_DEFLATE    8
+#define ZIP_LIMIT_16          0xFFFF
+#define ZIP_LIMIT_32          0xFFFFFFFFu
+
+/**
+ * MS-DOS times have no time zone, so they're in local time like Info-ZIP
+ * does it; the extended timestamp has the real time.
+ */
+static void dos_time(time_t mtime, uint16_t &dos_time, uint16_t &dos_date)
+{
+	struct tm tm;
+	if (localtime_r(&mtime, &tm) == nullptr || tm.tm_year < 80) {
+		dos_time = 0;
+		dos_date = (1 << 5) | 1; // 1980-01-01
+		return;
+	}
+	dos_time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+	dos_date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+}
+
+/**
+ * Each entry's sizes and CRC are known before it's written, so they go right
+ * in the local header, and no data descriptor is needed after it. That's what
+ * readers that go front to back like best. The central directory is kept
+ * until the end, since it's only a little per entry.
+ */
+bool ZipStreamWriter::add(const ArchiveEntry &entry)
+{
+	uint64_t compressed_size = entry.data->size();
+	bool zip64 = entry.uncompressed_size >= ZIP_LIMIT_32 || compressed_size >= ZIP_LIMIT_32;
+	bool zip64_offset = this->offset >= ZIP_LIMIT_32;
+	uint16_t time, date;
+	dos_time(entry.mtime, time, date);
+	// Names and comments longer than the fields allow can't be had
+	size_t path_length = entry.path.size() > ZIP_LIMIT_16 ? ZIP_LIMIT_16 : entry.path.size();
+	size_t comment_length = entry.comment.size() > ZIP_LIMIT_16 ? ZIP_LIMIT_16 : entry.comment.size();
+
+	std::string timestamp;
+	put_u16le(timestamp, ZIP_EXTRA_TIMESTAMP);
+	put_u16le(timestamp, 5);
+	timestamp.push_back(1); // has the modification time
+	put_u32le(timestamp, (uint32_t)entry.mtime);
+
+	std::string header;
+	put_u32le(header, ZIP_LOCAL_HEADER);
+	put_u16le(header, zip64 ? ZIP64_VERSION_NEEDED : ZIP_VERSION_NEEDED);
+	put_u16le(header, 0); // flags
+	put_u16le(header, entry.compressed ? ZIP_METHOD_DEFLATE : ZIP_METHOD_STORE);
+	put_u16le(header, time);
+	put_u16le(header, date);
+	put_u32le(header, entry.crc);
+	put_u32le(header, zip64 ? ZIP_LIMIT_32 : (uint32_t)compressed_size);
+	put_u32le(header, zip64 ? ZIP_LIMIT_32 : (uint32_t)entry.uncompressed_size);
+	put_u16le(header, path_length);
+	std::string extra = timestamp;
+	if (zip64) {
+		put_u16le(extra, ZIP_EXTRA_ZIP64);
+		put_u16le(extra, 16);
+		put_u64le(extra, entry.uncompressed_size);
+		put_u64le(extra, compressed_size);
+	}
+	put_u16le(header, extra.size());
+	header.append(entry.path, 0, path_length);
+	header.append(extra);
+
+	std::string &central = this->central_directory;
+	put_u32le(central, ZIP_CENTRAL_HEADER);
+	put_u16le(central, ZIP_VERSION_MADE_BY);
+	put_u16le(central, zip64 || zip64_offset ? ZIP64_VERSION_NEEDED : ZIP_VERSION_NEEDED);
+	put_u16le(central, 0); // flags
+	put_u16le(central, entry.compressed ? ZIP_METHOD_DEFLATE : ZIP_METHOD_STORE);
+	put_u16le(central, time);
+	put_u16le(central, date);
+	put_u32le(central, entry.crc);
+	put_u32le(central, zip64 ? ZIP_LIMIT_32 : (uint32_t)compressed_size);
+	put_u32le(central, zip64 ? ZIP_LIMIT_32 : (uint32_t)entry.uncompressed_size);
+	put_u16le(central, path_length);
+	extra = timestamp;
+	// The Zip64 extra field only has what didn't fit, in this order
+	if (zip64 || zip64_offset) {
+		put_u16le(extra, ZIP_EXTRA_ZIP64);
+		put_u16le(extra, (zip64 ? 16 : 0) + (zip64_offset ? 8 : 0));
+		if (zip64) {
+			put_u64le(extra, entry.uncompressed_size);
+			put_u64le(extra, compressed_size);
+		}
+		if (zip64_offset) {
+			put_u64le(extra, this->offset);
+		}
+	}
+	put_u16le(central, extra.size());
+	put_u16le(central, comment_length);
+	put_u16le(central, 0); // disk number
+	put_u16le(central, 0); // internal attributes
+	put_u32le(central, 0100644u << 16); // a regular file, rw-r--r--
+	put_u32le(central, zip64_offset ? ZIP_LIMIT_32 : (uint32_t)this->offset);
+	central.append(entry.path, 0, path_length);
+	central.append(extra);
+	central.append(entry.comment, 0, comment_length);
+	this->entry_count++;
+
+	write(header);
+	write(*entry.data);
+	return this->sink.error == 0;
+}
+
+bool ZipStreamWriter::finish()
+{
+	uint64_t central_offset = this->offset;
+	uint64_t central_size = this->central_directory.size();
+	write(this->central_directory);
+	std::string end;
+	bool zip64 = this->entry_count >= ZIP_LIMIT_16
+		|| central_offset >= ZIP_LIMIT_32 || central_size >= ZIP_LIMIT_32;
+	if (zip64) {
+		uint64_t zip64_end_offset = this->offset;
+		put_u32le(end, ZIP64_END);
+		put_u64le(end, 44); // size of the rest of the record
+		put_u16le(end, ZIP_VERSION_MADE_BY);
+		put_u16le(end, ZIP64_VERSION_NEEDED);
+		put_u32le(end, 0); // this disk
+		put_u32le(end, 0); // disk the central directory starts on
+		put_u64le(end, this->entry_count);
+		put_u64le(end, this->entry_count);
+		put_u64le(end, central_size);
+		put_u64le(end, central_offset);
+		put_u32le(end, ZIP64_END_LOCATOR);
+		put_u32le(end, 0);
+		put_u64le(end, zip64_end_offset);
+		put_u32le(end, 1); // total disks
+	}
+	put_u32le(end, ZIP_END);
+	put_u16le(end, 0);
+	put_u16le(end, 0);
+	put_u16le(end, zip64 ? ZIP_LIMIT_16 : this->entry_count);
+	put_u16le(end, zip64 ? ZIP_LIMIT_16 : this->entry_count);
+	put_u32le(end, zip64 ? ZIP_LIMIT_32 : (uint32_t)central_size);
+	put_u32le(end, zip64 ? ZIP_LIMIT_32 : (uint32_t)central_offset);
+	put_u16le(end, 0); // no archive comment
+	write(end);
+	return flush();
+}
+
+#define TAR_BLOCK_SIZE     512
+// The largest size that fits in 11 octal digits
+#define TAR_MAX_SIZE       077777777777ull
+
+TarWriter::TarWriter(int fd, bool gzip, int level) : ArchiveWriter(fd)
+{
+	this->gzip = gzip;
+	this->level = level;
+}
+
+TarWriter::~TarWriter()
+{
+	if (this->deflater != nullptr) {
+		deflateEnd(this->deflater);
+		delete this->deflater;
+	}
+}
+
+static void put_octal(char *field, size_t length, uint64_t value)
+{
+	// Zero padded, and ending with a NUL
+	std::string text = fmt::format("{:0{}o}", value, length - 1);
+	memcpy(field, text.data(), length - 1);
+	field[length - 1] = '\0';
+}
+
+/**
+ * Adds a pax extended header record, which starts with its own length.
+ */
+static void put_pax_record(std::string &out, const char *key, const std::string &value)
+{
+	size_t length = strlen(key) + value.size() + 3; // space, =, and newline
+	size_t digits = fmt::formatted_size("{}", length);
+	// Adding the length can make it need another digit
+	if (fmt::formatted_size("{}", length + digits) != digits) {
+		digits++;
+	}
+	fmt::format_to(std::back_inserter(out), "{} {}={}\n", length + digits, key, value);
+}
+
+/**
+ * Splits a path into the prefix and name fields of a ustar header, which can
+ * only happen at a slash. Returns false if it can't fit.
+ */
+static bool split_ustar_path(const std::string &path, char *prefix, char *name)
+{
+	if (path.size() <= 100) {
+		memcpy(name, path.data(), path.size());
+		return true;
+	}
+	size_t slash = path.find('/', path.size() > 101 ? path.size() - 101 : 0);
+	while (slash != std::string::npos && slash <= 155) {
+		if (slash > 0 && path.size() - slash - 1 <= 100) {
+			memcpy(prefix, path.data(), slash);
+			memcpy(name, path.data() + slash + 1, path.size() - slash - 1);
+			return true;
+		}
+		slash = path.find('/', slash + 1);
+	}
+	return false;
+}
+
+static std::string make_tar_header(const std::string &path, char type, uint64_t size, time_t mtime)
+{
+	std::string block(TAR_BLOCK_SIZE, '\0');
+	char *header = &block[0];
+	if (!split_ustar_path(path, header + 345, header)) {
+		// Still put what fits for readers that don't know pax
+		memcpy(header, path.data(), 100);
+	}
+	put_octal(header + 100, 8, 0644); // mode
+	put_octal(header + 108, 8, 0); // uid
+	put_octal(header + 116, 8, 0); // gid
+	put_octal(header + 124, 12, size > TAR_MAX_SIZE ? 0 : size);
+	put_octal(header + 136, 12, mtime < 0 ? 0 : (uint64_t)mtime);
+	header[156] = type;
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+	// The checksum is done as if its own field were spaces
+	memset(header + 148, ' ', 8);
+	unsigned int checksum = 0;
+	for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+		checksum += (unsigned char)header[i];
+	}
+	put_octal(header + 148, 7, checksum);
+	return block;
+}
+
+static size_t tar_padding(uint64_t size)
+{
+	return (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+}
+
+/**
+ * Compresses data as a gzip member of its own. Any number of them one after
+ * another is still one gzip file, so the entries a worker deflated can go in
+ * between these without being touched.
+ */
+bool TarWriter::write_gzip_member(const std::string &data)
+{
+	if (this->deflater == nullptr) {
+		this->deflater = new z_stream();
+		// 16 more window bits for a gzip header and trailer
+		if (deflateInit2(this->deflater, this->level, Z_DEFLATED,
+				MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			delete this->deflater;
+			this->deflater = nullptr;
+			errno = ENOMEM;
+			return false;
+		}
+	} else if (deflateReset(this->deflater) != Z_OK) {
+		errno = EINVAL;
+		return false;
+	}
+	this->compressed.resize(deflateBound(this->deflater, data.size()));
+	ptrdiff_t length = deflate_all(this->deflater, data.data(), data.size(),
+		&this->compressed[0], this->compressed.size());
+	if (length < 0) {
+		errno = EINVAL;
+		return false;
+	}
+	this->compressed.resize(length);
+	write(this->compressed);
+	return true;
+}
+
+/**
+ * Wraps a raw deflate stream in a gzip header and trailer.
+ */
+void TarWriter::write_deflated(const ArchiveEntry &entry)
+{
+	// Deflated, no flags or time, and from Unix
+	static const char gzip_header[] = { 0x1F, (char)0x8B, 8, 0, 0, 0, 0, 0, 0, 3 };
+	write(std::string(gzip_header, sizeof(gzip_header)));
+	write(*entry.data);
+	std::string trailer;
+	put_u32le(trailer, entry.crc);
+	put_u32le(trailer, (uint32_t)entry.uncompressed_size); // modulo 2^32
+	write(trailer);
+}
+
+/**
+ * Writes an entry with a pax header first if it has a comment or doesn't fit
+ * in a ustar header. Compressed entries can only be written when making a
+ * gzipped tar file.
+ */
+bool TarWriter::add(const ArchiveEntry &entry)
+{
+	if (entry.compressed && !this->gzip) {
+		errno = EINVAL;
+		return false;
+	}
+	std::string pax;
+	char prefix[155], name[100];
+	if (!split_ustar_path(entry.path, prefix, name)) {
+		put_pax_record(pax, "path", entry.path);
+	}
+	if (entry.uncompressed_size > TAR_MAX_SIZE) {
+		put_pax_record(pax, "size", fmt::format("{}", entry.uncompressed_size));
+	}
+	if (!entry.comment.empty()) {
+		put_pax_record(pax, "comment", entry.comment);
+	}
+
+	// Headers and padding are gathered, since gzipping each on its own
+	// would add more than they take
+	std::string &pending = this->pending;
+	if (!pax.empty()) {
+		std::string pax_name = "PaxHeader/" + entry.path.substr(entry.path.rfind('/') + 1);
+		pax_name.resize(pax_name.size() > 100 ? 100 : pax_name.size());
+		pending.append(make_tar_header(pax_name, 'x', pax.size(), entry.mtime));
+		pending.append(pax);
+		pending.append(tar_padding(pax.size()), '\0');
+	}
+	pending.append(make_tar_header(entry.path, '0', entry.uncompressed_size, entry.mtime));
+
+	if (!this->gzip) {
+		write(pending);
+		pending.clear();
+		write(*entry.data);
+	} else if (entry.compressed) {
+		if (!write_gzip_member(pending)) {
+			return false;
+		}
+		pending.clear();
+		write_deflated(entry);
+	} else {
+		pending.append(*entry.data);
+	}
+	pending.append(tar_padding(entry.uncompressed_size), '\0');
+	// Don't let what didn't compress pile up
+	if (this->gzip && pending.size() >= OUTPUT_BUFFER_SIZE) {
+		if (!write_gzip_member(pending)) {
+			return false;
+		}
+		pending.clear();
+	}
+	return this->sink.error == 0;
+}
+
+bool TarWriter::finish()
+{
+	// The end is marked by two empty blocks
+	this->pending.append(TAR_BLOCK_SIZE * 2, '\0');
+	if (this->gzip) {
+		if (!write_gzip_member(this->pending)) {
+			return false;
+		}
+	} else {
+		write(this->pending);
+	}
+	this->pending.clear();
+	return flush();
+}
@@ -0,0 +1,69 @@
+#!/QOpenSys/pkgs/bin/bash
+#
+# Compares the compression methods and levels pfzip can use on a library of
+# source members: how fast the archive is made (in MB of converted text per
+# second) and how big it is next to the text. Run from the top of the source
+# tree after building.
+#
+# usage: bench/compression.sh [members] [library] [jobs]
+
+set -e
+
+MEMBERS=${1:-500}
+LIBRARY=${2:-PFBENCH}
+JOBS=${3:-0}
+export PATH="$(pwd):$PATH"
+
+ARCHIVE=$(mktemp /tmp/pfgrep_bench.XXXXXXX).zip
+SOURCE=$(mktemp /tmp/pfgrep_bench.XXXXXXX)
+trap 'rm -f "$ARCHIVE" "$SOURCE"; system -q "DLTLIB $LIBRARY" > /dev/null 2>&1 || true' EXIT
+
+system -q "CRTLIB $LIBRARY" > /dev/null
+system -q "CRTSRCPF $LIBRARY/QRPGLESRC CCSID(37) RCDLEN(112)" > /dev/null
+for i in $(seq 1 "$MEMBERS"); do
+	# RPG-like source of a few hundred to a few thousand lines
+	awk -v seed="$i" 'BEGIN {
+		srand(seed)
+		lines = 200 + int(rand() * 2000)
+		for (n = 0; n < lines; n++) {
+			r = int(rand() * 4)
+			if (r == 0) {
+				printf "     C                   EVAL      WK%03d = WK%03d + %d\n", n % 100, (n + 7) % 100, n
+			} else if (r == 1) {
+				printf "     D WK%03d           S             %2d  %d INZ(%d)\n", n % 100, 5 + n % 20, n % 3, n
+			} else if (r == 2) {
+				printf "      * Member %d line %d: update the totals for order %d\n", seed, n, int(rand() * 100000)
+			} else {
+				printf "     C                   IF        WK%03d > %d\n     C                   LEAVE\n     C                   ENDIF\n", n % 100, n
+			}
+		}
+	}' > "$SOURCE"
+	system -q "ADDPFM $LIBRARY/QRPGLESRC M$i SRCTYPE(RPGLE) TEXT('Member $i')" > /dev/null
+	Rfile -w "/QSYS.LIB/$LIBRARY.LIB/QRPGLESRC.FILE/M$i.MBR" < "$SOURCE"
+done
+
+PF="/QSYS.LIB/$LIBRARY.LIB/QRPGLESRC.FILE"
+TEXT_BYTES=$(pfcat -r "$PF" | wc -c)
+echo "$MEMBERS members, $(( TEXT_BYTES / 1024 )) KB of text, -j $JOBS"
+printf "%-12s %10s %10s %8s\n" method "MB/s" "KB" ratio
+
+run() {
+	local method=$1 start end
+	# Discard the first run so every method starts with a warm cache
+	if ! pfzip -W -j "$JOBS" -Z "$method" -r "$ARCHIVE" "$PF" 2> /dev/null; then
+		printf "%-12s %s\n" "$method" "not supported"
+		return
+	fi
+	start=$(date +%s%N)
+	pfzip -W -j "$JOBS" -Z "$method" -r "$ARCHIVE" "$PF"
+	end=$(date +%s%N)
+	local size
+	size=$(wc -c < "$ARCHIVE")
+	awk -v m="$method" -v t="$TEXT_BYTES" -v s="$size" -v ns=$(( end - start )) 'BEGIN {
+		printf "%-12s %10.1f %10d %8.3f\n", m, (t / 1048576) / (ns / 1e9), s / 1024, s / t
+	}'
+}
+
+for method in store deflate:1 deflate deflate:9 bzip2 xz zstd:1 zstd zstd:19; do
+	run "$method"
+done
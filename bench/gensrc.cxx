@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Writes a made up source member to standard output, either as fixed length
+ * records in its CCSID (to copy into a member with CPYFRMSTMF) or as text.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "synth.hxx"
+
+static void usage(char *argv0)
+{
+	fprintf(stderr, "usage: %s [-t] [-l rpg|cl|c|mixed] [-r record length] [-c ccsid] [-n records] [-s seed]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+	SourceSpec spec = {LanguageRPG, 80, 37, 1000, 1};
+	bool text = false;
+	int ch;
+	while ((ch = getopt(argc, argv, "tl:r:c:n:s:h")) != -1) {
+		switch (ch) {
+		case 't':
+			text = true;
+			break;
+		case 'l':
+			if (!parse_language(optarg, spec.language)) {
+				fprintf(stderr, "%s: unknown language %s\n", argv[0], optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			spec.record_length = strtoul(optarg, nullptr, 10);
+			break;
+		case 'c':
+			spec.ccsid = atoi(optarg);
+			break;
+		case 'n':
+			spec.records = strtoul(optarg, nullptr, 10);
+			break;
+		case 's':
+			spec.seed = strtoul(optarg, nullptr, 10);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (spec.record_length == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::string output;
+	if (text) {
+		output = generate_lines(spec);
+	} else if (!generate_records(spec, output)) {
+		fprintf(stderr, "%s: can't convert to CCSID %d\n", argv[0], spec.ccsid);
+		return 1;
+	}
+	if (fwrite(output.data(), 1, output.size(), stdout) != output.size()) {
+		perror("fwrite");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+#
+# Makes a library like bench/library.sh does, but as a directory laid out the
+# way host.cxx reads it, so the tools can be run under perf, valgrind, or the
+# sanitizers somewhere other than i. Run from the top of the source tree after
+# building with "make bench", then point the tools at the directory.
+#
+# usage: bench/hostlib.sh [members per file] [directory]
+
+set -e
+
+MEMBERS=${1:-200}
+LIB=${2:-/tmp/PFBENCH.LIB}
+
+mkdir -p "$LIB"
+# file, language, record length (less sequence number and date), CCSID
+while read -r file language length ccsid; do
+	mkdir -p "$LIB/$file.FILE"
+	{
+		echo "record_length $(( length + 12 ))"
+		echo "ccsid $ccsid"
+		echo "source 1"
+	} > "$LIB/$file.FILE/.pfinfo"
+	for i in $(seq 1 "$MEMBERS"); do
+		bench/gensrc -l "$language" -r "$length" -c "$ccsid" -s "$i" \
+			-n $(( 200 + (i * 7919) % 2000 )) > "$LIB/$file.FILE/M$i.MBR"
+		echo "member M$i $language Made up by gensrc" >> "$LIB/$file.FILE/.pfinfo"
+	done
+done <<LIST
+QRPGLESRC rpg 100 37
+QCLSRC cl 80 273
+QCSRC c 80 500
+QMIXSRC mixed 80 939
+LIST
+
+echo "$(( MEMBERS * 4 )) members in $LIB"
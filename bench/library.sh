@@ -0,0 +1,57 @@
+#!/QOpenSys/pkgs/bin/bash
+#
+# Fills a library with made up source members from bench/gensrc, in a few
+# languages, record lengths, and CCSIDs, then times pfgrep and pfcat over it
+# in MB of text and lines per second. Run from the top of the source tree
+# after building with "make bench".
+#
+# usage: bench/library.sh [members per file] [library]
+
+set -e
+
+MEMBERS=${1:-200}
+LIBRARY=${2:-PFBENCH}
+export PATH="$(pwd):$PATH"
+
+RECORDS=$(mktemp /tmp/pfgrep_bench.XXXXXXX)
+trap 'rm -f "$RECORDS"; system -q "DLTLIB $LIBRARY" > /dev/null 2>&1 || true' EXIT
+
+system -q "CRTLIB $LIBRARY" > /dev/null
+# file, language, record length (less sequence number and date), CCSID
+while read -r file language length ccsid; do
+	system -q "CRTSRCPF $LIBRARY/$file CCSID($ccsid) RCDLEN($(( length + 12 )))" > /dev/null
+	for i in $(seq 1 "$MEMBERS"); do
+		bench/gensrc -l "$language" -r "$length" -c "$ccsid" -s "$i" \
+			-n $(( 200 + (i * 7919) % 2000 )) > "$RECORDS"
+		system -q "ADDPFM $LIBRARY/$file M$i" > /dev/null
+		system -q "CPYFRMSTMF FROMSTMF('$RECORDS') TOMBR('/QSYS.LIB/$LIBRARY.LIB/$file.FILE/M$i.MBR') MBROPT(*REPLACE) STMFCCSID($ccsid) ENDLINFMT(*FIXED)" > /dev/null
+	done
+done <<LIST
+QRPGLESRC rpg 100 37
+QCLSRC cl 80 273
+QCSRC c 80 500
+QMIXSRC mixed 80 939
+LIST
+
+LIB="/QSYS.LIB/$LIBRARY.LIB"
+TEXT_BYTES=$(pfcat -r "$LIB" | wc -c)
+TEXT_LINES=$(pfcat -r "$LIB" | wc -l)
+echo "$(( MEMBERS * 4 )) members, $(( TEXT_BYTES / 1024 )) KB, $TEXT_LINES lines"
+
+run() {
+	echo "== $*"
+	"$@" > /dev/null || true
+	local start end
+	start=$(date +%s%N)
+	"$@" > /dev/null || true
+	end=$(date +%s%N)
+	awk -v t="$TEXT_BYTES" -v l="$TEXT_LINES" -v ns=$(( end - start )) 'BEGIN {
+		printf "%.1f MB/s, %.0f lines/s\n", (t / 1048576) / (ns / 1e9), l / (ns / 1e9)
+	}'
+}
+
+run pfcat -r "$LIB"
+run pfgrep -r -c CUSTOMER "$LIB"
+run pfgrep -r -c -i customer "$LIB"
+run pfgrep -r -c 'EVAL\s+\w+' "$LIB"
+run pfgrep -r -c NOT_IN_THE_FILE "$LIB"
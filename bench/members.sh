@@ -0,0 +1,40 @@
+#!/QOpenSys/pkgs/bin/bash
+#
+# Times going through a library of many small members, where looking up
+# each member (path to object names, record length, description) costs more
+# than reading it. Prints the time per member. Run from the top of the
+# source tree after building.
+#
+# usage: bench/members.sh [members] [library]
+
+set -e
+
+MEMBERS=${1:-2000}
+LIBRARY=${2:-PFBENCH}
+export PATH="$(pwd):$PATH"
+
+CACHE=$(mktemp /tmp/pfgrep_bench.XXXXXXX)
+rm -f "$CACHE"
+trap 'rm -f "$CACHE"; system -q "DLTLIB $LIBRARY" > /dev/null 2>&1 || true' EXIT
+
+system -q "CRTLIB $LIBRARY" > /dev/null
+system -q "CRTSRCPF $LIBRARY/QTXTSRC CCSID(37) RCDLEN(92)" > /dev/null
+for i in $(seq 1 "$MEMBERS"); do
+	system -q "ADDPFM $LIBRARY/QTXTSRC M$i TEXT('Member $i')" > /dev/null
+done
+
+run() {
+	echo "== $*"
+	"$@" > /dev/null || true
+	local start end
+	start=$(date +%s%N)
+	"$@" > /dev/null || true
+	end=$(date +%s%N)
+	echo "$(( (end - start) / 1000 / MEMBERS )) us per member"
+}
+
+PF="/QSYS.LIB/$LIBRARY.LIB/QTXTSRC.FILE"
+run pfstat -r "$PF"
+run pfgrep -r -c NOT_IN_THE_FILE "$PF"
+# The first run fills the cache, which the timed run then uses
+run pfstat -r --metadata-cache "$CACHE" "$PF"
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Microbenchmarks for the hot paths: converting records into lines, matching
+ * lines against patterns, splitting a window into lines, and splitting the
+ * path of each member into names. Only the parts
+ * that don't touch files are here, so nothing else is in the timings; lines
+ * are matched with pfgrep's own loop from search.o. To time the tools as a
+ * whole on Linux, see bench/hostlib.sh.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "../common.hxx"
+#include "../search.hxx"
+#include "synth.hxx"
+
+struct Dataset {
+	const char *name;
+	SourceSpec spec;
+	std::string records;
+	// What read_records makes of them, to match against
+	std::string text;
+	size_t lines;
+	iconv_t conv;
+	SbcsTable *sbcs;
+};
+
+struct Benchmark {
+	const char *name;
+	// Returns how many lines matched, or were made
+	std::function<size_t(const Dataset&)> run;
+	bool wants_sbcs;
+};
+
+static pcre2_match_data *match_data;
+static const unsigned char *tables;
+// What the patterns were made from, which they keep a reference to
+static std::deque<std::string> expressions;
+
+static void usage(char *argv0)
+{
+	fprintf(stderr, "usage: %s [-t seconds] [-n records] [filter]\n", argv0);
+}
+
+/**
+ * Goes through the lines of the text like pfgrep::search_window, counting
+ * the ones that match. Lines are skipped if the patterns have a prefilter.
+ */
+static size_t search_text(const std::vector<Pattern> &patterns, const std::string &text)
+{
+	static std::vector<size_t> candidates;
+	static std::vector<string_view> substrings;
+	WindowLines lines(patterns, match_data, text.data(), text.size(), candidates);
+	size_t matches = 0;
+	while (lines.next(true, 0, nullptr)) {
+		if (lines.could_match && match_patterns(patterns, match_data, lines.line, lines.line_size, false, substrings)) {
+			matches++;
+		}
+	}
+	return matches;
+}
+
+/**
+ * A fixed string like -F makes, optionally with itself as the prefilter
+ * like pfgrep sets up for it.
+ */
+static std::vector<Pattern> make_literal(const char *needle, bool caseless, bool prefilter)
+{
+	expressions.emplace_back(needle);
+	std::vector<Pattern> patterns;
+	patterns.emplace_back(expressions.back(), nullptr, false);
+	patterns[0].literal = std::make_shared<LiteralMatcher>(needle, tables, caseless, false, false);
+	if (prefilter) {
+		patterns[0].prefilter = patterns[0].literal;
+	}
+	return patterns;
+}
+
+static std::vector<Pattern> make_regex(const char *expr)
+{
+	int error;
+	PCRE2_SIZE offset;
+	expressions.emplace_back(expr);
+	pcre2_code *re = pcre2_compile((PCRE2_SPTR)expr, PCRE2_ZERO_TERMINATED, 0, &error, &offset, nullptr);
+	if (re == nullptr || pcre2_jit_compile(re, PCRE2_JIT_COMPLETE) != 0) {
+		fprintf(stderr, "can't JIT compile %s\n", expr);
+		exit(1);
+	}
+	std::vector<Pattern> patterns;
+	patterns.emplace_back(expressions.back(), re, true);
+	return patterns;
+}
+
+static bool make_dataset(Dataset &dataset)
+{
+	if (!generate_records(dataset.spec, dataset.records)) {
+		fprintf(stderr, "%s: can't convert to CCSID %d (%s)\n", dataset.name,
+			dataset.spec.ccsid, iconv_name(dataset.spec.ccsid).c_str());
+		return false;
+	}
+	dataset.conv = iconv_open("UTF-8", iconv_name(dataset.spec.ccsid).c_str());
+	if (dataset.conv == (iconv_t)(-1)) {
+		perror("iconv_open");
+		return false;
+	}
+	dataset.sbcs = sbcs_table_build(dataset.conv);
+	std::string buffer(dataset.records.size() * UTF8_SCALE_FACTOR + dataset.spec.records, '\0');
+	ptrdiff_t length = records_convert(dataset.sbcs, dataset.conv, dataset.records.data(),
+		dataset.spec.records, dataset.spec.record_length, true, &buffer[0], buffer.size());
+	if (length == -1) {
+		perror("iconv");
+		return false;
+	}
+	buffer.resize(length);
+	dataset.text = std::move(buffer);
+	dataset.lines = lines_count(dataset.text.data(), dataset.text.data() + dataset.text.size());
+	return true;
+}
+
+static size_t convert_records(const Dataset &dataset, const SbcsTable *sbcs)
+{
+	static std::string buffer;
+	buffer.resize(dataset.records.size() * UTF8_SCALE_FACTOR + dataset.spec.records);
+	ptrdiff_t length = records_convert(sbcs, dataset.conv, dataset.records.data(),
+		dataset.spec.records, dataset.spec.record_length, true, &buffer[0], buffer.size());
+	return length == -1 ? 0 : dataset.spec.records;
+}
+
+/**
+ * Runs the benchmark until it's taken long enough to trust, then prints the
+ * throughput over the records (for conversion) or the text (for the rest).
+ */
+static void run_benchmark(const Benchmark &benchmark, const Dataset &dataset, double min_seconds)
+{
+	using clock = std::chrono::steady_clock;
+	size_t result = benchmark.run(dataset); // warm up
+	size_t iterations = 0;
+	auto start = clock::now();
+	double elapsed = 0;
+	do {
+		benchmark.run(dataset);
+		iterations++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < min_seconds);
+
+	bool converts = strncmp(benchmark.name, "records", 7) == 0;
+	double bytes = converts ? dataset.records.size() : dataset.text.size();
+	double lines = converts ? dataset.spec.records : dataset.lines;
+	printf("%-20s %-14s %10.1f %14.0f %10zu\n", benchmark.name, dataset.name,
+		(bytes * iterations / 1048576) / elapsed, lines * iterations / elapsed, result);
+}
+
+/**
+ * Makes paths like recursing through a few libraries gives, with some of the
+ * kinds that are less usual or left to the system mixed in.
+ */
+static std::vector<std::string> make_paths(size_t count)
+{
+	static const char *files[] = { "QRPGLESRC", "QCLSRC", "QCSRC", "QDDSSRC" };
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < count; i++) {
+		std::string library = "LIB" + std::to_string(i % 7);
+		std::string member = "M" + std::to_string((i * 7919) % 100000);
+		switch (i % 10) {
+		case 7:
+			library = "%LIBL%";
+			break;
+		case 8:
+			member = "\"m" + std::to_string(i % 1000) + "\"";
+			break;
+		case 9:
+			member = "M$" + std::to_string(i % 1000);
+			break;
+		}
+		paths.push_back("/QSYS.LIB/" + library + ".LIB/" + files[i % 4] + ".FILE/" + member + ".MBR");
+	}
+	return paths;
+}
+
+/**
+ * Like run_benchmark, but over paths, which are counted where lines are.
+ */
+static void run_path_benchmark(const char *name, const std::vector<std::string> &paths, double min_seconds)
+{
+	using clock = std::chrono::steady_clock;
+	std::string object, library, member;
+	auto run = [&] {
+		size_t parsed = 0;
+		for (const auto &path : paths) {
+			parsed += parse_qsys_path(path, object, library, member);
+		}
+		return parsed;
+	};
+	size_t result = run(); // warm up
+	size_t iterations = 0, bytes = 0;
+	for (const auto &path : paths) {
+		bytes += path.size();
+	}
+	auto start = clock::now();
+	double elapsed = 0;
+	do {
+		run();
+		iterations++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < min_seconds);
+
+	std::string dataset = std::to_string(paths.size()) + " paths";
+	printf("%-20s %-14s %10.1f %14.0f %10zu\n", name, dataset.c_str(),
+		((double)bytes * iterations / 1048576) / elapsed, (double)paths.size() * iterations / elapsed, result);
+}
+
+int main(int argc, char **argv)
+{
+	double min_seconds = 1;
+	size_t records = 100000;
+	int ch;
+	while ((ch = getopt(argc, argv, "t:n:h")) != -1) {
+		switch (ch) {
+		case 't':
+			min_seconds = atof(optarg);
+			break;
+		case 'n':
+			records = strtoul(optarg, nullptr, 10);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	const char *filter = optind < argc ? argv[optind] : nullptr;
+
+	tables = pcre2_maketables(nullptr);
+	match_data = pcre2_match_data_create(16, nullptr);
+
+	Dataset datasets[] = {
+		{"rpg/100/37", {LanguageRPG, 100, 37, records, 1}, "", "", 0, nullptr, nullptr},
+		{"cl/80/273", {LanguageCL, 80, 273, records, 2}, "", "", 0, nullptr, nullptr},
+		{"c/80/500", {LanguageC, 80, 500, records, 3}, "", "", 0, nullptr, nullptr},
+		// DBCS, so iconv does the conversion
+		{"mixed/80/939", {LanguageMixed, 80, 939, records, 4}, "", "", 0, nullptr, nullptr},
+	};
+
+	auto literal = make_literal("CUSTOMER", false, false);
+	auto caseless = make_literal("customer", true, false);
+	auto regex = make_regex("(?:EVAL|CHGVAR|compute_\\w+)\\W+\\w+");
+	auto prefiltered = make_literal("CUSTOMER", false, true);
+	Benchmark benchmarks[] = {
+		{"records/sbcs", [](const Dataset &d) { return convert_records(d, d.sbcs); }, true},
+		{"records/iconv", [](const Dataset &d) { return convert_records(d, nullptr); }, false},
+		{"lines/count", [](const Dataset &d) {
+			return lines_count(d.text.data(), d.text.data() + d.text.size());
+		}, false},
+		{"match/literal", [&](const Dataset &d) {
+			return search_text(literal, d.text);
+		}, false},
+		{"match/caseless", [&](const Dataset &d) {
+			return search_text(caseless, d.text);
+		}, false},
+		{"match/regex", [&](const Dataset &d) {
+			return search_text(regex, d.text);
+		}, false},
+		{"match/prefilter", [&](const Dataset &d) {
+			return search_text(prefiltered, d.text);
+		}, false},
+	};
+
+	printf("%-20s %-14s %10s %14s %10s\n", "benchmark", "dataset", "MB/s", "lines/s", "result");
+	for (auto &dataset : datasets) {
+		if (!make_dataset(dataset)) {
+			continue;
+		}
+		for (const auto &benchmark : benchmarks) {
+			if (filter != nullptr && strstr(benchmark.name, filter) == nullptr
+					&& strstr(dataset.name, filter) == nullptr) {
+				continue;
+			}
+			if (benchmark.wants_sbcs && dataset.sbcs == nullptr) {
+				continue;
+			}
+			run_benchmark(benchmark, dataset, min_seconds);
+		}
+	}
+	if (filter == nullptr || strstr("paths/qsys", filter) != nullptr) {
+		run_path_benchmark("paths/qsys", make_paths(10000), min_seconds);
+	}
+	return 0;
+}
@@ -0,0 +1,44 @@
+#!/QOpenSys/pkgs/bin/bash
+#
+# Compares reading a large streamfile by mapping it against reading it into
+# memory (--no-mmap), both in the PASE CCSID and in EBCDIC, which needs to be
+# converted. Run from the top of the source tree after building.
+#
+# usage: bench/streamfile.sh [megabytes]
+
+set -e
+
+SIZE_MB=${1:-1024}
+PATTERN='^NOT_IN_THE_FILE$'
+export PATH="$(pwd):$PATH"
+
+STMF_A=$(mktemp /tmp/pfgrep_bench.XXXXXXX)
+STMF_E=$(mktemp /tmp/pfgrep_bench.XXXXXXX)
+trap 'rm -f "$STMF_A" "$STMF_E"' EXIT
+
+# Log-like lines, about 100 bytes each
+awk -v bytes=$((SIZE_MB * 1024 * 1024)) 'BEGIN {
+	for (i = 0; written < bytes; i++) {
+		line = sprintf("2025-01-01 12:00:%02d.%06d INFO job %06d/QUSER/QZDASOINIT processed request %d ok", i % 60, i % 1000000, i % 1000000, i)
+		print line
+		written += length(line) + 1
+	}
+}' > "$STMF_A"
+setccsid 1208 "$STMF_A"
+/usr/bin/iconv -f UTF-8 -t IBM-037 < "$STMF_A" > "$STMF_E"
+setccsid 37 "$STMF_E"
+
+run() {
+	echo "== $*"
+	# Discard the first run so both cases start with a warm cache
+	"$@" > /dev/null || true
+	time ("$@" > /dev/null || true)
+}
+
+for file in "$STMF_A" "$STMF_E"; do
+	echo "### $(attr "$file" CCSID 2> /dev/null || true) ${SIZE_MB} MB"
+	run pfgrep -c "$PATTERN" "$file"
+	run pfgrep -c --no-mmap "$PATTERN" "$file"
+	run pfcat "$file"
+	run pfcat --no-mmap "$file"
+done
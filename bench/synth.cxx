@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#ifdef _AIX
+#include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+}
+
+#include <string>
+
+#include "synth.hxx"
+
+static const char *words[] = {
+	"CUSTOMER", "ORDER", "INVOICE", "TOTAL", "AMOUNT", "STATUS", "REGION",
+	"PRODUCT", "QTY", "PRICE", "DISCOUNT", "BALANCE", "ACCOUNT", "LEDGER",
+	"SHIPMENT", "VENDOR", "BATCH", "PERIOD", "RATE", "TAX", "WAREHOUSE",
+	"ITEM", "LINE", "DATE", "COUNT", "ERROR", "RETURN", "NAME", "ADDRESS",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static const char *comments[] = {
+	"Update the order totals for the region",
+	"Read the next customer record",
+	"Make sure the item is still in stock",
+	"Nothing to do if the batch was already posted",
+	"Work out the tax for each line",
+	"Send the message back to the caller",
+	"Keep going until end of file",
+	"Clear the work fields before the next pass",
+};
+#define COMMENT_COUNT (sizeof(comments) / sizeof(comments[0]))
+
+// Only used when the CCSID can have them, i.e. 930, 939, 1399, 5035
+static const char *dbcs_comments[] = {
+	"受注の合計を更新する",
+	"顧客マスタを読む",
+	"在庫数を確認する",
+	"請求書を印刷する",
+};
+#define DBCS_COMMENT_COUNT (sizeof(dbcs_comments) / sizeof(dbcs_comments[0]))
+
+// xorshift, so the same seed makes the same members everywhere
+class Random {
+public:
+	explicit Random(uint32_t seed) : state(seed != 0 ? seed : 1) {}
+	uint32_t next()
+	{
+		this->state ^= this->state << 13;
+		this->state ^= this->state >> 17;
+		this->state ^= this->state << 5;
+		return this->state;
+	}
+	uint32_t below(uint32_t n)
+	{
+		return next() % n;
+	}
+	const char *word()
+	{
+		return words[below(WORD_COUNT)];
+	}
+	const char *comment()
+	{
+		return comments[below(COMMENT_COUNT)];
+	}
+
+private:
+	uint32_t state;
+};
+
+template <typename... T>
+static std::string format(const char *fmt, T... args)
+{
+	char line[256];
+	snprintf(line, sizeof(line), fmt, args...);
+	return line;
+}
+
+/**
+ * Fixed form RPG, with a bit of free form mixed in like in most shops.
+ */
+static std::string rpg_line(Random &random)
+{
+	switch (random.below(12)) {
+	case 0:
+		return format("     C                   EVAL      %-6.6s = %-6.6s + %u", random.word(), random.word(), random.below(1000));
+	case 1:
+		return format("     C     %-14.14sCHAIN     %-10.10s", random.word(), random.word());
+	case 2:
+		return format("     D %-15.15s S             %2u %u", random.word(), 1 + random.below(30), random.below(3));
+	case 3:
+		return format("      * %s", random.comment());
+	case 4:
+		return format("     C                   IF        %-6.6s > %u", random.word(), random.below(100));
+	case 5:
+		return "     C                   ENDIF";
+	case 6:
+		return format("     C                   CALLP     %s(%s)", random.word(), random.word());
+	case 7:
+		return format("       dcl-s %s char(%u);", random.word(), 1 + random.below(50));
+	case 8:
+		return format("       if %s = '%s';", random.word(), random.word());
+	case 9:
+		return format("         %s += %u;", random.word(), random.below(100));
+	case 10:
+		return "       endif;";
+	default:
+		return "";
+	}
+}
+
+static std::string cl_line(Random &random)
+{
+	switch (random.below(9)) {
+	case 0:
+		return format("             DCL        VAR(&%.10s) TYPE(*CHAR) LEN(%u)", random.word(), 1 + random.below(256));
+	case 1:
+		return format("             CHGVAR     VAR(&%.10s) VALUE('%s')", random.word(), random.word());
+	case 2:
+		return format("             IF         COND(&%.10s *EQ '%s') THEN(DO)", random.word(), random.word());
+	case 3:
+		return "             ENDDO";
+	case 4:
+		return "             MONMSG     MSGID(CPF0000)";
+	case 5:
+		return format("             SNDPGMMSG  MSG('%s') TOPGMQ(*EXT)", random.comment());
+	case 6:
+		return format("/* %s */", random.comment());
+	case 7:
+		return format("             CALL       PGM(%.10s) PARM(&%.10s)", random.word(), random.word());
+	default:
+		return "";
+	}
+}
+
+static std::string c_line(Random &random)
+{
+	switch (random.below(10)) {
+	case 0:
+		return format("#include <%s.h>", random.word());
+	case 1:
+		return format("static int get_%s(const char *%s, size_t length)", random.word(), random.word());
+	case 2:
+		return "{";
+	case 3:
+		return "}";
+	case 4:
+		return format("    for (size_t i = 0; i < %s_count; i++) {", random.word());
+	case 5:
+		return format("        %s[i] = compute_%s(%s, %u);", random.word(), random.word(), random.word(), random.below(100));
+	case 6:
+		return format("    if (%s == NULL) {", random.word());
+	case 7:
+		return "        return -1;";
+	case 8:
+		return format("/* %s */", random.comment());
+	default:
+		return "";
+	}
+}
+
+static std::string make_line(const SourceSpec &spec, Random &random, SourceLanguage language)
+{
+	switch (language) {
+	case LanguageRPG:
+		return rpg_line(random);
+	case LanguageCL:
+		return cl_line(random);
+	case LanguageC:
+		return c_line(random);
+	default:
+		if (random.below(20) == 0) {
+			return format("      * %s", dbcs_comments[random.below(DBCS_COMMENT_COUNT)]);
+		}
+		return make_line(spec, random, (SourceLanguage)random.below(3));
+	}
+}
+
+bool parse_language(const char *name, SourceLanguage &language)
+{
+	if (strcmp(name, "rpg") == 0) {
+		language = LanguageRPG;
+	} else if (strcmp(name, "cl") == 0) {
+		language = LanguageCL;
+	} else if (strcmp(name, "c") == 0) {
+		language = LanguageC;
+	} else if (strcmp(name, "mixed") == 0) {
+		language = LanguageMixed;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * What iconv calls the CCSID here, which differs between PASE and glibc.
+ */
+std::string iconv_name(int ccsid)
+{
+	if (ccsid == 1208) {
+		return "UTF-8";
+	}
+#ifdef _AIX
+	return format("IBM-%03d", ccsid);
+#else
+	return format("IBM%03d", ccsid);
+#endif
+}
+
+/**
+ * Makes the lines of a member as UTF-8 text, one per record.
+ */
+std::string generate_lines(const SourceSpec &spec)
+{
+	Random random(spec.seed);
+	std::string text;
+	for (size_t i = 0; i < spec.records; i++) {
+		text.append(make_line(spec, random, spec.language));
+		text.push_back('\n');
+	}
+	return text;
+}
+
+/**
+ * Makes the records of a member in its CCSID, each space padded (or cut) to
+ * the record length. Lines that can't be converted, like DBCS ones in a
+ * CCSID without DBCS, are left blank.
+ */
+bool generate_records(const SourceSpec &spec, std::string &records)
+{
+	std::string name = iconv_name(spec.ccsid);
+	iconv_t conv = iconv_open(name.c_str(), "UTF-8");
+	if (conv == (iconv_t)(-1)) {
+		return false;
+	}
+	char space;
+	{
+		char in_space = ' ', *in = &in_space, *out = &space;
+		size_t inleft = 1, outleft = 1;
+		if (iconv(conv, &in, &inleft, &out, &outleft) == (size_t)-1) {
+			iconv_close(conv);
+			return false;
+		}
+	}
+
+	Random random(spec.seed);
+	std::string converted(spec.record_length * 4, '\0');
+	records.clear();
+	records.reserve(spec.records * spec.record_length);
+	for (size_t i = 0; i < spec.records; i++) {
+		std::string line = make_line(spec, random, spec.language);
+		char *in = &line[0], *out = &converted[0];
+		size_t inleft = line.size(), outleft = converted.size();
+		size_t length = 0;
+		iconv(conv, nullptr, nullptr, nullptr, nullptr);
+		if (iconv(conv, &in, &inleft, &out, &outleft) != (size_t)-1
+				&& iconv(conv, nullptr, nullptr, &out, &outleft) != (size_t)-1) {
+			length = out - &converted[0];
+		}
+		// Cutting a DBCS line could leave it without its shift in, so
+		// only cut lines that stayed one byte per character
+		if (length > spec.record_length) {
+			length = length == line.size() ? spec.record_length : 0;
+		}
+		records.append(converted, 0, length);
+		records.append(spec.record_length - length, space);
+	}
+	iconv_close(conv);
+	return true;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Makes up source members that look like what's in real libraries, so the
+ * benchmarks have something to chew on that isn't just the same line.
+ */
+
+enum SourceLanguage {
+	LanguageRPG,
+	LanguageCL,
+	LanguageC,
+	// All of the above, with DBCS comments if the CCSID has them
+	LanguageMixed,
+};
+
+typedef struct pfgrep_source_spec {
+	SourceLanguage language;
+	// Of the source data, not counting the sequence number and date
+	size_t record_length;
+	int ccsid;
+	size_t records;
+	uint32_t seed;
+} SourceSpec;
+
+bool parse_language(const char *name, SourceLanguage &language);
+std::string iconv_name(int ccsid);
+std::string generate_lines(const SourceSpec &spec);
+bool generate_records(const SourceSpec &spec, std::string &records);
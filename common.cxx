@@ -5,16 +5,19 @@
  */
 
 extern "C" {
-#include <as400_protos.h>
-#include <as400_types.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/errno.h>
-#include <sys/mode.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef _AIX
 #include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
 
 #include "errc.h"
 }
@@ -34,9 +37,124 @@ void pfbase::print_version(const char *tool_name)
 	fmt::println(stderr, "Written by Calvin Buckley and others, see <https://github.com/SeidenGroup/pfgrep/graphs/contributors>");
 }
 
+/**
+ * Uses the metadata cache at path for members, for --metadata-cache. If it
+ * can't be read, members are looked up as usual, and it's rewritten at the end.
+ */
+void pfbase::open_metadata_cache(const char *path)
+{
+	auto cache = std::make_shared<MetadataCache>();
+	if (!cache->open(path) && !this->silent) {
+		std::string msg = fmt::format("opening metadata cache {}", path);
+		perror(msg.c_str());
+	}
+	this->metadata_cache = cache;
+}
+
+/**
+ * Prints what --stats counted. Call once everything's been written out.
+ */
+void pfbase::print_stats(const char *tool_name)
+{
+	if (this->stats) {
+		this->stats->print(tool_name);
+	}
+}
+
+void pfbase::count_skip(SkipReason reason)
+{
+	if (this->stats) {
+		this->stats->skipped[reason]++;
+	}
+}
+
+/**
+ * Parses the argument to -j. Zero means one worker per online processor.
+ */
+unsigned int parse_worker_count(const char *arg)
+{
+	int count = atoi(arg);
+	if (count == 0) {
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	return count > 1 ? count : 1;
+}
+
+/**
+ * Parses the argument to --newer-than and --older-than, which is either a
+ * local date and time (YYYY-MM-DD, optionally followed by HH:MM or HH:MM:SS)
+ * or a file to take the modification time of. Prints why if it can't.
+ */
+bool pfbase::parse_time(const char *arg, time_t &when)
+{
+	static const char *formats[] = {
+		"%Y-%m-%d %H:%M:%S",
+		"%Y-%m-%dT%H:%M:%S",
+		"%Y-%m-%d %H:%M",
+		"%Y-%m-%dT%H:%M",
+		"%Y-%m-%d",
+	};
+	for (const char *format : formats) {
+		struct tm tm = {};
+		const char *end = strptime(arg, format, &tm);
+		if (end != nullptr && *end == '\0') {
+			tm.tm_isdst = -1;
+			when = mktime(&tm);
+			return when != (time_t)-1;
+		}
+	}
+	FileStatus status = {};
+	if (!this->platform->stat(arg, status)) {
+		fmt::println(stderr, "{}: Not a date (YYYY-MM-DD [HH:MM[:SS]]) or a file", arg);
+		return false;
+	}
+	when = status.mtime;
+	return true;
+}
+
+/**
+ * Like getopt, but also handles the long options given (--name, --name=arg,
+ * or --name arg), since PASE doesn't have getopt_long.
+ */
+int get_option(int argc, char **argv, const char *optstring, const LongOption *long_options)
+{
+	// getopt isn't in the middle of a group of short options if optind is
+	// pointing at a long option, so it's safe to step in here.
+	if (optind < argc && strncmp(argv[optind], "--", 2) == 0 && argv[optind][2] != '\0') {
+		const char *name = argv[optind] + 2;
+		const char *equals = strchr(name, '=');
+		size_t name_length = equals ? (size_t)(equals - name) : strlen(name);
+		for (const LongOption *option = long_options; option && option->name; option++) {
+			if (strlen(option->name) != name_length || strncmp(option->name, name, name_length) != 0) {
+				continue;
+			}
+			optind++;
+			if (option->has_arg && equals) {
+				optarg = (char*)(equals + 1);
+			} else if (option->has_arg && optind < argc) {
+				optarg = argv[optind++];
+			} else if (option->has_arg || equals) {
+				fprintf(stderr, "%s: option --%s %s an argument\n", argv[0],
+					option->name, option->has_arg ? "requires" : "doesn't take");
+				return '?';
+			} else {
+				optarg = nullptr;
+			}
+			return option->value;
+		}
+		fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[optind]);
+		optind++;
+		return '?';
+	}
+	return getopt(argc, argv, optstring);
+}
+
 pfbase::pfbase()
 {
-	this->pase_ccsid = Qp2paseCCSID();
+	this->platform = make_platform();
+	this->pase_ccsid = platform_text_ccsid();
+	this->sink = std::make_shared<OutputSink>(STDOUT_FILENO);
+	this->member_lister = this->platform->make_member_lister();
 }
 
 pfbase::~pfbase()
@@ -47,120 +165,426 @@ pfbase::~pfbase()
 	free_cached_iconv();
 	free(this->read_buffer);
 	free(this->conv_buffer);
+#else
+	// Workers come and go with the pool, so don't leak their buffers
+	if (this->is_worker) {
+		free(this->read_buffer);
+		free(this->conv_buffer);
+	}
 #endif
 }
 
-bool pfbase::read_records(const File &file, iconv_t conv)
+/**
+ * Resets the per-thread state of an object copied from the main one, so the
+ * worker doesn't share buffers with the object it was copied from.
+ */
+void pfbase::init_worker()
+{
+	this->read_buffer = nullptr;
+	this->read_buffer_size = 0;
+	this->conv_buffer = nullptr;
+	this->conv_buffer_size = 0;
+	this->output.clear();
+	this->pool = nullptr;
+	this->is_worker = true;
+	this->visited_directories.clear();
+	if (this->stats) {
+		this->stats = std::make_shared<Stats>();
+	}
+}
+
+/**
+ * Writes out the output of a job. This is always called in traversal order,
+ * no matter which thread the job ran on.
+ */
+void pfbase::commit_job(Job &job)
 {
-	size_t read_buf_size = file.file_size + 1;
+	this->sink->write(job.output);
+	// What didn't need converting is written straight from the file
+	if (job.file.keep_map) {
+		this->sink->write(job.file.map, job.file.map_size);
+		unload_streamfile(job.file);
+	}
+	this->sink->end_file();
+}
+
+/**
+ * By default, every file is read.
+ */
+bool pfbase::rule_out(const File &)
+{
+	return false;
+}
+
+/**
+ * Reads until the buffer is full or the end of the file, since a single read
+ * can come up short. Returns bytes read, or -1 on error.
+ */
+static ssize_t read_fully(int fd, char *buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size) {
+		ssize_t bytes_read = read(fd, buffer + total, size - total);
+		if (bytes_read == -1) {
+			return -1;
+		} else if (bytes_read == 0) {
+			break;
+		}
+		total += bytes_read;
+	}
+	return total;
+}
+
+/**
+ * Reads the next batch of records as they are, without converting them. The
+ * window is a whole number of records. Returns like next_window.
+ */
+int pfbase::next_raw_records(File &file, Window &window)
+{
+	size_t records_left = SIZE_MAX;
+	if (file.record_count > 0) {
+		records_left = file.record_count - file.records_read;
+	}
+	size_t window_records = RECORD_WINDOW_SIZE / file.record_length;
+	if (window_records == 0) {
+		window_records = 1;
+	}
+	if (window_records > records_left) {
+		window_records = records_left;
+	}
+	if (window_records == 0) {
+		return 0;
+	}
+
+	size_t read_buf_size = (window_records * file.record_length) + 1;
 	if (read_buf_size > this->read_buffer_size) {
 		this->read_buffer = (char*)realloc(this->read_buffer, read_buf_size);
 		this->read_buffer_size = read_buf_size;
 	}
-	int bytes_to_read = file.file_size;
-	// Read the whole file in
-	while ((bytes_to_read = read(file.fd, this->read_buffer, bytes_to_read)) != 0) {
-		if (bytes_to_read == -1) {
-			if (!this->silent) {
-				std::string msg;
-				msg = fmt::format("read({}, {})", file.short_filename, bytes_to_read);
-				perror_xpf(msg.c_str());
-			}
-			return false;
+	ssize_t bytes_read;
+	{
+		StatsTimer timer(this->stats.get(), PhaseRead);
+		bytes_read = read_fully(file.fd, this->read_buffer, window_records * file.record_length);
+	}
+	if (bytes_read == -1) {
+		if (!this->silent) {
+			std::string msg;
+			msg = fmt::format("read({}, {})", file.short_filename, window_records * file.record_length);
+			perror_xpf(msg.c_str());
 		}
+		return -1;
 	}
-	this->read_buffer[file.file_size] = '\0';
-
-	size_t record_count = file.record_count;
-	if (record_count <= 0) {
-		record_count = file.file_size / file.record_length;
+	// Any partial record at the end is ignored, like before
+	size_t record_count = bytes_read / file.record_length;
+	if (record_count == 0) {
+		return 0;
 	}
-	// record length * 6 for worst case UTF-8 conv + newline
-	size_t conv_buf_size = (file.file_size * UTF8_SCALE_FACTOR) + record_count + 1;
+	file.records_read += record_count;
+	if (this->stats) {
+		this->stats->bytes_read += bytes_read;
+	}
+
+	window.data = this->read_buffer;
+	window.length = record_count * file.record_length;
+	return 1;
+}
+
+/**
+ * Turns the records of a file with a record format into text a field at a
+ * time, a line per record.
+ */
+int pfbase::decode_records(File &file, const Window &raw, size_t record_count, Window &window)
+{
+	size_t line_size = file.format->max_text_length + 1;
+	size_t conv_buf_size = (record_count * line_size) + 1;
 	if (conv_buf_size > this->conv_buffer_size) {
 		this->conv_buffer = (char*)realloc(this->conv_buffer, conv_buf_size);
 		this->conv_buffer_size = conv_buf_size;
 	}
+	StatsTimer timer(this->stats.get(), PhaseConvert);
 	char *out = this->conv_buffer;
-	size_t outleft = conv_buf_size;
 	for (size_t record_num = 0; record_num < record_count; record_num++) {
-		char *record = this->read_buffer + (record_num * file.record_length);
-		// Converted record is on a 6x multiplier due to possible
-		// worst case EBCDIC->UTF-8 conversion
-		char *in = record;
+		const char *record = raw.data + (record_num * file.record_length);
 		char *beginning = out;
-		size_t inleft = file.record_length;
-		int rc = iconv(conv, &in, &inleft, &out, &outleft);
-		if (rc != 0) {
-			perror("iconv");
-			return false;
-		}
-		// Trim buffer to end of iconv plus trim spaces,
-		// as SRCPFs are fixed length and space padded,
-		// so $ works like expected
+		out += decode_record(*file.format, record, file.ccsid, out);
 		if (!this->dont_trim_ending_whitespace) {
-			while (out >= beginning && *(out - 1) == ' ') {
-				*out-- = '\0';
-				outleft++;
+			while (out > beginning && *(out - 1) == ' ') {
+				out--;
 			}
 		}
 		*out++ = '\n';
-		outleft--;
 	}
-	*out++ = '\0';
-	outleft--;
+	*out = '\0';
 
-	return true;
+	window.data = this->conv_buffer;
+	window.length = out - this->conv_buffer;
+	if (this->stats) {
+		this->stats->bytes_converted += raw.length;
+		this->stats->text_bytes += window.length;
+	}
+	return 1;
 }
 
-bool pfbase::read_streamfile(const File &file, iconv_t conv)
+/**
+ * Reads the next batch of records into the read buffer and converts them into
+ * the conversion buffer, a line per record. The buffers are sized for a batch
+ * rather than the member, so memory use doesn't grow with the member's size.
+ */
+int pfbase::read_records(File &file, Window &window)
 {
-	size_t read_buf_size = file.file_size + 1;
-	if (read_buf_size > this->read_buffer_size) {
-		this->read_buffer = (char*)realloc(this->read_buffer, read_buf_size);
-		this->read_buffer_size = read_buf_size;
+	Window raw;
+	int rc = next_raw_records(file, raw);
+	if (rc <= 0) {
+		return rc;
 	}
-	int bytes_to_read = file.file_size;
-	size_t record_count = file.file_size;
-	// Assume max length plus newline character for each line
-	size_t conv_buf_size = read_buf_size + record_count;
+	size_t record_count = raw.length / file.record_length;
+	if (file.format != nullptr) {
+		return decode_records(file, raw, record_count, window);
+	}
+
+	// record length * 6 for worst case UTF-8 conv + newline
+	size_t conv_buf_size = (record_count * file.record_length * UTF8_SCALE_FACTOR) + record_count + 1;
 	if (conv_buf_size > this->conv_buffer_size) {
 		this->conv_buffer = (char*)realloc(this->conv_buffer, conv_buf_size);
 		this->conv_buffer_size = conv_buf_size;
 	}
-	// Read the whole file in
-	while ((bytes_to_read = read(file.fd, this->read_buffer, bytes_to_read)) != 0) {
-		if (bytes_to_read == -1) {
-			if (!this->silent) {
-				std::string msg;
-				msg = fmt::format("read({}, {})", file.full_filename, bytes_to_read);
-				perror_xpf(msg.c_str());
+	ptrdiff_t length;
+	{
+		StatsTimer timer(this->stats.get(), PhaseConvert);
+		length = records_convert(file.sbcs, file.conv, raw.data, record_count,
+			file.record_length, !this->dont_trim_ending_whitespace,
+			this->conv_buffer, conv_buf_size - 1);
+	}
+	if (length == -1) {
+		perror("iconv");
+		return -1;
+	}
+	this->conv_buffer[length] = '\0';
+	if (this->stats) {
+		this->stats->bytes_converted += raw.length;
+		this->stats->text_bytes += length;
+	}
+
+	window.data = this->conv_buffer;
+	window.length = length;
+	return 1;
+}
+
+/**
+ * Makes the whole streamfile available at file.map, by mapping it if we can
+ * and reading it into the read buffer if we can't.
+ */
+bool pfbase::load_streamfile(File &file)
+{
+	std::string msg;
+	// A mapped file is really read as it's touched, so that's counted
+	// in whatever phase touches it
+	StatsTimer timer(this->stats.get(), PhaseRead);
+	// The size could've changed since we stat'd it, and touching a page
+	// past the end of a mapped file is fatal
+	struct stat64 s = {};
+	if (fstat64(file.fd, &s) == 0) {
+		file.file_size = s.st_size;
+	}
+	file.map_size = file.file_size;
+	if (file.map_size == 0) {
+		return true;
+	}
+
+	if (this->use_mmap) {
+		void *map = mmap(nullptr, file.map_size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+		if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise(map, file.map_size, MADV_SEQUENTIAL);
+#endif
+			file.map = (char*)map;
+			file.is_mapped = true;
+			if (this->stats) {
+				this->stats->bytes_read += file.map_size;
 			}
-			return false;
+			return true;
 		}
+		// Fall back to reading, i.e. for filesystems that can't map
 	}
-	this->read_buffer[file.file_size] = '\0';
 
-	// Skip the copy, we'll just work against the read buffer directly.
+	size_t read_buf_size = file.map_size + 1;
+	if (read_buf_size > this->read_buffer_size) {
+		this->read_buffer = (char*)realloc(this->read_buffer, read_buf_size);
+		this->read_buffer_size = read_buf_size;
+	}
+	ssize_t bytes_read = read_fully(file.fd, this->read_buffer, file.map_size);
+	if (bytes_read == -1) {
+		if (!this->silent) {
+			msg = fmt::format("read({}, {})", file.full_filename, file.map_size);
+			perror_xpf(msg.c_str());
+		}
+		return false;
+	}
+	this->read_buffer[bytes_read] = '\0';
+	file.map = this->read_buffer;
+	file.map_size = bytes_read;
+	if (this->stats) {
+		this->stats->bytes_read += bytes_read;
+	}
+	return true;
+}
+
+void pfbase::unload_streamfile(File &file)
+{
+	if (file.is_mapped) {
+		munmap(file.map, file.map_size);
+	}
+	file.map = nullptr;
+	file.is_mapped = false;
+}
+
+/**
+ * Hands out a streamfile. If it's in the PASE CCSID, that's the whole file in
+ * place. Otherwise, it's converted a piece at a time, cut at the last newline
+ * so lines don't cross windows; the rest is carried into the next window.
+ */
+int pfbase::read_streamfile(File &file, Window &window)
+{
+	if (file.map == nullptr) {
+		if (file.stream_offset > 0 || file.records_read > 0) {
+			return 0; // done, or empty
+		}
+		// Streamfiles have no records, so this marks it as loaded
+		file.records_read = 1;
+		if (!load_streamfile(file) || file.map_size == 0) {
+			return file.map_size == 0 ? 0 : -1;
+		}
+	}
+
+	// Skip the copy, we'll just work against the file directly.
 	// Save an unnecessary iconv and conversion.
 	if (file.ccsid == this->pase_ccsid) {
-		this->conv_buffer[0] = '\0';
-		return true;
+		if (file.stream_offset == file.map_size) {
+			return 0;
+		}
+		file.stream_offset = file.map_size;
+		window.data = file.map;
+		window.length = file.map_size;
+		return 1;
 	}
 
-	char *in = this->read_buffer;
-	size_t inleft = file.file_size;
-	char *out = this->conv_buffer;
-	size_t outleft = conv_buf_size;
-	int rc = iconv(conv, &in, &inleft, &out, &outleft);
-	if (rc != 0) {
-		perror("iconv");
-		return false;
+	// Move what was left after the last newline to the front
+	if (file.carry_length > 0) {
+		memmove(this->conv_buffer, this->conv_buffer + file.carry_offset, file.carry_length);
+	} else if (file.stream_offset == file.map_size) {
+		return 0;
+	}
+	size_t produced = file.carry_length;
+	size_t cut = 0;
+	size_t converted_from = file.stream_offset;
+	StatsTimer timer(this->stats.get(), PhaseConvert);
+	while (true) {
+		size_t in_size = file.map_size - file.stream_offset;
+		if (in_size > STREAM_WINDOW_SIZE) {
+			in_size = STREAM_WINDOW_SIZE;
+		}
+		size_t conv_buf_size = produced + (in_size * UTF8_SCALE_FACTOR) + 1;
+		if (conv_buf_size > this->conv_buffer_size) {
+			this->conv_buffer = (char*)realloc(this->conv_buffer, conv_buf_size);
+			this->conv_buffer_size = conv_buf_size;
+		}
+		char *in = file.map + file.stream_offset;
+		size_t inleft = in_size;
+		char *out = this->conv_buffer + produced;
+		size_t outleft = conv_buf_size - produced - 1;
+		if (file.sbcs != nullptr) {
+			out += sbcs_convert(file.sbcs, in, in_size, out);
+			inleft = 0;
+		} else {
+			int rc = iconv(file.conv, &in, &inleft, &out, &outleft);
+			// A multibyte character split by the end of the window is
+			// fine, the rest of it is converted with the next window.
+			bool split_character = rc == -1 && errno == EINVAL
+				&& file.stream_offset + in_size < file.map_size;
+			if (rc != 0 && !split_character) {
+				perror("iconv");
+				return -1;
+			}
+		}
+		file.stream_offset += in_size - inleft;
+		produced = out - this->conv_buffer;
+		if (file.stream_offset == file.map_size) {
+			cut = produced;
+			break;
+		}
+		cut = produced;
+		while (cut > 0 && this->conv_buffer[cut - 1] != '\n') {
+			cut--;
+		}
+		if (cut > 0) {
+			break;
+		}
+		// No newline yet, so the line is longer than a window; keep going
+	}
+	this->conv_buffer[produced] = '\0';
+	file.carry_offset = cut;
+	file.carry_length = produced - cut;
+	if (this->stats) {
+		this->stats->bytes_converted += file.stream_offset - converted_from;
+		this->stats->text_bytes += cut;
 	}
-	*out++ = '\0';
-	outleft--;
 
-	return true;
+	window.data = this->conv_buffer;
+	window.length = cut;
+	return 1;
+}
+
+/**
+ * Gets the next piece of the file's text, converted to the PASE CCSID. This
+ * is valid until the next call. Returns 1 if there's a window, 0 at the end
+ * of the file, and -1 on error (after printing it).
+ */
+int pfbase::next_window(File &file, Window &window)
+{
+	if (this->dont_read_file) {
+		return 0;
+	}
+	// Streamfiles are record length 0, and must be read differently
+	if (file.record_length == 0) {
+		return read_streamfile(file, window);
+	}
+	return read_records(file, window);
+}
+
+/**
+ * Recurses through a physical file, listing all of its members in one go
+ * first, so each doesn't need its own calls to find its names, record length,
+ * and description. If it can't be listed, members are looked up as usual.
+ */
+int pfbase::do_physical_file(File &file)
+{
+	MemberList list = {};
+	const MemberList *outer = this->member_list;
+	int ret;
+	{
+		StatsTimer timer(this->stats.get(), PhaseConvertPath);
+		ret = this->platform->filename_to_libobj(file);
+	}
+	if (ret != -1) {
+		memcpy(list.libobj, file.libobj, sizeof(list.libobj));
+		{
+			StatsTimer timer(this->stats.get(), PhaseFileInfo);
+			list.pf_info = this->platform->get_pf_info(file);
+		}
+		// Not worth listing members that'll be skipped anyway
+		bool usable = list.pf_info > 0 || (list.pf_info < 0 && this->search_non_source_files);
+		bool listed = false;
+		if (usable) {
+			StatsTimer timer(this->stats.get(), PhaseMemberList);
+			listed = load_member_list(*this->member_lister, list);
+		}
+		if (listed) {
+			this->member_list = &list;
+		}
+	}
+	ret = do_directory(file.full_filename.c_str());
+	this->member_list = outer;
+	return ret;
 }
 
 /**
@@ -170,7 +594,11 @@ int pfbase::do_directory(const char *directory)
 {
 	std::string msg;
 	int files_matched = 0;
-	DIR *dir = opendir(directory);
+	DIR *dir;
+	{
+		StatsTimer timer(this->stats.get(), PhaseReaddir);
+		dir = opendir(directory);
+	}
 	if (dir == NULL) {
 		if (!this->silent) {
 			msg = fmt::format("opendir({})", directory);
@@ -195,7 +623,14 @@ int pfbase::do_directory(const char *directory)
 		}
 		return -1;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while (true) {
+		{
+			StatsTimer timer(this->stats.get(), PhaseReaddir);
+			dirent = readdir(dir);
+		}
+		if (dirent == NULL) {
+			break;
+		}
 		if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
 			continue;
 		}
@@ -227,51 +662,106 @@ int pfbase::do_directory(const char *directory)
 	return files_matched;
 }
 
+/**
+ * Gets a member from the list of the physical file being recursed into, if
+ * it's in there, filling in its object names.
+ */
+bool pfbase::find_listed_member(File &file, MemberMetadata &metadata)
+{
+	if (this->member_list == nullptr) {
+		return false;
+	}
+	auto found = this->member_list->members.find(std::string(file.short_filename.data(), file.short_filename.size()));
+	if (found == this->member_list->members.end()) {
+		return false;
+	}
+	memcpy(file.libobj, this->member_list->libobj, sizeof(file.libobj));
+	memcpy(file.member, found->second.member, sizeof(file.member));
+	metadata = found->second.metadata;
+	return true;
+}
+
 bool pfbase::set_record_length(File &file)
 {
-	// Determine the record length, the API to do this needs traditional paths.
-	// Note that it will resolve symlinks for us, so i.e. /QIBM/include works
-	int ret = filename_to_libobj(file);
-	if (ret == -1) {
-		if (!this->silent) {
-			fmt::println(stderr, "filename_to_libobj({}): Failed to convert IFS path to object name",
-				file.full_filename);
+	MemberMetadata metadata = {};
+	bool cached = find_listed_member(file, metadata);
+	if (cached && this->stats) {
+		this->stats->listed_hits++;
+	}
+	if (!cached) {
+		// Determine the record length, the API to do this needs traditional paths.
+		// Note that it will resolve symlinks for us, so i.e. /QIBM/include works
+		int ret;
+		{
+			StatsTimer timer(this->stats.get(), PhaseConvertPath);
+			ret = this->platform->filename_to_libobj(file);
+		}
+		if (ret == -1) {
+			if (!this->silent) {
+				fmt::println(stderr, "filename_to_libobj({}): Failed to convert IFS path to object name",
+					file.full_filename);
+			}
+			count_skip(SkipNoObjectName);
+			return false;
+		}
+		cached = this->metadata_cache && this->metadata_cache->find(file, metadata);
+		if (this->metadata_cache && this->stats) {
+			(cached ? this->stats->cache_hits : this->stats->cache_misses)++;
 		}
-		return false;
 	}
-	int file_record_size = get_pf_info(file);
+	int file_record_size = metadata.pf_info;
+	if (!cached) {
+		StatsTimer timer(this->stats.get(), PhaseFileInfo);
+		file_record_size = this->platform->get_pf_info(file);
+	}
 	if (file_record_size == 0 && errno == ENODEV) {
 		// Ignore files we can't support w/ POSIX I/O for now
+		count_skip(SkipUnsupported);
 		return false;
 	} else if (file_record_size == 0) {
 		if (!this->silent) {
 			fmt::println(stderr, "get_pf_info({}): Couldn't get record length",
 				file.full_filename);
 		}
+		count_skip(SkipNoRecordLength);
 		return false;
 	} else if (file_record_size < 0 && this->search_non_source_files) {
 		// Non-source PF, signedness is used as source PF bit
 		file.record_length = -file_record_size;
-		return true;
+		// Records with numbers in them are turned into text by field
+		StatsTimer timer(this->stats.get(), PhaseRecordFormat);
+		file.format = this->platform->get_record_format(file);
 	} else if (file_record_size > 0) {
 		// Source PF, length includes other metadata not pulled when
 		// reading source PFs via POSIX APIs
 		file.record_length = file_record_size - 12;
-		return true;
+	} else {
+		count_skip(SkipNotSource);
+		return false;
 	}
-	return false;
+	if (cached) {
+		set_member_info(file, metadata);
+		file.has_member_info = true;
+	}
+	return true;
 }
 
-int pfbase::do_file(File &file)
+/**
+ * Opens a file and gets the information about it that needs ILE calls. This
+ * happens on the traversal thread, since the short filename is relative to
+ * the directory we've changed into.
+ */
+bool pfbase::open_file(File &file)
 {
 	std::string msg;
-	int matches = -1;
-	iconv_t conv = (iconv_t)(-1);
 
 	// Only open after we know it's a valid thing to open.
 	// Note that it's safe to use short_filename because it's bound to the
 	// suffix of the full filename.
-	file.fd = open(file.short_filename.data(), O_RDONLY);
+	{
+		StatsTimer timer(this->stats.get(), PhaseOpen);
+		file.fd = open(file.short_filename.data(), O_RDONLY);
+	}
 	// We let do_file fill in the filename and CCSID. Technically a TOCTOU
 	// problem, but open(2) error reporting with IBM i objects is goofy.
 	if (file.fd == -1) {
@@ -279,40 +769,67 @@ int pfbase::do_file(File &file)
 			msg = fmt::format("open({})", file.full_filename);
 			perror_xpf(msg.c_str());
 		}
-		return -1;
+		count_skip(SkipOpenFailed);
+		return false;
 	}
 
 	// Get member info for an accurate record count
-	if (file.record_length != 0) {
-		if (!get_member_info(file) && !this->silent) {
+	if (file.record_length != 0 && !file.has_member_info) {
+		MemberMetadata metadata = {};
+		bool found;
+		{
+			StatsTimer timer(this->stats.get(), PhaseMemberInfo);
+			found = this->platform->get_member_info(file, metadata);
+		}
+		if (found) {
+			set_member_info(file, metadata);
+			if (this->metadata_cache) {
+				// Already looked up for the record length, so it's cached
+				StatsTimer timer(this->stats.get(), PhaseFileInfo);
+				metadata.pf_info = this->platform->get_pf_info(file);
+				this->metadata_cache->add(file, metadata);
+			}
+		} else if (!this->silent) {
 			msg = fmt::format("get_member_info({})", file.full_filename);
 			perror(msg.c_str());
 		}
 	}
+	return true;
+}
+
+/**
+ * Reads and acts on an opened file, then closes it. This can run on a worker.
+ */
+void pfbase::run_job(Job &job)
+{
+	std::string msg;
+	File &file = job.file;
+	int matches = -1;
+	iconv_t conv = (iconv_t)(-1);
+
+	this->file_count = job.file_count;
+	this->output.clear();
+	this->output_wants_separator = false;
+	this->output_printed = false;
+	this->output_compressed = false;
 
 	// Open a conversion for this CCSID
 	conv = get_iconv(file.ccsid);
 	if (conv == (iconv_t)(-1)) {
 		if (!this->silent) {
-			msg = fmt::format("iconv_open({}, {})", Qp2paseCCSID(), file.ccsid);
+			msg = fmt::format("iconv_open({}, {})", this->pase_ccsid, file.ccsid);
 			perror(msg.c_str());
 		}
 		goto fail;
 	}
+	file.conv = conv;
+	file.sbcs = get_sbcs_table(file.ccsid);
 
-	if (!this->dont_read_file) {
-		// Streamfiles are record length 0, and must be read differently
-		if (file.record_length == 0) {
-			if (!read_streamfile(file, conv)) {
-				goto fail;
-			}
-		} else {
-			if (!read_records(file, conv)) {
-				goto fail;
-			}
-		}
+	// The action reads the file through next_window as it goes
+	{
+		StatsTimer timer(this->stats.get(), PhaseAction);
+		matches = do_action(file);
 	}
-	matches = do_action(file);
 
 fail:
 	// shift this should be reset after each file in case of MBCS/DBCS
@@ -320,10 +837,105 @@ fail:
 		reset_iconv(conv);
 	}
 
+	if (file.map != nullptr && !file.keep_map) {
+		unload_streamfile(file);
+	}
 	if (file.fd != -1) {
 		close(file.fd);
+		file.fd = -1;
+	}
+
+	job.result = matches;
+	if (this->stats) {
+		(file.record_length == 0 ? this->stats->streamfiles : this->stats->members)++;
+		this->stats->note_buffers(this->read_buffer_size, this->conv_buffer_size,
+			this->output.size());
+	}
+	// Swap so both sides keep their allocations around for reuse
+	job.output.swap(this->output);
+	job.wants_separator = this->output_wants_separator;
+	job.printed = this->output_printed;
+	job.compressed = this->output_compressed;
+	job.crc = this->output_crc;
+	job.uncompressed_size = this->output_uncompressed_size;
+}
+
+int pfbase::do_file(File &file)
+{
+	if (!open_file(file)) {
+		return -1;
+	}
+
+	if (this->worker_count > 1) {
+		if (this->pool == nullptr) {
+			this->pool = pool_create(this, this->worker_count);
+		}
+		pool_submit(this->pool, file, this->file_count);
+		// Results are counted when the pool finishes
+		return 0;
+	}
+
+	Job job = {};
+	copy_file(job.file, file);
+	job.file_count = this->file_count;
+	run_job(job);
+	{
+		StatsTimer timer(this->stats.get(), PhaseOutput);
+		commit_job(job);
+	}
+	return job.result;
+}
+
+/**
+ * Writes out what was printed for a file that was ruled out, after the output
+ * of the files before it.
+ */
+void pfbase::commit_unread(const File &file)
+{
+	if (this->output.empty()) {
+		return;
+	}
+	if (this->pool != nullptr) {
+		pool_submit_unread(this->pool, file, this->file_count, this->output);
+		return;
+	}
+
+	Job job = {};
+	copy_file(job.file, file);
+	job.file_count = this->file_count;
+	job.output.swap(this->output);
+	{
+		StatsTimer timer(this->stats.get(), PhaseOutput);
+		commit_job(job);
+	}
+}
+
+/**
+ * Waits for any files still being worked on, and merges their results into
+ * the ones from the main thread. Then writes out whatever output is left;
+ * if any of it couldn't be written, that's an error.
+ */
+void pfbase::finish_jobs(bool &any_match, bool &any_error)
+{
+	if (this->pool != nullptr) {
+		pool_finish(this->pool, any_match, any_error);
+		this->pool = nullptr;
+	}
+	{
+		StatsTimer timer(this->stats.get(), PhaseOutput);
+		this->sink->flush();
+	}
+	// The output after the failed write was dropped, so it's cut short
+	if (this->sink->error != 0) {
+		if (!this->silent) {
+			errno = this->sink->error;
+			perror("writing output");
+		}
+		any_error = true;
+	}
+	if (this->metadata_cache && !this->metadata_cache->save() && !this->silent) {
+		perror("saving metadata cache");
 	}
-	return matches;
 }
 
 int pfbase::do_thing(const char *filename, bool from_recursion)
@@ -335,7 +947,7 @@ int pfbase::do_thing(const char *filename, const char *dirname, bool from_recurs
 {
 	std::string msg;
 	int matches = 0;
-	struct stat64_ILE s = {};
+	FileStatus s = {};
 	File f = {};
 
 	if (dirname != nullptr) {
@@ -351,32 +963,33 @@ int pfbase::do_thing(const char *filename, const char *dirname, bool from_recurs
 		f.full_filename = filename;
 		f.short_filename = f.full_filename;
 	}
-	// IBM messed up the statx declaration, it doesn't write
-	int ret = statx((char*)filename, (struct stat*)&s, sizeof(s), STX_XPFSS_PASE);
-	if (ret == -1) {
+	bool found;
+	{
+		StatsTimer timer(this->stats.get(), PhaseStat);
+		found = this->platform->stat(filename, s);
+	}
+	if (!found) {
 		if (!this->silent) {
 			msg = fmt::format("stat({})", filename);
 			perror_xpf(msg.c_str());
 		}
+		count_skip(SkipStatFailed);
 		return -1;
 	}
-	f.file_size = s.st_size;
-	// XXX: This is 32-bit with ILE mtime
-	f.mtime = s.st_mtime;
-	// objtype is *FILE or *DIR, check for mode though to avoid i.e. SAVFs
-	if (S_ISDIR(s.st_mode)) {
+	f.file_size = s.size;
+	f.mtime = s.mtime;
+	f.ctime = s.ctime;
+	if (s.kind == ObjectDirectory || s.kind == ObjectPhysicalFile) {
 		if (this->recurse) {
-			// Avoid recursion in a loop; get the ID (dev+inode) of
-			// each directory. Note that we use the (truncated?) ID
-			// that's 32-bit for device and inode, so we can mask
-			// them into a single value. Consider that a TODO...
-			uint64_t devino = ((uint64_t)s.st_dev << 32) | s.st_ino;
+			// Avoid recursion in a loop, by the ID of each directory
 			// XXX: C++20: .contains
-			if (visited_directories.find(devino) != visited_directories.end()) {
+			if (visited_directories.find(s.id) != visited_directories.end()) {
 				return 0;
 			}
-			visited_directories.emplace(devino);
-			int subdir_files_matched = do_directory(f.full_filename.c_str());
+			visited_directories.emplace(s.id);
+			int subdir_files_matched = s.kind == ObjectPhysicalFile
+				? do_physical_file(f)
+				: do_directory(f.full_filename.c_str());
 			if (subdir_files_matched >= 0) {
 				matches += subdir_files_matched;
 			}
@@ -386,19 +999,29 @@ int pfbase::do_thing(const char *filename, const char *dirname, bool from_recurs
 			}
 			return -1;
 		}
-	} else if (s.st_size == 0) {
+	} else if (s.size == 0) {
 		// This is either a logical file or such (we can't open these
 		// yet), or a supported empty file that would have no matches.
 		// Avoid bothering the user (per GH-3)
+		count_skip(SkipEmpty);
+		return 0;
+	} else if ((this->filter_newer && f.mtime <= this->newer_than)
+			|| (this->filter_older && f.mtime >= this->older_than)) {
+		// Outside of the window; rejected before any ILE calls
+		count_skip(SkipFiltered);
+		return 0;
+	} else if ((s.kind == ObjectMember || s.kind == ObjectStreamfile) && rule_out(f)) {
+		// Also before any ILE calls, and the tool counts why
+		commit_unread(f);
 		return 0;
-	} else if (strcmp(s.st_objtype, "*MBR      ") == 0) {
-		f.ccsid = s.st_ccsid; // or st_codepage?
+	} else if (s.kind == ObjectMember) {
+		f.ccsid = s.ccsid;
 		if (!set_record_length(f)) {
 			return from_recursion ? 0 : -1; // messages emited in function
 		}
 		matches = do_file(f);
-	} else if (strcmp(s.st_objtype, "*STMF     ") == 0) {
-		f.ccsid = s.st_ccsid; // or st_codepage?
+	} else if (s.kind == ObjectStreamfile) {
+		f.ccsid = s.ccsid;
 		f.record_length = 0;
 		matches = do_file(f);
 	}
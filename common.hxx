@@ -5,17 +5,30 @@
  */
 
 extern "C" {
+#ifdef _AIX
 #include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+
+#include "lines.h"
+#include "platform.h"
+#include "sbcs.h"
+#include "records.h"
 }
 
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
 #if defined(__cpp_lib_string_view)
 #include <string_view>
 #else
 #include <experimental/string_view>
 #endif
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #if defined(__cpp_lib_string_view)
 using std::string_view;
@@ -26,6 +39,13 @@ using std::experimental::string_view;
 // In the worst case, a single byte character can become six bytes in UTF-8.
 #define UTF8_SCALE_FACTOR 6
 
+// How many bytes of records to read and convert at a time.
+#define RECORD_WINDOW_SIZE (256 * 1024)
+// How many bytes of a streamfile in another CCSID to convert at a time.
+#define STREAM_WINDOW_SIZE (1024 * 1024)
+// How much output to gather up before writing it out.
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
 /* Much like Git, we use ANSI colour codes. Use colours like "git grep" */
 #define ANSI_COLOUR_RESET    "\033[m"
 #define ANSI_COLOUR_CYAN     "\033[36m"
@@ -40,39 +60,393 @@ using std::experimental::string_view;
 #define PFGREP_COLON_COLOUR  ANSI_COLOUR_CYAN
 #define PFGREP_LINENO_COLOUR ANSI_COLOUR_GREEN
 
+// Long options, for getopt_long-style parsing that works on PASE too
+typedef struct pfgrep_long_option {
+	const char *name;
+	bool has_arg;
+	int value; // returned like a short option; out of char range
+} LongOption;
+
+enum LongOptionValue {
+	OptionNoMmap = 256,
+	OptionNoNative,
+	OptionIndex,
+	OptionMetadataCache,
+	OptionNewerThan,
+	OptionOlderThan,
+	OptionFormat,
+	OptionStats,
+};
+
 typedef enum pfgrep_colourize {
 	ColourizeNever = -1,
 	ColourizeAuto = 0,
 	ColourizeAlways = 1
 } Colourize;
 
+// A field of an externally described file, as QUSLFLD describes it
+typedef struct pfgrep_field {
+	char type; // data type, in ASCII (i.e. A, S, P, B)
+	bool varying;
+	int32_t offset; // in the record
+	int32_t length; // in bytes
+	int32_t digits;
+	int32_t decimals;
+	int32_t ccsid;
+} Field;
+
+// The fields of a file whose records aren't all text, so they're turned
+// into text a field at a time instead of converting the whole record.
+typedef struct pfgrep_record_format {
+	std::vector<Field> fields;
+	// The most text a record can turn into, without the newline
+	size_t max_text_length;
+} RecordFormat;
+
 typedef struct pfgrep_file {
 	std::string full_filename; // used for naming the file
 	string_view short_filename; // used for opening the file
 	int64_t file_size;
 	time_t mtime;
+	time_t ctime;
 	int fd;
 	int32_t record_count;
 	int16_t record_length;
 	uint16_t ccsid;
+	// Set if records are decoded by field; owned by rcdfmt.cxx
+	const RecordFormat *format;
+	// Conversion from ccsid to the PASE CCSID, for the reading thread
+	iconv_t conv;
+	// If set, used instead of conv, since the CCSID is single byte
+	const SbcsTable *sbcs;
+	// How many records have been read so far
+	size_t records_read;
+	// Streamfiles are mapped into memory when possible
+	char *map;
+	size_t map_size;
+	bool is_mapped;
+	// Left mapped for commit_job to write out from, instead of a copy
+	bool keep_map;
+	// How far into the streamfile we've converted, and what's left over
+	// of the converted text from the last window
+	size_t stream_offset;
+	size_t carry_offset;
+	size_t carry_length;
 	// EBCDIC space-padded + null terminated names for PFs
 	char libobj[21]; // object then library, QDBRTVFD needs
 	char member[11];
-	// Filled in from get_mbr_info
+	// Filled in from get_member_info, or the metadata cache
+	bool has_member_info;
 	char source_type[(10 * UTF8_SCALE_FACTOR) + 1];
 	char description[(50 * UTF8_SCALE_FACTOR) + 1];
 } File;
 
+// What QUSRMBRD and QDBRTVFD say about a member, as they say it; the text is
+// still EBCDIC, so it's converted the same way whether it was cached or not.
+typedef struct pfgrep_member_metadata {
+	int32_t pf_info; // as get_pf_info returns
+	int32_t record_count;
+	int32_t description_ccsid;
+	char source_type[10];
+	char description[50];
+} MemberMetadata;
+
+class MetadataCache;
+
+// A member found by listing the physical file it's in
+typedef struct pfgrep_listed_member {
+	char member[11]; // EBCDIC, like File::member
+	MemberMetadata metadata;
+} ListedMember;
+
+// The members of the physical file being recursed into, by the name readdir
+// gives them, so each doesn't need looking up on its own.
+typedef struct pfgrep_member_list {
+	char libobj[21];
+	int pf_info;
+	std::unordered_map<std::string, ListedMember> members;
+} MemberList;
+
+// Where member lists come from. On i, that's QUSLMBR; anything else giving
+// entries laid out like MBRD0200 (i.e. a canned list) works too.
+class MemberListBackend {
+public:
+	virtual ~MemberListBackend() {}
+	virtual bool list(const char *libobj, std::string &entries, size_t &entry_size) = 0;
+};
+
+class UserSpaceMemberList : public MemberListBackend {
+public:
+	bool list(const char *libobj, std::string &entries, size_t &entry_size) override;
+};
+
+// What a path is, as far as pfbase goes through it
+typedef enum pfgrep_object_kind {
+	ObjectOther = 0, // i.e. save files, programs
+	ObjectDirectory, // or library
+	ObjectPhysicalFile,
+	ObjectMember,
+	ObjectStreamfile,
+} ObjectKind;
+
+typedef struct pfgrep_file_status {
+	ObjectKind kind;
+	int64_t size;
+	time_t mtime;
+	time_t ctime;
+	// Device and inode, to tell if a directory has been visited already
+	uint64_t id;
+	uint16_t ccsid;
+} FileStatus;
+
+// The calls pfbase makes to the system for each file. On i, that's statx
+// and the ILE APIs (ibmi.cxx); elsewhere, libraries are modelled as plain
+// directories (host.cxx), so the rest can be run and profiled anywhere.
+class Platform {
+public:
+	virtual ~Platform() {}
+	// Sets errno and returns false if it can't
+	virtual bool stat(const char *path, FileStatus &status) = 0;
+	virtual int filename_to_libobj(File &file) = 0;
+	virtual int get_pf_info(const File &file) = 0;
+	virtual bool get_member_info(const File &file, MemberMetadata &metadata) = 0;
+	virtual const RecordFormat *get_record_format(const File &file) = 0;
+	virtual std::shared_ptr<MemberListBackend> make_member_lister() = 0;
+};
+
+// Defined by whichever of ibmi.cxx or host.cxx is built
+std::shared_ptr<Platform> make_platform();
+
+// A piece of a file's text, converted to the PASE CCSID. Members are handed
+// out a batch of whole records at a time, so lines never cross windows.
+typedef struct pfgrep_window {
+	const char *data;
+	size_t length;
+} Window;
+
+// A file handed off to be read and acted on, possibly by another thread.
+// Output is collected here so it can be written out in traversal order.
+typedef struct pfgrep_job {
+	File file;
+	// Snapshot of pfbase::file_count when the file was found
+	int file_count;
+	int result;
+	std::string output;
+	// Output starts with a group that needs a separator if an earlier
+	// file printed anything (only used by pfgrep context lines)
+	bool wants_separator;
+	bool printed;
+	// Output was deflated by the worker; this is its CRC and size from
+	// before (only used by pfzip)
+	bool compressed;
+	uint32_t crc;
+	size_t uncompressed_size;
+	bool done;
+} Job;
+
+class pfpool;
+
+// Output for stdout, written in big batches instead of through stdio.
+// Only written to in traversal order, so it's shared with the workers.
+class OutputSink {
+public:
+	explicit OutputSink(int fd);
+	~OutputSink();
+	void write(const char *data, size_t length);
+	void write(const std::string &text);
+	void end_file();
+	void flush();
+	// errno from the write that failed, if one did
+	int error = 0;
+
+private:
+	void write_out(const char *data, size_t length);
+
+	int fd;
+	std::string pending;
+	bool flush_each_file;
+	bool failed = false;
+};
+
+// An entry for pfzip to put in an archive, converted and maybe deflated
+typedef struct pfzip_archive_entry {
+	std::string path;
+	std::string comment;
+	time_t mtime;
+	const std::string *data;
+	// data is a raw deflate stream; the CRC and size are of what's in it
+	bool compressed;
+	uint32_t crc;
+	uint64_t uncompressed_size;
+} ArchiveEntry;
+
+// Writes an archive front to back without seeking, so it can go to a pipe.
+class ArchiveWriter {
+public:
+	explicit ArchiveWriter(int fd);
+	virtual ~ArchiveWriter() {}
+	virtual bool add(const ArchiveEntry &entry) = 0;
+	virtual bool finish() = 0;
+
+protected:
+	void write(const std::string &data);
+	bool flush();
+	OutputSink sink;
+	uint64_t offset = 0;
+};
+
+class ZipStreamWriter : public ArchiveWriter {
+public:
+	using ArchiveWriter::ArchiveWriter;
+	bool add(const ArchiveEntry &entry) override;
+	bool finish() override;
+
+private:
+	std::string central_directory;
+	uint64_t entry_count = 0;
+};
+
+class TarWriter : public ArchiveWriter {
+public:
+	TarWriter(int fd, bool gzip, int level);
+	~TarWriter();
+	bool add(const ArchiveEntry &entry) override;
+	bool finish() override;
+
+private:
+	bool write_gzip_member(const std::string &data);
+	void write_deflated(const ArchiveEntry &entry);
+	bool gzip;
+	int level;
+	/* Headers and padding not written yet, and the buffer to gzip them */
+	std::string pending;
+	std::string compressed;
+	struct z_stream_s *deflater = nullptr;
+};
+
+// Deflates in pieces, for more than zlib can take at once
+ptrdiff_t deflate_all(struct z_stream_s *stream, const char *in, size_t in_length, char *out, size_t out_length);
+
+// Where the time goes, for --stats
+enum StatsPhase {
+	PhaseStat,
+	PhaseReaddir,
+	PhaseOpen,
+	PhaseConvertPath,
+	PhaseFileInfo,
+	PhaseMemberInfo,
+	PhaseMemberList,
+	PhaseRecordFormat,
+	PhaseRead,
+	PhaseConvert,
+	// Whatever the tool does with the text, less reading and converting
+	PhaseAction,
+	PhaseOutput,
+	PhaseCount,
+	PhaseNone = PhaseCount,
+};
+
+// Why a file found wasn't acted on
+enum SkipReason {
+	SkipEmpty,
+	SkipFiltered, // by --newer-than/--older-than
+	SkipUnsupported,
+	SkipNotSource,
+	SkipNoRecordLength,
+	SkipNoObjectName,
+	SkipStatFailed,
+	SkipOpenFailed,
+	SkipIndex, // ruled out by pfgrep --index
+	SkipCount,
+};
+
+typedef struct pfgrep_phase_stats {
+	uint64_t calls;
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+} PhaseStats;
+
+// Counters for --stats. Each thread has its own, merged at the end.
+class Stats {
+public:
+	Stats();
+	StatsPhase enter(StatsPhase phase);
+	void leave(StatsPhase previous);
+	void note_buffers(size_t read_buffer, size_t conv_buffer, size_t output);
+	void merge(const Stats &other);
+	void print(const char *tool_name) const;
+
+	uint64_t skipped[SkipCount] = {};
+	uint64_t members = 0;
+	uint64_t streamfiles = 0;
+	uint64_t bytes_read = 0;
+	// Of the file, and the text it became
+	uint64_t bytes_converted = 0;
+	uint64_t text_bytes = 0;
+	// Member metadata that didn't need QUSRMBRD and QDBRTVFD
+	uint64_t listed_hits = 0;
+	uint64_t cache_hits = 0;
+	uint64_t cache_misses = 0;
+	size_t peak_read_buffer = 0;
+	size_t peak_conv_buffer = 0;
+	size_t peak_output = 0;
+
+private:
+	void charge();
+
+	PhaseStats phases[PhaseCount] = {};
+	StatsPhase current = PhaseNone;
+	uint64_t started;
+	uint64_t last_wall;
+	uint64_t last_cpu;
+};
+
+// Counts a phase for as long as it's in scope, if there are stats to keep
+class StatsTimer {
+public:
+	StatsTimer(Stats *stats, StatsPhase phase) : stats(stats)
+	{
+		if (stats != nullptr) {
+			this->previous = stats->enter(phase);
+		}
+	}
+	~StatsTimer()
+	{
+		if (this->stats != nullptr) {
+			this->stats->leave(this->previous);
+		}
+	}
+
+private:
+	Stats *stats;
+	StatsPhase previous = PhaseNone;
+};
+
 class pfbase {
 public:
 	pfbase();
-	~pfbase();
+	virtual ~pfbase();
 	void print_version(const char *tool_name);
+	void open_metadata_cache(const char *path);
+	void print_stats(const char *tool_name);
+	bool parse_time(const char *arg, time_t &when);
 	virtual int do_action(File &file) = 0;
+	// Makes a copy of this object with its own buffers for a worker thread
+	virtual pfbase *make_worker() const = 0;
+	// Called in traversal order once a file has been acted on
+	virtual void commit_job(Job &job);
+	// Lets a tool pass over a file from its name, size, and time alone,
+	// before it's opened; anything it prints for it goes in output
+	virtual bool rule_out(const File &file);
 	int do_thing(const char *filename, bool from_recursion);
 	int do_thing(const char *filename, const char *dirname,  bool from_recursion);
+	void finish_jobs(bool &any_match, bool &any_error);
+	void run_job(Job &job);
+	int next_window(File &file, Window &window);
+	int next_raw_records(File &file, Window &window);
 
 	/* Cached system info */
+	std::shared_ptr<Platform> platform;
 	int pase_ccsid = 0;
 	/* Files */
 	std::unordered_set<uint64_t> visited_directories;
@@ -82,6 +456,24 @@ public:
 	size_t read_buffer_size = 0;
 	char *conv_buffer = nullptr;
 	size_t conv_buffer_size = 0;
+	/* Output for the current file */
+	std::string output;
+	std::shared_ptr<OutputSink> sink;
+	/* Metadata from earlier runs, only used on the traversal thread */
+	std::shared_ptr<MetadataCache> metadata_cache;
+	/* Timings and counters for --stats, if asked for; one per thread */
+	std::shared_ptr<Stats> stats;
+	/* Members of the physical file being recursed into, if listed */
+	std::shared_ptr<MemberListBackend> member_lister;
+	const MemberList *member_list = nullptr;
+	bool output_wants_separator = false;
+	bool output_printed = false;
+	bool output_compressed = false;
+	uint32_t output_crc = 0;
+	size_t output_uncompressed_size = 0;
+	/* Workers */
+	pfpool *pool = nullptr;
+	bool is_worker = false;
 	/* Options */
 	Colourize colourize = ColourizeAuto;
 	bool search_non_source_files = false;
@@ -89,29 +481,181 @@ public:
 	// Note quiet does not imply silent et vice versa
 	bool silent = false; // No output on errors
 	bool recurse = false;
+	bool use_mmap = true;
+	unsigned int worker_count = 1;
+	// Only files changed in this window are looked at, if set
+	bool filter_newer = false;
+	time_t newer_than = 0;
+	bool filter_older = false;
+	time_t older_than = 0;
 	/* Stat options */
 	bool dont_read_file = false;
+protected:
+	void init_worker();
+	void count_skip(SkipReason reason);
 private:
-	bool read_records(const File &file, iconv_t conv);
-	bool read_streamfile(const File &file, iconv_t conv);
+	int read_records(File &file, Window &window);
+	int decode_records(File &file, const Window &raw, size_t record_count, Window &window);
+	int read_streamfile(File &file, Window &window);
+	bool load_streamfile(File &file);
+	void unload_streamfile(File &file);
 	bool set_record_length(File &file);
+	bool find_listed_member(File &file, MemberMetadata &metadata);
+	int do_physical_file(File &file);
 	int do_directory(const char *directory);
+	bool open_file(File &file);
 	int do_file(File &file);
+	void commit_unread(const File &file);
 };
 
+/* common.cxx */
+unsigned int parse_worker_count(const char *arg);
+int get_option(int argc, char **argv, const char *optstring, const LongOption *long_options);
+
+/* literal.cxx */
+// Finds a fixed string the way PCRE2_LITERAL would, for -F
+class LiteralMatcher {
+public:
+	LiteralMatcher(const std::string &needle, const unsigned char *tables, bool caseless, bool match_word, bool match_line);
+	bool find(const char *haystack, size_t length, size_t offset, size_t &start, size_t &end) const;
+
+private:
+	size_t find_candidate(const char *haystack, size_t length, size_t offset) const;
+	bool equals_at(const char *haystack, size_t position) const;
+	bool is_boundary(const char *haystack, size_t length, size_t position) const;
+
+	// Case folded if caseless
+	std::string needle;
+	unsigned char fold[256];
+	bool word[256];
+	// The first and last bytes of the needle, in either case
+	uint64_t first[2];
+	uint64_t last[2];
+	bool use_filter;
+	bool caseless;
+	bool match_word;
+	bool match_line;
+};
+
+std::string required_literal(const std::string &expr, bool &caseless);
+bool matches_within_lines(const std::string &expr);
+
+/* trigram.cxx */
+// Collects the distinct three byte sequences in some text
+class TrigramCollector {
+public:
+	void add(const char *text, size_t length);
+	std::vector<uint32_t> finish();
+
+private:
+	void compact();
+
+	std::vector<uint32_t> trigrams;
+	uint32_t last = 0;
+	int have = 0;
+};
+
+typedef struct pfgrep_index_entry {
+	std::string key; // the full filename
+	int64_t mtime;
+	int64_t size;
+	// Sorted; only filled in if asked for when loading
+	std::vector<uint32_t> trigrams;
+} IndexEntry;
+
+// Which trigrams are in each file, for pfindex to write and pfgrep to skip
+// files that can't match with
+class TrigramIndex {
+public:
+	bool load(const std::string &path, bool with_trigrams);
+	bool save(const std::string &path) const;
+	void add(IndexEntry entry);
+	const IndexEntry *find(const std::string &key) const;
+	int find_current(const std::string &key, int64_t mtime, int64_t size) const;
+	std::vector<bool> candidates(const std::vector<std::vector<uint32_t>> &queries) const;
+	size_t size() const;
+
+private:
+	typedef struct pfgrep_posting_list {
+		uint32_t trigram;
+		uint32_t count;
+		uint64_t offset;
+	} PostingList;
+
+	bool read_postings(size_t list_index, std::vector<uint32_t> &ids) const;
+
+	std::vector<IndexEntry> entries;
+	std::unordered_map<std::string, size_t> by_key;
+	std::vector<PostingList> directory;
+	std::string postings;
+};
+
+std::vector<uint32_t> literal_trigrams(const std::string &literal, bool caseless);
+
+/* mdcache.cxx */
+// Member metadata kept between runs, so unchanged members don't need the
+// slow program calls. Looked up in a mapped file of sorted records.
+class MetadataCache {
+public:
+	~MetadataCache();
+	bool open(const std::string &path);
+	bool find(const File &file, MemberMetadata &metadata) const;
+	void add(const File &file, const MemberMetadata &metadata);
+	bool save();
+
+private:
+	const char *lookup(const char *key) const;
+
+	std::string path;
+	char *map = nullptr;
+	size_t map_size = 0;
+	size_t count = 0;
+	// Records found this run, by key, to merge in when saving
+	std::map<std::string, std::string> added;
+};
+
+/* mbrlist.cxx */
+void parse_member_description(const char *description, MemberMetadata &metadata);
+void set_member_info(File &file, const MemberMetadata &metadata);
+bool load_member_list(MemberListBackend &backend, MemberList &list);
+
+/* usrspc.cxx */
+const char *get_list_space();
+bool read_list_space(std::string &entries, size_t &entry_size);
+
+/* fields.cxx */
+bool parse_field_list(const std::string &entries, size_t entry_size, RecordFormat &format);
+size_t decode_record(const RecordFormat &format, const char *record, uint16_t ccsid, char *out);
+
+/* qsyspath.cxx */
+bool parse_qsys_path(const std::string &path, std::string &object, std::string &library, std::string &member);
+
+/* native.cxx */
+bool transcode_pattern(const std::string &expr, const SbcsTable *table, bool fixed, std::string &out);
+unsigned char *make_native_tables(const unsigned char *base, const SbcsTable *table);
+
+/* pool.cxx */
+pfpool *pool_create(pfbase *owner, unsigned int worker_count);
+void pool_submit(pfpool *pool, const File &file, int file_count);
+void pool_submit_unread(pfpool *pool, const File &file, int file_count, std::string &output);
+void pool_finish(pfpool *pool, bool &any_match, bool &any_error);
+void copy_file(File &dest, const File &src);
+
 extern "C" {
 /* conv.c */
 iconv_t get_pase_to_system_iconv(void);
 iconv_t get_iconv(uint16_t ccsid);
+const SbcsTable *get_sbcs_table(uint16_t ccsid);
 void free_cached_iconv(void);
 void reset_iconv(iconv_t conv);
 
-/* convpath.c */
+/* convpath.c, only on i; go through Platform */
 int filename_to_libobj(File &file);
 
-/* rcdfmt.c */
+/* rcdfmt.c, likewise */
 int get_pf_info(const File &file);
+const RecordFormat *get_record_format(const File &file);
 
-/* mbrinfo.c */
-bool get_member_info(File &file);
+/* mbrinfo.c, likewise */
+bool get_member_info(const File &file, MemberMetadata &metadata);
 }
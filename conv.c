@@ -4,49 +4,110 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
-#include <as400_protos.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
+#ifdef _AIX
 #include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+
+#include "platform.h"
+#include "sbcs.h"
 
 // These contain conversions from convs[N] to system PASE CCSID, memoized to
 // avoid constantly reopening iconv for conversion. Gets closed on exit.
 // Because we only convert to a single CCSID, we can keep the maping flat.
-// The memory cost of this should be minimal on modern systems.
-static iconv_t convs[UINT16_MAX];
+// iconv handles carry state, so each thread gets its own table; it's
+// allocated on first use so threads that never convert don't pay for it.
+static __thread iconv_t *convs = NULL;
+
+// Lookup tables for single byte CCSIDs, next to the iconv handles for them.
+// CCSIDs that can't use a table are marked, so we only try building once.
+static __thread SbcsTable **sbcs_tables = NULL;
+static SbcsTable not_sbcs;
 
 // Used for converting from PASE CCSID to 37, which is used for paths, as
 // well as various locale-invariant things we usually convert from than to.
-static iconv_t pase_to_system_iconv = NULL;
+static __thread iconv_t pase_to_system_iconv = NULL;
 
 iconv_t get_pase_to_system_iconv(void)
 {
 	if (pase_to_system_iconv == NULL) {
-		pase_to_system_iconv = iconv_open(ccsidtocs(37), ccsidtocs(Qp2paseCCSID()));
+		pase_to_system_iconv = iconv_open(platform_ccsid_name(37), platform_ccsid_name(platform_text_ccsid()));
 	}
 	return pase_to_system_iconv;
 }
 
 iconv_t get_iconv(uint16_t ccsid)
 {
+	if (convs == NULL) {
+		convs = calloc(UINT16_MAX + 1, sizeof(iconv_t));
+		if (convs == NULL) {
+			return (iconv_t)(-1);
+		}
+	}
 	iconv_t conv = convs[ccsid];
 	if (conv == NULL || conv == (iconv_t)(-1)) {
-		conv = iconv_open(ccsidtocs(Qp2paseCCSID()), ccsidtocs(ccsid));
+		conv = iconv_open(platform_ccsid_name(platform_text_ccsid()), platform_ccsid_name(ccsid));
 		convs[ccsid] = conv;
 	}
 	return conv;
 }
 
+/**
+ * Gets a lookup table to convert from a single byte CCSID to the PASE CCSID,
+ * or NULL if the CCSID needs iconv.
+ */
+const SbcsTable *get_sbcs_table(uint16_t ccsid)
+{
+	if (sbcs_tables == NULL) {
+		sbcs_tables = calloc(UINT16_MAX + 1, sizeof(SbcsTable*));
+		if (sbcs_tables == NULL) {
+			return NULL;
+		}
+	}
+	SbcsTable *table = sbcs_tables[ccsid];
+	if (table == NULL) {
+		iconv_t conv = get_iconv(ccsid);
+		if (conv != (iconv_t)(-1)) {
+			table = sbcs_table_build(conv);
+		}
+		sbcs_tables[ccsid] = table != NULL ? table : &not_sbcs;
+	}
+	return table == &not_sbcs ? NULL : table;
+}
+
+/**
+ * Closes the cached conversions for the calling thread.
+ */
 void free_cached_iconv(void)
 {
-	for (int i = 0; i < UINT16_MAX; i++) {
-		iconv_t conv = convs[i];
-		if (conv == NULL || conv == (iconv_t)(-1)) {
-			continue;
+	if (convs != NULL) {
+		for (int i = 0; i <= UINT16_MAX; i++) {
+			iconv_t conv = convs[i];
+			if (conv == NULL || conv == (iconv_t)(-1)) {
+				continue;
+			}
+			iconv_close(conv);
+		}
+		free(convs);
+		convs = NULL;
+	}
+	if (sbcs_tables != NULL) {
+		for (int i = 0; i <= UINT16_MAX; i++) {
+			if (sbcs_tables[i] != &not_sbcs) {
+				free(sbcs_tables[i]);
+			}
 		}
-		iconv_close(conv);
+		free(sbcs_tables);
+		sbcs_tables = NULL;
+	}
+	if (pase_to_system_iconv != NULL && pase_to_system_iconv != (iconv_t)(-1)) {
+		iconv_close(pase_to_system_iconv);
 	}
-	iconv_close(pase_to_system_iconv);
+	pase_to_system_iconv = NULL;
 }
 
 /**
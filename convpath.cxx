@@ -47,12 +47,46 @@ typedef struct QSYS0100 {
 
 static ILEFunction<void, Qlg_Path_Name_T*, QSYS0100*, const char*, unsigned int, unsigned int, ERRC0100*> Qp0lCvtPathToQSYSObjName("QSYS/QP0LLIB2", "Qp0lCvtPathToQSYSObjName", ILECALL_EXCP_NOSIGNAL);
 
+/**
+ * Converts a name to EBCDIC, padded with spaces to the size of its field.
+ */
+static bool set_name(char *field, size_t size, const std::string &name)
+{
+	memset(field, ' '_e, size);
+	field[size] = '\0';
+	iconv_t a2e = get_pase_to_system_iconv();
+	char *in = (char*)name.data(), *out = field;
+	size_t inleft = name.size(), outleft = size;
+	size_t rc = iconv(a2e, &in, &inleft, &out, &outleft);
+	return rc != (size_t)-1 && inleft == 0;
+}
+
+/**
+ * Splits paths that are already in canonical QSYS form ourselves, which
+ * saves converting the whole path and calling into ILE for each member.
+ */
+static bool parse_libobj(File &file)
+{
+	std::string object, library, member;
+	if (!parse_qsys_path(file.full_filename, object, library, member)) {
+		return false;
+	}
+	// libobj is object then library, like QDBRTVFD wants
+	return set_name(file.libobj, 10, object)
+		&& set_name(file.libobj + 10, 10, library)
+		&& set_name(file.member, 10, member);
+}
+
 /**
  * Takes an ASCII IFS path to a traditional object (like /QSYS.LIB/QGPL.LIB/QCLSRC.FILE/X.MBR)
  * and breaks it down into three 29-character EBCDIC strings.
  */
 extern "C" int filename_to_libobj(File &file)
 {
+	if (parse_libobj(file)) {
+		return 0;
+	}
+
 	struct {
 		Qlg_Path_Name_T	qlg;
 		char path[1024];
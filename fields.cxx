@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+}
+
+#include <cmath>
+#include <string>
+
+#include "common.hxx"
+
+/*
+ * Turns records of externally described files into text a field at a time,
+ * so numbers stored as zoned, packed, or binary can be searched for. Only
+ * character fields go through a conversion; the rest is done here.
+ */
+
+// XXX: Convert to using struct (Qdb_Lfld in QSYSINC)
+#define FLDL_DATA_TYPE       10
+#define FLDL_INPUT_POSITION  16
+#define FLDL_LENGTH          20
+#define FLDL_DIGITS          24
+#define FLDL_DECIMALS        28
+#define FLDL_VARYING         267
+#define FLDL_DATA_CCSID      272
+
+// The most digits a decimal field can have, and a binary one can hold
+#define MAX_DECIMAL_DIGITS 63
+#define MAX_BINARY_DIGITS 18
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+ * The data types are EBCDIC letters, which don't need a conversion to find.
+ */
+static char type_from_ebcdic(unsigned char c)
+{
+	switch (c) {
+	case 0xC1: return 'A';
+	case 0xC2: return 'B';
+	case 0xC5: return 'E';
+	case 0xC6: return 'F';
+	case 0xC7: return 'G';
+	case 0xC8: return 'H';
+	case 0xD1: return 'J';
+	case 0xD3: return 'L';
+	case 0xD6: return 'O';
+	case 0xD7: return 'P';
+	case 0xE2: return 'S';
+	case 0xE3: return 'T';
+	case 0xE9: return 'Z';
+	default: return '?';
+	}
+}
+
+static int32_t get_int32(const char *p)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) {
+		value = (value << 8) | (unsigned char)p[i];
+	}
+	return (int32_t)value;
+}
+
+/**
+ * Fills in the fields from the entries QUSLFLD gives in format FLDL0100.
+ * Returns false if the file doesn't need decoding (all of it is fixed length
+ * text) or has a field that can't be decoded, in which case the records are
+ * converted whole like before.
+ */
+bool parse_field_list(const std::string &entries, size_t entry_size, RecordFormat &format)
+{
+	if (entry_size < FLDL_DATA_CCSID + 4) {
+		return false;
+	}
+	format.fields.clear();
+	format.max_text_length = 0;
+	bool needs_decoding = false;
+	for (size_t offset = 0; offset + entry_size <= entries.size(); offset += entry_size) {
+		const char *entry = entries.data() + offset;
+		Field field = {};
+		field.type = type_from_ebcdic(entry[FLDL_DATA_TYPE]);
+		// Buffer positions start at 1
+		field.offset = get_int32(entry + FLDL_INPUT_POSITION) - 1;
+		field.length = get_int32(entry + FLDL_LENGTH);
+		field.digits = get_int32(entry + FLDL_DIGITS);
+		field.decimals = get_int32(entry + FLDL_DECIMALS);
+		field.varying = entry[FLDL_VARYING] == (char)0xF1; // '1'
+		field.ccsid = get_int32(entry + FLDL_DATA_CCSID);
+		if (field.type == '?' || field.offset < 0 || field.length <= 0
+				|| field.digits < 0 || field.decimals < 0 || field.decimals > field.digits) {
+			return false;
+		}
+		// More than the buffers numbers are put together in have room for
+		if (field.digits > MAX_DECIMAL_DIGITS
+				|| (field.type == 'B' && field.digits > MAX_BINARY_DIGITS)) {
+			return false;
+		}
+		if (field.type != 'A' || field.varying) {
+			needs_decoding = true;
+		}
+		// Text can grow when converted, numbers get a sign, a point, and
+		// maybe a zero before it, and anything can be shown as hex
+		format.max_text_length += (field.length * UTF8_SCALE_FACTOR) + field.digits + 3 + 1;
+		format.fields.push_back(field);
+	}
+	return needs_decoding && !format.fields.empty();
+}
+
+/**
+ * Writes a number given as its digits, right aligned to the width every
+ * value of the field takes, so columns still line up.
+ */
+static char *put_number(char *out, bool negative, const char *digits, int count, int decimals)
+{
+	// A sign, a zero and a point, and the digits
+	char text[MAX_DECIMAL_DIGITS + 3];
+	char *p = text;
+	int first = 0;
+	// Leading zeros go, but keep the one before the point
+	while (first < count - decimals - 1 && digits[first] == '0') {
+		first++;
+	}
+	bool zero = true;
+	for (int i = first; i < count; i++) {
+		if (digits[i] != '0') {
+			zero = false;
+		}
+	}
+	if (negative && !zero) {
+		*p++ = '-';
+	}
+	if (count - decimals <= 0) {
+		*p++ = '0';
+	}
+	for (int i = first; i < count; i++) {
+		if (i == count - decimals) {
+			*p++ = '.';
+		}
+		*p++ = digits[i];
+	}
+	size_t length = p - text;
+	size_t width = count + 1 + (decimals > 0 ? 1 : 0) + (count == decimals ? 1 : 0);
+	for (size_t i = length; i < width; i++) {
+		*out++ = ' ';
+	}
+	memcpy(out, text, length);
+	return out + length;
+}
+
+static char *put_hex(char *out, const char *data, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = data[i];
+		*out++ = hex_digits[c >> 4];
+		*out++ = hex_digits[c & 0x0F];
+	}
+	return out;
+}
+
+/**
+ * Zoned decimal has a digit in the low half of each byte, and the sign in the
+ * high half of the last. Bad data is shown as hex.
+ */
+static char *put_zoned(char *out, const Field &field, const char *data)
+{
+	char digits[MAX_DECIMAL_DIGITS];
+	int count = field.length < MAX_DECIMAL_DIGITS ? field.length : MAX_DECIMAL_DIGITS;
+	for (int i = 0; i < count; i++) {
+		unsigned char c = data[i];
+		if ((c & 0x0F) > 9) {
+			return put_hex(out, data, field.length);
+		}
+		digits[i] = '0' + (c & 0x0F);
+	}
+	unsigned char sign = ((unsigned char)data[field.length - 1]) >> 4;
+	return put_number(out, sign == 0xD || sign == 0xB, digits, count, field.decimals);
+}
+
+/**
+ * Packed decimal has two digits a byte, with the sign in the last half byte.
+ */
+static char *put_packed(char *out, const Field &field, const char *data)
+{
+	char digits[MAX_DECIMAL_DIGITS + 1];
+	int count = 0;
+	for (int i = 0; i < field.length && count < MAX_DECIMAL_DIGITS; i++) {
+		unsigned char c = data[i];
+		unsigned char high = c >> 4, low = c & 0x0F;
+		bool last = i == field.length - 1;
+		if (high > 9 || (!last && low > 9)) {
+			return put_hex(out, data, field.length);
+		}
+		digits[count++] = '0' + high;
+		if (!last) {
+			digits[count++] = '0' + low;
+		}
+	}
+	// An even number of digits leaves an extra zero at the front
+	int skip = count > field.digits ? count - field.digits : 0;
+	unsigned char sign = ((unsigned char)data[field.length - 1]) & 0x0F;
+	return put_number(out, sign == 0xD || sign == 0xB, digits + skip, count - skip, field.decimals);
+}
+
+static char *put_binary(char *out, const Field &field, const char *data)
+{
+	if (field.length != 2 && field.length != 4 && field.length != 8) {
+		return put_hex(out, data, field.length);
+	}
+	uint64_t raw = 0;
+	for (int i = 0; i < field.length; i++) {
+		raw = (raw << 8) | (unsigned char)data[i];
+	}
+	// Sign extend from the field's size
+	int shift = 64 - (field.length * 8);
+	int64_t value = shift > 0 ? ((int64_t)(raw << shift)) >> shift : (int64_t)raw;
+	bool negative = value < 0;
+	uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+	// As many as the field holds, or as a 64-bit value can have
+	char digits[MAX_BINARY_DIGITS + 2];
+	int count = field.digits > field.decimals ? field.digits : field.decimals + 1;
+	char text[MAX_BINARY_DIGITS + 3];
+	int length = snprintf(text, sizeof(text), "%llu", (unsigned long long)magnitude);
+	if (length > count) {
+		count = length; // more than the field says it holds
+	}
+	memset(digits, '0', count - length);
+	memcpy(digits + (count - length), text, length);
+	return put_number(out, negative, digits, count, field.decimals);
+}
+
+/**
+ * Floats are written with the fewest digits that read back as the same value,
+ * so 0.1 is 0.1 and not 0.10000000000000001, like it'd be typed to search.
+ * Whole numbers that fit in those digits aren't given an exponent, so 100 is
+ * 100 and not 1e+02.
+ */
+static char *put_float(char *out, const Field &field, const char *data)
+{
+	uint64_t raw = 0;
+	for (int i = 0; i < field.length; i++) {
+		raw = (raw << 8) | (unsigned char)data[i];
+	}
+	float single = 0;
+	double value;
+	if (field.length == 4) {
+		uint32_t raw32 = (uint32_t)raw;
+		memcpy(&single, &raw32, sizeof(single));
+		value = single;
+	} else if (field.length == 8) {
+		memcpy(&value, &raw, sizeof(value));
+	} else {
+		return put_hex(out, data, field.length);
+	}
+	// 9 and 17 digits are always enough to read back the same
+	int max_precision = field.length == 4 ? 9 : 17;
+	char text[32];
+	int length = 0;
+	for (int precision = 1; precision <= max_precision; precision++) {
+		length = snprintf(text, sizeof(text), "%.*g", precision, value);
+		const char *exponent = strchr(text, 'e');
+		if (!std::isfinite(value)) {
+			break;
+		} else if (exponent != nullptr && atoi(exponent + 1) >= 0 && atoi(exponent + 1) < max_precision) {
+			continue;
+		} else if (field.length == 4 ? strtof(text, nullptr) == single : strtod(text, nullptr) == value) {
+			break;
+		}
+	}
+	memcpy(out, text, length);
+	return out + length;
+}
+
+/**
+ * Converts a text field from its CCSID (or the file's, if it doesn't have
+ * one), using the same tables and conversions as whole records.
+ */
+static char *put_text(char *out, const Field &field, const char *data, uint16_t file_ccsid)
+{
+	size_t length = field.length;
+	if (field.varying && length >= 2) {
+		size_t actual = ((unsigned char)data[0] << 8) | (unsigned char)data[1];
+		data += 2;
+		length -= 2;
+		if (actual < length) {
+			length = actual;
+		}
+	}
+	uint16_t ccsid = (field.ccsid == 0 || field.ccsid == 65535) ? file_ccsid : field.ccsid;
+	const SbcsTable *table = get_sbcs_table(ccsid);
+	if (table != nullptr) {
+		return out + sbcs_convert(table, data, length, out);
+	}
+	iconv_t conv = get_iconv(ccsid);
+	if (conv == (iconv_t)(-1)) {
+		return put_hex(out, data, length);
+	}
+	char *in = (char*)data, *start = out;
+	size_t inleft = length, outleft = length * UTF8_SCALE_FACTOR;
+	if (iconv(conv, &in, &inleft, &out, &outleft) == (size_t)-1) {
+		reset_iconv(conv);
+		return put_hex(start, data, length);
+	}
+	reset_iconv(conv);
+	return out;
+}
+
+/**
+ * Turns a record into text, with a space between fields, and returns how long
+ * it is. out needs room for format.max_text_length bytes.
+ */
+size_t decode_record(const RecordFormat &format, const char *record, uint16_t ccsid, char *out)
+{
+	char *start = out;
+	for (size_t i = 0; i < format.fields.size(); i++) {
+		const Field &field = format.fields[i];
+		const char *data = record + field.offset;
+		if (i > 0) {
+			*out++ = ' ';
+		}
+		switch (field.type) {
+		case 'S':
+			out = put_zoned(out, field, data);
+			break;
+		case 'P':
+			out = put_packed(out, field, data);
+			break;
+		case 'B':
+			out = put_binary(out, field, data);
+			break;
+		case 'F':
+			out = put_float(out, field, data);
+			break;
+		case 'H':
+			out = put_hex(out, data, field.length);
+			break;
+		default:
+			// Text, including dates and times, which are kept as text
+			out = put_text(out, field, data, ccsid);
+			break;
+		}
+	}
+	return out - start;
+}
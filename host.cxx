@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/xattr.h>
+#endif
+#include <unistd.h>
+
+#include "errc.h"
+}
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common.hxx"
+
+/*
+ * The platform anywhere but i, so everything past the system calls can be
+ * built, profiled, and run under sanitizers and valgrind. A library is a
+ * directory (named like MYLIB.LIB, though it doesn't have to be), and a
+ * physical file is a directory named like QRPGLESRC.FILE with a .pfinfo in
+ * it. Members are files of fixed length records named like ORDERS.MBR; like
+ * reading them through the IFS on i, source members don't have the sequence
+ * number and date. The .pfinfo has a key and value a line:
+ *
+ *   record_length 112          RCDLEN, so with the 12 bytes for source
+ *   ccsid 37
+ *   source 1                   0 for data files, read as all text
+ *   member ORDERS RPGLE Order entry
+ *
+ * Members don't need a member line, but they'll have no type or description.
+ * Anything else is a streamfile, in the CCSID in its user.ccsid extended
+ * attribute if it has one, otherwise UTF-8.
+ */
+
+#define PFINFO_NAME "/.pfinfo"
+// EBCDIC, what names and descriptions are padded with
+#define EBCDIC_SPACE '\x40'
+// Big enough for everything parse_member_description reads
+#define HOST_ENTRY_SIZE 0x100
+
+typedef struct host_member {
+	char source_type[10];
+	char description[50];
+} HostMember;
+
+typedef struct host_physical_file {
+	std::string directory;
+	int record_length;
+	int ccsid;
+	bool source;
+	// By EBCDIC name, padded like File::member
+	std::map<std::string, HostMember> members;
+} HostPhysicalFile;
+
+class HostPlatform : public Platform, public std::enable_shared_from_this<HostPlatform> {
+public:
+	bool stat(const char *path, FileStatus &status) override;
+	int filename_to_libobj(File &file) override;
+	int get_pf_info(const File &file) override;
+	bool get_member_info(const File &file, MemberMetadata &metadata) override;
+	const RecordFormat *get_record_format(const File &file) override;
+	std::shared_ptr<MemberListBackend> make_member_lister() override;
+	const HostPhysicalFile *find_file(const char *libobj) const;
+
+private:
+	const HostPhysicalFile *stat_file(const std::string &directory);
+
+	// The physical file the last member stat'd was in, since they come in
+	// order when recursing
+	uint64_t stat_file_id = 0;
+	bool stat_file_found = false;
+	HostPhysicalFile stat_file_info;
+	// By libobj, once it's been worked out from the path
+	std::unordered_map<std::string, HostPhysicalFile> files;
+};
+
+// Lists the members of a physical file by reading its directory, in entries
+// laid out like QUSLMBR's, so load_member_list gets what it does on i.
+class HostMemberList : public MemberListBackend {
+public:
+	explicit HostMemberList(std::shared_ptr<const HostPlatform> platform) : platform(platform) {}
+	bool list(const char *libobj, std::string &entries, size_t &entry_size) override;
+
+private:
+	std::shared_ptr<const HostPlatform> platform;
+};
+
+static bool ends_with_caseless(const std::string &name, const char *suffix)
+{
+	size_t length = strlen(suffix);
+	return name.size() > length && strcasecmp(name.c_str() + name.size() - length, suffix) == 0;
+}
+
+static std::string base_name(const std::string &path)
+{
+	size_t end = path.find_last_not_of('/');
+	if (end == std::string::npos) {
+		return "/";
+	}
+	size_t start = path.find_last_of('/', end);
+	return path.substr(start == std::string::npos ? 0 : start + 1, end - (start == std::string::npos ? 0 : start + 1) + 1);
+}
+
+static std::string dir_name(const std::string &path)
+{
+	size_t end = path.find_last_not_of('/');
+	size_t slash = end == std::string::npos ? std::string::npos : path.find_last_of('/', end);
+	if (slash == std::string::npos) {
+		return ".";
+	}
+	return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static std::string strip_suffix(const std::string &name)
+{
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+/**
+ * Converts text to EBCDIC, padded with spaces to the size of its field. Names
+ * are upper cased first, like QSYS does for names not in quotes.
+ */
+static bool set_field(char *field, size_t size, std::string text, bool is_name)
+{
+	memset(field, EBCDIC_SPACE, size);
+	if (is_name) {
+		if (text.empty() || text.size() > size) {
+			return false;
+		}
+		for (auto &c : text) {
+			c = (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+		}
+	}
+	iconv_t a2e = get_pase_to_system_iconv();
+	char *in = (char*)text.data(), *out = field;
+	size_t inleft = text.size(), outleft = size;
+	size_t rc = iconv(a2e, &in, &inleft, &out, &outleft);
+	reset_iconv(a2e);
+	// Descriptions too long are cut off, like they'd be on i
+	return is_name ? rc != (size_t)-1 && inleft == 0 : true;
+}
+
+/**
+ * Reads the .pfinfo of a physical file's directory. Returns false with errno
+ * set to ENODEV if there isn't one, like QDBRTVFD for things that aren't
+ * physical files.
+ */
+static bool read_pfinfo(const std::string &directory, HostPhysicalFile &file)
+{
+	std::string path = directory + PFINFO_NAME;
+	FILE *f = fopen(path.c_str(), "r");
+	if (f == nullptr) {
+		errno = ENODEV;
+		return false;
+	}
+	file = HostPhysicalFile();
+	file.directory = directory;
+	file.record_length = 0;
+	file.ccsid = 37;
+	file.source = true;
+	char line[512];
+	while (fgets(line, sizeof(line), f) != nullptr) {
+		char key[32], name[32], type[32];
+		int value, offset = 0;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (sscanf(line, "%31s %d", key, &value) == 2 && strcmp(key, "record_length") == 0) {
+			file.record_length = value;
+		} else if (sscanf(line, "%31s %d", key, &value) == 2 && strcmp(key, "ccsid") == 0) {
+			file.ccsid = value;
+		} else if (sscanf(line, "%31s %d", key, &value) == 2 && strcmp(key, "source") == 0) {
+			file.source = value != 0;
+		} else if (sscanf(line, "member %31s %31s %n", name, type, &offset) >= 2) {
+			char member[10];
+			HostMember info;
+			if (!set_field(member, sizeof(member), name, true)) {
+				continue;
+			}
+			set_field(info.source_type, sizeof(info.source_type), type, true);
+			set_field(info.description, sizeof(info.description), offset > 0 ? line + offset : "", false);
+			file.members[std::string(member, sizeof(member))] = info;
+		}
+	}
+	fclose(f);
+	// Source files need room for more than the sequence number and date
+	if (file.record_length <= (file.source ? 12 : 0) || file.record_length > INT16_MAX) {
+		errno = EINVAL;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Gets the physical file a member being stat'd is in, or nullptr if the
+ * directory isn't one.
+ */
+const HostPhysicalFile *HostPlatform::stat_file(const std::string &directory)
+{
+	struct stat s;
+	if (::stat(directory.c_str(), &s) == -1) {
+		return nullptr;
+	}
+	uint64_t id = ((uint64_t)s.st_dev << 32) ^ s.st_ino;
+	if (id != this->stat_file_id) {
+		this->stat_file_id = id;
+		this->stat_file_found = read_pfinfo(directory, this->stat_file_info);
+	}
+	return this->stat_file_found ? &this->stat_file_info : nullptr;
+}
+
+bool HostPlatform::stat(const char *path, FileStatus &status)
+{
+	struct stat s;
+	if (::stat(path, &s) == -1) {
+		return false;
+	}
+	status.size = s.st_size;
+	status.mtime = s.st_mtime;
+	status.ctime = s.st_ctime;
+	status.id = ((uint64_t)s.st_dev << 32) ^ s.st_ino;
+	status.ccsid = 0;
+	std::string name = base_name(path);
+	if (S_ISDIR(s.st_mode)) {
+		std::string pfinfo = std::string(path) + PFINFO_NAME;
+		status.kind = ends_with_caseless(name, ".FILE") && access(pfinfo.c_str(), R_OK) == 0
+			? ObjectPhysicalFile
+			: ObjectDirectory;
+		return true;
+	} else if (!S_ISREG(s.st_mode) || name == PFINFO_NAME + 1) {
+		// The .pfinfo isn't something physical files have in them on i
+		status.kind = ObjectOther;
+		return true;
+	}
+	const HostPhysicalFile *file = nullptr;
+	if (ends_with_caseless(name, ".MBR") && (file = stat_file(dir_name(path))) != nullptr) {
+		status.kind = ObjectMember;
+		status.ccsid = file->ccsid;
+		return true;
+	}
+	status.kind = ObjectStreamfile;
+	status.ccsid = 1208;
+#ifdef __linux__
+	char ccsid[16] = {};
+	if (getxattr(path, "user.ccsid", ccsid, sizeof(ccsid) - 1) > 0 && atoi(ccsid) > 0) {
+		status.ccsid = atoi(ccsid);
+	}
+#endif
+	return true;
+}
+
+/**
+ * Works out the names from the real path, so relative paths work as well as
+ * they do with Qp0lCvtPathToQSYSObjName. The library is the name of the
+ * physical file's directory, less any .LIB.
+ */
+int HostPlatform::filename_to_libobj(File &file)
+{
+	char resolved[PATH_MAX];
+	if (realpath(file.short_filename.data(), resolved) == nullptr) {
+		return -1;
+	}
+	std::string path(resolved), member;
+	if (ends_with_caseless(base_name(path), ".MBR")) {
+		member = strip_suffix(base_name(path));
+		path = dir_name(path);
+	}
+	std::string object = strip_suffix(base_name(path));
+	std::string library = strip_suffix(base_name(dir_name(path)));
+	if (!set_field(file.libobj, 10, object, true)
+			|| !set_field(file.libobj + 10, 10, library, true)) {
+		errno = EINVAL;
+		return -1;
+	}
+	file.libobj[20] = '\0';
+	memset(file.member, EBCDIC_SPACE, 10);
+	file.member[10] = '\0';
+	if (!member.empty() && !set_field(file.member, 10, member, true)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	std::string libobj(file.libobj, 20);
+	if (this->files.find(libobj) == this->files.end()) {
+		HostPhysicalFile info;
+		// Not a physical file is remembered too, for get_pf_info
+		if (!read_pfinfo(path, info)) {
+			info.record_length = 0;
+		}
+		this->files.emplace(libobj, std::move(info));
+	}
+	return 0;
+}
+
+const HostPhysicalFile *HostPlatform::find_file(const char *libobj) const
+{
+	auto found = this->files.find(std::string(libobj, 20));
+	if (found == this->files.end() || found->second.record_length == 0) {
+		return nullptr;
+	}
+	return &found->second;
+}
+
+/**
+ * Gets the record length like rcdfmt.cxx does: positive for source files,
+ * negative for the rest, and 0 with errno set if it isn't a physical file.
+ */
+int HostPlatform::get_pf_info(const File &file)
+{
+	const HostPhysicalFile *info = find_file(file.libobj);
+	if (info == nullptr) {
+		errno = ENODEV;
+		return 0;
+	}
+	return info->source ? info->record_length : -info->record_length;
+}
+
+/**
+ * Makes up what QUSRMBRD would say about the member from the .pfinfo and
+ * its size. Descriptions are converted to CCSID 37 along with everything.
+ */
+bool HostPlatform::get_member_info(const File &file, MemberMetadata &metadata)
+{
+	const HostPhysicalFile *info = find_file(file.libobj);
+	struct stat s;
+	if (info == nullptr || fstat(file.fd, &s) == -1) {
+		errno = ENOENT;
+		return false;
+	}
+	int record_length = info->record_length - (info->source ? 12 : 0);
+	metadata.pf_info = info->source ? info->record_length : -info->record_length;
+	metadata.record_count = s.st_size / record_length;
+	metadata.description_ccsid = 37;
+	auto member = info->members.find(std::string(file.member, 10));
+	if (member != info->members.end()) {
+		memcpy(metadata.source_type, member->second.source_type, sizeof(metadata.source_type));
+		memcpy(metadata.description, member->second.description, sizeof(metadata.description));
+	} else {
+		memset(metadata.source_type, EBCDIC_SPACE, sizeof(metadata.source_type));
+		memset(metadata.description, EBCDIC_SPACE, sizeof(metadata.description));
+	}
+	return true;
+}
+
+/**
+ * Field descriptions aren't modelled, so data files are read as all text.
+ */
+const RecordFormat *HostPlatform::get_record_format(const File &)
+{
+	return nullptr;
+}
+
+std::shared_ptr<MemberListBackend> HostPlatform::make_member_lister()
+{
+	return std::make_shared<HostMemberList>(shared_from_this());
+}
+
+bool HostMemberList::list(const char *libobj, std::string &entries, size_t &entry_size)
+{
+	const HostPhysicalFile *info = this->platform->find_file(libobj);
+	if (info == nullptr) {
+		return false;
+	}
+	DIR *dir = opendir(info->directory.c_str());
+	if (dir == nullptr) {
+		return false;
+	}
+	int record_length = info->record_length - (info->source ? 12 : 0);
+	entries.clear();
+	entry_size = HOST_ENTRY_SIZE;
+	struct dirent *dirent;
+	while ((dirent = readdir(dir)) != nullptr) {
+		std::string name(dirent->d_name), path;
+		char entry[HOST_ENTRY_SIZE] = {}, member[10];
+		struct stat s;
+		if (!ends_with_caseless(name, ".MBR") || !set_field(member, sizeof(member), strip_suffix(name), true)) {
+			continue;
+		}
+		path = info->directory + "/" + name;
+		if (::stat(path.c_str(), &s) == -1) {
+			continue;
+		}
+		// Offsets as parse_member_description and load_member_list read them
+		int32_t record_count = s.st_size / record_length, description_ccsid = 37;
+		memcpy(entry + 0x08, libobj, 20);
+		memcpy(entry + 0x1C, member, sizeof(member));
+		memset(entry + 0x30, EBCDIC_SPACE, 10);
+		memset(entry + 0x54, EBCDIC_SPACE, 50);
+		auto found = info->members.find(std::string(member, sizeof(member)));
+		if (found != info->members.end()) {
+			memcpy(entry + 0x30, found->second.source_type, 10);
+			memcpy(entry + 0x54, found->second.description, 50);
+		}
+		memcpy(entry + 0x8C, &record_count, sizeof(record_count));
+		memcpy(entry + 0xF0, &description_ccsid, sizeof(description_ccsid));
+		entries.append(entry, sizeof(entry));
+	}
+	closedir(dir);
+	return true;
+}
+
+std::shared_ptr<Platform> make_platform()
+{
+	return std::make_shared<HostPlatform>();
+}
+
+// Without a job log, errno is all there is to say
+extern "C" void perror_xpf(const char *s)
+{
+	perror(s);
+}
+
+extern "C" int platform_text_ccsid(void)
+{
+	return 1208;
+}
+
+extern "C" int platform_job_ccsid(void)
+{
+	return 37;
+}
+
+/**
+ * Gets the name iconv knows a CCSID by. Most EBCDIC CCSIDs are known as
+ * IBM037 and the like by glibc and GNU libiconv both.
+ */
+extern "C" const char *platform_ccsid_name(int ccsid)
+{
+	// Names are handed out for as long as the process lives
+	static std::mutex lock;
+	static std::unordered_map<int, std::string> names;
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = names.find(ccsid);
+	if (found != names.end()) {
+		return found->second.c_str();
+	}
+	char name[16];
+	switch (ccsid) {
+	case 367:
+		snprintf(name, sizeof(name), "ASCII");
+		break;
+	case 819:
+		snprintf(name, sizeof(name), "ISO-8859-1");
+		break;
+	case 1200:
+	case 13488:
+		snprintf(name, sizeof(name), "UTF-16BE");
+		break;
+	case 1208:
+		snprintf(name, sizeof(name), "UTF-8");
+		break;
+	default:
+		snprintf(name, sizeof(name), "IBM%03d", ccsid);
+		break;
+	}
+	return names.emplace(ccsid, name).first->second.c_str();
+}
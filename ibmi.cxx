@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <as400_protos.h>
+#include <as400_types.h>
+#include <string.h>
+#include <sys/mode.h>
+#include <sys/stat.h>
+}
+
+#include <memory>
+
+#include "common.hxx"
+
+/*
+ * The platform as PASE has it: statx for the object type and CCSID, and the
+ * ILE APIs in convpath.cxx, rcdfmt.cxx, and mbrinfo.cxx for the rest.
+ */
+
+class IbmiPlatform : public Platform {
+public:
+	bool stat(const char *path, FileStatus &status) override;
+	int filename_to_libobj(File &file) override
+	{
+		return ::filename_to_libobj(file);
+	}
+	int get_pf_info(const File &file) override
+	{
+		return ::get_pf_info(file);
+	}
+	bool get_member_info(const File &file, MemberMetadata &metadata) override
+	{
+		return ::get_member_info(file, metadata);
+	}
+	const RecordFormat *get_record_format(const File &file) override
+	{
+		return ::get_record_format(file);
+	}
+	std::shared_ptr<MemberListBackend> make_member_lister() override
+	{
+		return std::make_shared<UserSpaceMemberList>();
+	}
+};
+
+bool IbmiPlatform::stat(const char *path, FileStatus &status)
+{
+	struct stat64_ILE s = {};
+	// IBM messed up the statx declaration, it doesn't write
+	if (statx((char*)path, (struct stat*)&s, sizeof(s), STX_XPFSS_PASE) == -1) {
+		return false;
+	}
+	status.size = s.st_size;
+	// XXX: This is 32-bit with ILE mtime
+	status.mtime = s.st_mtime;
+	status.ctime = s.st_ctime;
+	// Note that we use the (truncated?) ID that's 32-bit for device and
+	// inode, so we can mask them into a single value. Consider that a TODO...
+	status.id = ((uint64_t)s.st_dev << 32) | s.st_ino;
+	status.ccsid = s.st_ccsid; // or st_codepage?
+	// objtype is *FILE or *DIR, check for mode though to avoid i.e. SAVFs
+	if (S_ISDIR(s.st_mode)) {
+		status.kind = strcmp(s.st_objtype, "*FILE     ") == 0
+			? ObjectPhysicalFile
+			: ObjectDirectory;
+	} else if (strcmp(s.st_objtype, "*MBR      ") == 0) {
+		status.kind = ObjectMember;
+	} else if (strcmp(s.st_objtype, "*STMF     ") == 0) {
+		status.kind = ObjectStreamfile;
+	} else {
+		status.kind = ObjectOther;
+	}
+	return true;
+}
+
+std::shared_ptr<Platform> make_platform()
+{
+	return std::make_shared<IbmiPlatform>();
+}
+
+extern "C" int platform_text_ccsid(void)
+{
+	return Qp2paseCCSID();
+}
+
+extern "C" int platform_job_ccsid(void)
+{
+	return Qp2jobCCSID();
+}
+
+extern "C" const char *platform_ccsid_name(int ccsid)
+{
+	return ccsidtocs(ccsid);
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+#include "lines.h"
+
+#define WORD_ONES  UINT64_C(0x0101010101010101)
+#define WORD_LOWS  UINT64_C(0x7F7F7F7F7F7F7F7F)
+#define WORD_HIGHS UINT64_C(0x8080808080808080)
+
+static inline uint64_t load_word(const char *p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/**
+ * Sets the high bit of exactly the bytes in the word equal to c, so the bits
+ * can be counted.
+ */
+static inline uint64_t bytes_equal(uint64_t word, unsigned char c)
+{
+	uint64_t x = word ^ (WORD_ONES * c);
+	return ~(((x & WORD_LOWS) + WORD_LOWS) | x) & WORD_HIGHS;
+}
+
+static inline bool is_break(char c)
+{
+	return c == '\n' || c == '\r';
+}
+
+#ifdef __ALTIVEC__
+typedef __vector unsigned char vuc;
+typedef __vector unsigned int vui;
+
+static inline vuc load_vector(const char *p)
+{
+	// The buffers aren't aligned, and memcpy gets the compiler to
+	// use whatever unaligned load the CPU has.
+	vuc v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+#endif
+
+/**
+ * Finds the first CR or LF at or after p, or end if there isn't one.
+ */
+const char *lines_find_break(const char *p, const char *end)
+{
+#ifdef __ALTIVEC__
+	const vuc cr_v = vec_splats((unsigned char)'\r');
+	const vuc lf_v = vec_splats((unsigned char)'\n');
+	while (p + 16 <= end) {
+		vuc v = load_vector(p);
+		if (vec_any_eq(v, cr_v) || vec_any_eq(v, lf_v)) {
+			break;
+		}
+		p += 16;
+	}
+#else
+	while (p + sizeof(uint64_t) <= end) {
+		uint64_t word = load_word(p);
+		if (bytes_equal(word, '\r') | bytes_equal(word, '\n')) {
+			break;
+		}
+		p += sizeof(uint64_t);
+	}
+#endif
+	while (p < end && !is_break(*p)) {
+		p++;
+	}
+	return p;
+}
+
+/**
+ * Counts the lines that start between begin and end: every LF, every CR not
+ * right before an LF, and the last line if it has no newline. The newlines
+ * are counted in bulk instead of finding each line.
+ */
+size_t lines_count(const char *begin, const char *end)
+{
+	size_t lines = 0;
+	const char *p = begin;
+#ifdef __ALTIVEC__
+	const vuc cr_v = vec_splats((unsigned char)'\r');
+	const vuc lf_v = vec_splats((unsigned char)'\n');
+	const vui zero = vec_splats(0U);
+	// Each lane counts to 255 at most before it's added up
+	while (p + 17 <= end) {
+		vuc counts = vec_splats((unsigned char)0);
+		for (int i = 0; i < 255 && p + 17 <= end; i++, p += 16) {
+			vuc v = load_vector(p), after = load_vector(p + 1);
+			vuc lf = (vuc)vec_cmpeq(v, lf_v);
+			vuc lone_cr = vec_andc((vuc)vec_cmpeq(v, cr_v), (vuc)vec_cmpeq(after, lf_v));
+			// Matching lanes are all ones, so subtracting adds one
+			counts = vec_sub(counts, lf);
+			counts = vec_sub(counts, lone_cr);
+		}
+		vui sums = vec_sum4s(counts, zero);
+		uint32_t lanes[4];
+		memcpy(lanes, &sums, sizeof(lanes));
+		lines += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#else
+	while (p + sizeof(uint64_t) + 1 <= end) {
+		uint64_t word = load_word(p);
+		uint64_t lf = bytes_equal(word, '\n');
+		uint64_t cr = bytes_equal(word, '\r');
+		if (lf | cr) {
+			// A CR is followed by an LF if the next byte over is one
+			uint64_t lf_after = bytes_equal(load_word(p + 1), '\n');
+			lines += __builtin_popcountll(lf) + __builtin_popcountll(cr & ~lf_after);
+		}
+		p += sizeof(uint64_t);
+	}
+#endif
+	for (; p < end; p++) {
+		if (*p == '\n' || (*p == '\r' && (p + 1 >= end || p[1] != '\n'))) {
+			lines++;
+		}
+	}
+	if (end > begin && !is_break(end[-1])) {
+		lines++; // the last line has no newline
+	}
+	return lines;
+}
+
+/**
+ * Finds the start of the line p is in, without going back past begin.
+ */
+const char *lines_start_of(const char *begin, const char *p)
+{
+	while (p > begin && !is_break(p[-1])) {
+		p--;
+	}
+	return p;
+}
+
+/**
+ * Finds where the line before the one at line starts, without going back
+ * past begin. Context before a match only needs a few of these.
+ */
+const char *lines_previous(const char *begin, const char *line)
+{
+	const char *p = line;
+	if (p > begin && p[-1] == '\n') {
+		p--;
+		if (p > begin && p[-1] == '\r') {
+			p--;
+		}
+	} else if (p > begin && p[-1] == '\r') {
+		p--;
+	}
+	return lines_start_of(begin, p);
+}
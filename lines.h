@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stddef.h>
+
+/*
+ * Lines end with CR, LF, or CRLF, like how pfgrep splits them.
+ */
+const char *lines_find_break(const char *p, const char *end);
+size_t lines_count(const char *begin, const char *end);
+const char *lines_start_of(const char *begin, const char *p);
+const char *lines_previous(const char *begin, const char *line);
@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "common.hxx"
+
+// Where the case folding and \w bitmap are in pcre2_maketables' tables
+#define PCRE2_TABLES_LCC 0
+#define PCRE2_TABLES_CBIT_WORD (512 + 160)
+
+#define WORD_ONES  UINT64_C(0x0101010101010101)
+#define WORD_HIGHS UINT64_C(0x8080808080808080)
+
+/**
+ * Sets the high bit of every byte in the word equal to c. Bytes above a match
+ * can be set too, but never a byte that doesn't match below the first one, so
+ * a word with no bits set definitely has no match.
+ */
+static inline uint64_t bytes_equal(uint64_t word, uint64_t c)
+{
+	uint64_t x = word ^ c;
+	return (x - WORD_ONES) & ~x & WORD_HIGHS;
+}
+
+static inline uint64_t load_word(const char *p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/**
+ * Finds the bytes that are the same character as c when case doesn't matter.
+ * Returns false if there are more than two, which the filter can't handle.
+ */
+static bool case_variants(const unsigned char *fold, unsigned char c, uint64_t variants[2])
+{
+	int count = 0;
+	for (int i = 0; i < 256; i++) {
+		if (fold[i] != fold[c]) {
+			continue;
+		}
+		if (count == 2) {
+			return false;
+		}
+		variants[count++] = WORD_ONES * i;
+	}
+	if (count == 1) {
+		variants[1] = variants[0];
+	}
+	return true;
+}
+
+LiteralMatcher::LiteralMatcher(const std::string &needle, const unsigned char *tables, bool caseless, bool match_word, bool match_line)
+{
+	this->caseless = caseless;
+	this->match_word = match_word;
+	this->match_line = match_line;
+	for (int i = 0; i < 256; i++) {
+		this->fold[i] = caseless ? tables[PCRE2_TABLES_LCC + i] : i;
+		this->word[i] = tables[PCRE2_TABLES_CBIT_WORD + (i / 8)] & (1 << (i % 8));
+	}
+	for (char c : needle) {
+		this->needle.push_back(this->fold[(unsigned char)c]);
+	}
+	this->use_filter = case_variants(this->fold, this->needle.front(), this->first)
+		&& case_variants(this->fold, this->needle.back(), this->last);
+}
+
+bool LiteralMatcher::equals_at(const char *haystack, size_t position) const
+{
+	if (!this->caseless) {
+		return memcmp(haystack + position, this->needle.data(), this->needle.size()) == 0;
+	}
+	const unsigned char *h = (const unsigned char*)haystack + position;
+	for (size_t i = 0; i < this->needle.size(); i++) {
+		if (this->fold[h[i]] != (unsigned char)this->needle[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Finds where the needle next occurs, ignoring word and line matching. Eight
+ * places are checked at a time by comparing the needle's first and last bytes
+ * against a word each, and only places where both match are compared fully.
+ */
+size_t LiteralMatcher::find_candidate(const char *haystack, size_t length, size_t offset) const
+{
+	size_t n = this->needle.size();
+	if (length < n) {
+		return std::string::npos;
+	}
+	size_t last_start = length - n;
+	size_t i = offset;
+	if (this->use_filter) {
+		// The word for the last byte can't run past the end
+		for (; i + n - 1 + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+			uint64_t firsts = load_word(haystack + i);
+			uint64_t lasts = load_word(haystack + i + n - 1);
+			uint64_t candidates = (bytes_equal(firsts, this->first[0]) | bytes_equal(firsts, this->first[1]))
+				& (bytes_equal(lasts, this->last[0]) | bytes_equal(lasts, this->last[1]));
+			if (candidates == 0) {
+				continue;
+			}
+			for (size_t j = 0; j < sizeof(uint64_t); j++) {
+				if (equals_at(haystack, i + j)) {
+					return i + j;
+				}
+			}
+		}
+	}
+	for (; i <= last_start; i++) {
+		if (equals_at(haystack, i)) {
+			return i;
+		}
+	}
+	return std::string::npos;
+}
+
+/**
+ * If there's a word boundary before position, like \b.
+ */
+bool LiteralMatcher::is_boundary(const char *haystack, size_t length, size_t position) const
+{
+	bool before = position > 0 && this->word[(unsigned char)haystack[position - 1]];
+	bool after = position < length && this->word[(unsigned char)haystack[position]];
+	return before != after;
+}
+
+/**
+ * Finds the next match at or after offset, like PCRE2_LITERAL with the same
+ * options would. Returns false if there isn't one.
+ */
+bool LiteralMatcher::find(const char *haystack, size_t length, size_t offset, size_t &start, size_t &end) const
+{
+	size_t n = this->needle.size();
+	if (this->match_line) {
+		// Like ^ and $, which allows a newline at the end
+		if (offset > 0 || length < n || !equals_at(haystack, 0)) {
+			return false;
+		}
+		if (length != n && !(length == n + 1 && haystack[n] == '\n')) {
+			return false;
+		}
+		start = 0;
+		end = n;
+		return true;
+	}
+	size_t position = offset;
+	while ((position = find_candidate(haystack, length, position)) != std::string::npos) {
+		if (!this->match_word || (is_boundary(haystack, length, position)
+				&& is_boundary(haystack, length, position + n))) {
+			start = position;
+			end = position + n;
+			return true;
+		}
+		position++;
+	}
+	return false;
+}
+
+/**
+ * Finds where the character class starting at i ends, or npos.
+ */
+static size_t skip_class(const std::string &expr, size_t i)
+{
+	size_t j = i + 1;
+	if (j < expr.size() && expr[j] == '^') {
+		j++;
+	}
+	if (j < expr.size() && expr[j] == ']') {
+		j++; // a literal ] if it's first
+	}
+	while (j < expr.size()) {
+		if (expr[j] == '\\') {
+			j += 2;
+		} else if (expr[j] == '[' && j + 1 < expr.size() && expr[j + 1] == ':') {
+			size_t end = expr.find(":]", j + 2);
+			if (end == std::string::npos) {
+				return std::string::npos;
+			}
+			j = end + 2;
+		} else if (expr[j] == ']') {
+			return j + 1;
+		} else {
+			j++;
+		}
+	}
+	return std::string::npos;
+}
+
+/**
+ * Finds where the group starting at i ends, or npos.
+ */
+static size_t skip_group(const std::string &expr, size_t i)
+{
+	int depth = 0;
+	size_t j = i;
+	while (j < expr.size()) {
+		if (expr[j] == '\\') {
+			j += 2;
+		} else if (expr[j] == '[') {
+			j = skip_class(expr, j);
+			if (j == std::string::npos) {
+				return j;
+			}
+		} else if (expr[j] == '(') {
+			depth++;
+			j++;
+		} else if (expr[j] == ')') {
+			j++;
+			if (--depth == 0) {
+				return j;
+			}
+		} else {
+			j++;
+		}
+	}
+	return std::string::npos;
+}
+
+/**
+ * Checks for a {n,m} quantifier at i, giving its minimum and where it ends.
+ */
+static bool is_quantifier(const std::string &expr, size_t i, unsigned long &minimum, size_t &end)
+{
+	if (i >= expr.size() || expr[i] != '{') {
+		return false;
+	}
+	size_t j = i + 1;
+	std::string digits;
+	while (j < expr.size() && isdigit((unsigned char)expr[j])) {
+		digits.push_back(expr[j++]);
+	}
+	bool any_digits = !digits.empty();
+	if (j < expr.size() && expr[j] == ',') {
+		j++;
+		while (j < expr.size() && isdigit((unsigned char)expr[j])) {
+			j++;
+			any_digits = true;
+		}
+	}
+	if (!any_digits || j >= expr.size() || expr[j] != '}') {
+		return false;
+	}
+	minimum = digits.empty() ? 0 : strtoul(digits.c_str(), nullptr, 10);
+	end = j + 1;
+	return true;
+}
+
+/**
+ * Finds the longest run of literal characters that every match of a regular
+ * expression has to contain, so lines without it can be skipped. Groups and
+ * classes are skipped over rather than looked into, and any alternation
+ * outside of a group means there's no telling. Returns an empty string if
+ * nothing could be found. If the pattern sets any options inline, the
+ * literal is treated as caseless to be safe.
+ */
+std::string required_literal(const std::string &expr, bool &caseless)
+{
+	std::string best, run;
+	size_t i = 0, n = expr.size();
+	auto end_run = [&best, &run]() {
+		if (run.size() > best.size()) {
+			best = run;
+		}
+		run.clear();
+	};
+	if (expr.find("(?") != std::string::npos) {
+		caseless = true;
+	}
+
+	while (i < n) {
+		char c = expr[i];
+		size_t next = i + 1;
+		unsigned long minimum;
+		size_t quantifier_end;
+		switch (c) {
+		case '|':
+			return "";
+		case '(':
+			// Verbs, extended mode, and comments change how the rest
+			// of the pattern is read
+			if (next < n && expr[next] == '*') {
+				return "";
+			} else if (next < n && expr[next] == '?') {
+				size_t j = next + 1;
+				if (j < n && expr[j] == '#') {
+					return "";
+				}
+				while (j < n && (isalpha((unsigned char)expr[j]) || expr[j] == '-' || expr[j] == '^')) {
+					if (expr[j] == 'x') {
+						return "";
+					}
+					j++;
+				}
+			}
+			i = skip_group(expr, i);
+			if (i == std::string::npos) {
+				return "";
+			}
+			end_run();
+			continue;
+		case '[':
+			i = skip_class(expr, i);
+			if (i == std::string::npos) {
+				return "";
+			}
+			end_run();
+			continue;
+		case '\\':
+			if (next >= n) {
+				return "";
+			}
+			c = expr[next];
+			if (isascii((unsigned char)c) && ispunct((unsigned char)c)) {
+				next++;
+				break; // an escaped literal
+			} else if (strchr("dswDSWbBAzZGhHvVRXK", c) != nullptr) {
+				end_run();
+				i = next + 1;
+				continue;
+			}
+			return "";
+		case '.':
+		case '^':
+		case '$':
+		case '*':
+		case '+':
+		case '?':
+			end_run();
+			i = next;
+			continue;
+		case '{':
+			if (is_quantifier(expr, i, minimum, quantifier_end)) {
+				end_run();
+				i = quantifier_end;
+				continue;
+			}
+			break;
+		default:
+			break;
+		}
+
+		// A literal; what comes after decides if it's required
+		if (next < n && (expr[next] == '?' || expr[next] == '*')) {
+			end_run();
+		} else if (is_quantifier(expr, next, minimum, quantifier_end)) {
+			if (minimum > 0) {
+				run.push_back(c);
+			}
+			end_run();
+		} else if (next < n && expr[next] == '+') {
+			run.push_back(c);
+			end_run();
+		} else {
+			run.push_back(c);
+		}
+		i = next;
+	}
+	end_run();
+
+	// A line never has a newline in it, so don't look for one
+	if (best.find_first_of("\r\n") != std::string::npos) {
+		return "";
+	}
+	return best;
+}
+
+/**
+ * Checks if a pattern can be run over many lines at once, finding at least
+ * every match it would find in each line on its own. Anything that looks
+ * past where it matches, like lookarounds and \A, or that can't give back
+ * what it took, like possessive quantifiers, could see the lines around it.
+ * This errs on the side of saying no.
+ */
+bool matches_within_lines(const std::string &expr)
+{
+	size_t n = expr.size();
+	for (size_t i = 0; i < n; i++) {
+		char c = expr[i];
+		char next = i + 1 < n ? expr[i + 1] : '\0';
+		if (c == '\\') {
+			if (next != '\0' && strchr("AzZGKQ", next) != nullptr) {
+				return false;
+			}
+			i++;
+		} else if (c == '(' && (next == '*' || next == '?')) {
+			// Only groups and option settings; not assertions,
+			// atomic groups, recursion, conditions, or verbs
+			size_t j = i + 2;
+			if (next == '*' || j >= n) {
+				return false;
+			}
+			if (expr.compare(j, 2, "P<") == 0) {
+				j++;
+			}
+			if ((expr[j] == '<' || expr[j] == '\'') && j + 1 < n && isalpha((unsigned char)expr[j + 1])) {
+				continue; // a named group
+			}
+			while (j < n && expr[j] != '\0' && strchr("imnsxJU-^", expr[j]) != nullptr) {
+				j++;
+			}
+			if (j >= n || (expr[j] != ':' && expr[j] != ')' && expr[j] != '|')) {
+				return false;
+			}
+		} else if (strchr("*+?}", c) != nullptr && next == '+') {
+			return false;
+		}
+	}
+	return true;
+}
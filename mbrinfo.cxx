@@ -25,9 +25,14 @@ extern "C" {
 using namespace pase_cpp;
 
 static PGMFunction<char*, int, const char*, const char*, const char*, const char, ERRC0100*> QUSRMBRD("QSYS", "QUSRMBRD", PGMCALL_EXCP_NOSIGNAL);
+static PGMFunction<const char*, const char*, const char*, const char*, const char, ERRC0100*> QUSLMBR("QSYS", "QUSLMBR", PGMCALL_EXCP_NOSIGNAL);
 
+/**
+ * Gets a member's information as QUSRMBRD has it, without converting it, so
+ * it can be kept in the metadata cache as is.
+ */
 // assume EBCDIC
-extern "C" bool get_member_info(File &file)
+extern "C" bool get_member_info(const File &file, MemberMetadata &metadata)
 {
 	char output[8192];
 	memset(output, 0, 8192);
@@ -42,31 +47,27 @@ extern "C" bool get_member_info(File &file)
 		return false;
 	}
 
-	file.record_count = *(uint32_t*)(output + 0x8C);
-
-	// XXX: Convert to using struct
-	iconv_t sys_conv = get_iconv(37);
-	char *in = output + 0x30, *out = file.source_type;
-	size_t inleft = 10, outleft = sizeof(file.source_type);
-	iconv(sys_conv, &in, &inleft, &out, &outleft);
+	parse_member_description(output, metadata);
+	return true;
+}
 
-	int32_t desc_ccsid = *(uint32_t*)(output + 0xF0);
-	// 65535 is no-convert, but we want to convert, and binary descriptions
-	// should be rare. Often, it's set for no description, or things that
-	// predate ~V2R1.
-	if (desc_ccsid == 65535 || desc_ccsid == 0) {
-		desc_ccsid = Qp2jobCCSID();
+/**
+ * Lists every member of a physical file with QUSLMBR in one call.
+ */
+bool UserSpaceMemberList::list(const char *libobj, std::string &entries, size_t &entry_size)
+{
+	const char *space = get_list_space();
+	if (space == nullptr) {
+		return false;
 	}
 
-	{
-		iconv_t desc_conv = get_iconv(desc_ccsid);
-		char *in = output + 0x54, *out = file.description;
-		size_t inleft = 50, outleft = sizeof(file.description);
-		iconv(desc_conv, &in, &inleft, &out, &outleft);
-		// reset in case of shift state
-		reset_iconv(desc_conv);
-		*out = '\0';
+	ERRC0100 errc = {};
+	errc.bytes_avail = sizeof(ERRC0100);
+	EbcdicFixedString<10> all_members("*ALL");
+	QUSLMBR(space, "MBRL0310"_e, libobj, all_members, '0'_e, &errc);
+	if (errc.exception_id[0] != '\0') {
+		errno = ENOSYS;
+		return false;
 	}
-
-	return true;
+	return read_list_space(entries, entry_size);
 }
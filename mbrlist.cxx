@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <stdint.h>
+#include <string.h>
+}
+
+#include <string>
+
+#include "common.hxx"
+
+/*
+ * Nothing in here calls the system APIs, the backend does, so what's done
+ * with the list can be tried with a canned one anywhere.
+ */
+
+/**
+ * Gets the fields we use out of a member description laid out like format
+ * MBRD0200 of QUSRMBRD, which the MBRL0310 list entries are too.
+ */
+void parse_member_description(const char *description, MemberMetadata &metadata)
+{
+	// XXX: Convert to using struct
+	memcpy(&metadata.record_count, description + 0x8C, sizeof(metadata.record_count));
+	memcpy(metadata.source_type, description + 0x30, sizeof(metadata.source_type));
+	memcpy(&metadata.description_ccsid, description + 0xF0, sizeof(metadata.description_ccsid));
+	memcpy(metadata.description, description + 0x54, sizeof(metadata.description));
+}
+
+/**
+ * Fills in the file from the member's information, converting the text.
+ */
+void set_member_info(File &file, const MemberMetadata &metadata)
+{
+	file.record_count = metadata.record_count;
+
+	iconv_t sys_conv = get_iconv(37);
+	char *in = (char*)metadata.source_type, *out = file.source_type;
+	size_t inleft = sizeof(metadata.source_type), outleft = sizeof(file.source_type);
+	iconv(sys_conv, &in, &inleft, &out, &outleft);
+
+	int32_t desc_ccsid = metadata.description_ccsid;
+	// 65535 is no-convert, but we want to convert, and binary descriptions
+	// should be rare. Often, it's set for no description, or things that
+	// predate ~V2R1.
+	if (desc_ccsid == 65535 || desc_ccsid == 0) {
+		desc_ccsid = platform_job_ccsid();
+	}
+
+	{
+		iconv_t desc_conv = get_iconv(desc_ccsid);
+		char *in = (char*)metadata.description, *out = file.description;
+		size_t inleft = sizeof(metadata.description), outleft = sizeof(file.description);
+		iconv(desc_conv, &in, &inleft, &out, &outleft);
+		// reset in case of shift state
+		reset_iconv(desc_conv);
+		*out = '\0';
+	}
+}
+
+/**
+ * Fills in the members of the physical file in list->libobj with a single
+ * call to the backend, keyed by the name readdir gives each member (i.e.
+ * ABC.MBR). Returns false if the list couldn't be had, in which case each
+ * member is looked up on its own like before.
+ */
+bool load_member_list(MemberListBackend &backend, MemberList &list)
+{
+	std::string entries;
+	size_t entry_size = 0;
+	if (!backend.list(list.libobj, entries, entry_size)) {
+		return false;
+	}
+	// Each entry has to have everything parse_member_description reads
+	if (entry_size < 0xF0 + sizeof(int32_t)) {
+		return false;
+	}
+	iconv_t name_conv = get_iconv(37);
+	list.members.clear();
+	for (size_t offset = 0; offset + entry_size <= entries.size(); offset += entry_size) {
+		const char *entry = entries.data() + offset;
+		// The file and library come before the member, like in libobj;
+		// if they don't match, the entries aren't what we think they are
+		if (memcmp(entry + 0x08, list.libobj, 20) != 0) {
+			list.members.clear();
+			return false;
+		}
+		ListedMember member = {};
+		// Member name (Qdbmbr) in the description
+		memcpy(member.member, entry + 0x1C, 10);
+		parse_member_description(entry, member.metadata);
+		member.metadata.pf_info = list.pf_info;
+
+		char name[(10 * UTF8_SCALE_FACTOR) + 1];
+		char *in = member.member, *out = name;
+		size_t inleft = 10, outleft = sizeof(name) - 1;
+		if (iconv(name_conv, &in, &inleft, &out, &outleft) == (size_t)-1) {
+			reset_iconv(name_conv);
+			continue; // looked up by path instead
+		}
+		while (out > name && out[-1] == ' ') {
+			out--;
+		}
+		std::string key(name, out - name);
+		key.append(".MBR");
+		list.members.emplace(std::move(key), member);
+	}
+	return true;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "common.hxx"
+
+// Bump the version at the end if the record layout changes; an old cache is
+// then just ignored and rewritten.
+#define CACHE_MAGIC "PFMDC\0\0\1"
+#define CACHE_MAGIC_LENGTH 8
+#define CACHE_HEADER_SIZE 16
+
+/*
+ * Each member is a fixed size record, sorted by key, so a lookup is a binary
+ * search of the mapped file. Numbers are big endian.
+ *
+ *   0  object and library, then member (30, EBCDIC, as the APIs want them)
+ *  32  mtime (8), ctime (8), size (8), for telling if it's still good
+ *  56  pf_info (4), record_count (4), description_ccsid (4)
+ *  68  source_type (10), description (50), EBCDIC
+ */
+#define RECORD_KEY_SIZE 30
+#define RECORD_MTIME 32
+#define RECORD_CTIME 40
+#define RECORD_SIZE_FIELD 48
+#define RECORD_PF_INFO 56
+#define RECORD_RECORD_COUNT 60
+#define RECORD_DESCRIPTION_CCSID 64
+#define RECORD_SOURCE_TYPE 68
+#define RECORD_DESCRIPTION 78
+#define RECORD_SIZE 128
+
+static void put_u32(char *out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		out[i] = (char)(value >> (24 - (i * 8)));
+	}
+}
+
+static void put_u64(char *out, uint64_t value)
+{
+	put_u32(out, (uint32_t)(value >> 32));
+	put_u32(out + 4, (uint32_t)value);
+}
+
+static uint32_t get_u32(const char *in)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) {
+		value = (value << 8) | (unsigned char)in[i];
+	}
+	return value;
+}
+
+static uint64_t get_u64(const char *in)
+{
+	return ((uint64_t)get_u32(in) << 32) | get_u32(in + 4);
+}
+
+static std::string make_key(const File &file)
+{
+	std::string key(file.libobj, 20);
+	key.append(file.member, 10);
+	return key;
+}
+
+MetadataCache::~MetadataCache()
+{
+	if (this->map != nullptr) {
+		munmap(this->map, this->map_size);
+	}
+}
+
+/**
+ * Maps the cache at path, if there is one. A missing or unusable cache is
+ * fine, it's as if it were empty; returns false only if it can't be read.
+ */
+bool MetadataCache::open(const std::string &path)
+{
+	this->path = path;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return errno == ENOENT;
+	}
+	struct stat s;
+	if (fstat(fd, &s) == -1) {
+		close(fd);
+		return false;
+	}
+	size_t size = s.st_size;
+	if (size < CACHE_HEADER_SIZE) {
+		close(fd);
+		return true;
+	}
+	void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	const char *header = (const char*)map;
+	size_t count = get_u32(header + CACHE_MAGIC_LENGTH);
+	if (memcmp(header, CACHE_MAGIC, CACHE_MAGIC_LENGTH) != 0
+			|| get_u32(header + CACHE_MAGIC_LENGTH + 4) != RECORD_SIZE
+			|| (size - CACHE_HEADER_SIZE) / RECORD_SIZE < count) {
+		munmap(map, size);
+		return true;
+	}
+	this->map = (char*)map;
+	this->map_size = size;
+	this->count = count;
+	return true;
+}
+
+const char *MetadataCache::lookup(const char *key) const
+{
+	size_t low = 0, high = this->count;
+	while (low < high) {
+		size_t middle = low + ((high - low) / 2);
+		const char *record = this->map + CACHE_HEADER_SIZE + (middle * RECORD_SIZE);
+		int cmp = memcmp(record, key, RECORD_KEY_SIZE);
+		if (cmp == 0) {
+			return record;
+		} else if (cmp < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Gets what's known about a member, if it hasn't changed since.
+ */
+bool MetadataCache::find(const File &file, MemberMetadata &metadata) const
+{
+	std::string key = make_key(file);
+	const char *record;
+	auto found = this->added.find(key);
+	if (found != this->added.end()) {
+		record = found->second.data();
+	} else {
+		record = lookup(key.data());
+	}
+	if (record == nullptr
+			|| (int64_t)get_u64(record + RECORD_MTIME) != (int64_t)file.mtime
+			|| (int64_t)get_u64(record + RECORD_CTIME) != (int64_t)file.ctime
+			|| (int64_t)get_u64(record + RECORD_SIZE_FIELD) != file.file_size) {
+		return false;
+	}
+	metadata.pf_info = (int32_t)get_u32(record + RECORD_PF_INFO);
+	metadata.record_count = (int32_t)get_u32(record + RECORD_RECORD_COUNT);
+	metadata.description_ccsid = (int32_t)get_u32(record + RECORD_DESCRIPTION_CCSID);
+	memcpy(metadata.source_type, record + RECORD_SOURCE_TYPE, sizeof(metadata.source_type));
+	memcpy(metadata.description, record + RECORD_DESCRIPTION, sizeof(metadata.description));
+	return true;
+}
+
+void MetadataCache::add(const File &file, const MemberMetadata &metadata)
+{
+	std::string record(RECORD_SIZE, '\0');
+	char *p = &record[0];
+	memcpy(p, file.libobj, 20);
+	memcpy(p + 20, file.member, 10);
+	put_u64(p + RECORD_MTIME, (uint64_t)file.mtime);
+	put_u64(p + RECORD_CTIME, (uint64_t)file.ctime);
+	put_u64(p + RECORD_SIZE_FIELD, (uint64_t)file.file_size);
+	put_u32(p + RECORD_PF_INFO, (uint32_t)metadata.pf_info);
+	put_u32(p + RECORD_RECORD_COUNT, (uint32_t)metadata.record_count);
+	put_u32(p + RECORD_DESCRIPTION_CCSID, (uint32_t)metadata.description_ccsid);
+	memcpy(p + RECORD_SOURCE_TYPE, metadata.source_type, sizeof(metadata.source_type));
+	memcpy(p + RECORD_DESCRIPTION, metadata.description, sizeof(metadata.description));
+	this->added[make_key(file)] = std::move(record);
+}
+
+/**
+ * Writes the cache back out if anything was added, merging the new records
+ * into the old ones. Members not seen this run are kept, since another run
+ * might look at them. The new cache replaces the old one all at once.
+ */
+bool MetadataCache::save()
+{
+	if (this->added.empty()) {
+		return true;
+	}
+	std::string temporary = fmt::format("{}.{}", this->path, getpid());
+	FILE *f = fopen(temporary.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+	// Records that were replaced aren't written, so count as we go
+	size_t written = 0;
+	char header[CACHE_HEADER_SIZE] = {};
+	bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+	size_t old = 0;
+	auto next = this->added.begin();
+	while (ok && (old < this->count || next != this->added.end())) {
+		const char *record = old < this->count
+			? this->map + CACHE_HEADER_SIZE + (old * RECORD_SIZE)
+			: nullptr;
+		int cmp = 1;
+		if (record != nullptr && next != this->added.end()) {
+			cmp = memcmp(record, next->first.data(), RECORD_KEY_SIZE);
+		} else if (record != nullptr) {
+			cmp = -1;
+		}
+		if (cmp < 0) {
+			old++;
+		} else {
+			if (cmp == 0) {
+				old++; // replaced
+			}
+			record = next->second.data();
+			next++;
+		}
+		ok = fwrite(record, 1, RECORD_SIZE, f) == RECORD_SIZE;
+		written++;
+	}
+	memcpy(header, CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+	put_u32(header + CACHE_MAGIC_LENGTH, written);
+	put_u32(header + CACHE_MAGIC_LENGTH + 4, RECORD_SIZE);
+	ok = ok && fseek(f, 0, SEEK_SET) == 0
+		&& fwrite(header, 1, sizeof(header), f) == sizeof(header);
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(temporary.c_str(), this->path.c_str()) != 0) {
+		int saved_errno = errno;
+		remove(temporary.c_str());
+		errno = saved_errno;
+		return false;
+	}
+	this->added.clear();
+	return true;
+}
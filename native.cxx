@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fmt/format.h>
+
+#include "common.hxx"
+
+// The layout of pcre2_maketables' tables: lower case, flipped case, then ten
+// bitmaps for classes like \d and [:alpha:], then a type for each character.
+#define PCRE2_TABLES_LCC 0
+#define PCRE2_TABLES_FCC 256
+#define PCRE2_TABLES_CBITS 512
+#define PCRE2_TABLES_CBITS_COUNT 10
+#define PCRE2_TABLES_CTYPES 832
+#define PCRE2_TABLES_LENGTH 1088
+
+/**
+ * Finds the byte in the single byte CCSID for the character at the start of
+ * text, which is in the PASE CCSID. Returns -1 if there isn't one.
+ */
+static int find_native_byte(const SbcsTable *table, const char *text, size_t text_length, size_t &char_length)
+{
+	int found = -1;
+	char_length = 0;
+	for (int i = 0; i < 256; i++) {
+		size_t length = table->length[i];
+		if (length > char_length && length <= text_length
+				&& memcmp(table->bytes[i], text, length) == 0) {
+			found = i;
+			char_length = length;
+		}
+	}
+	return found;
+}
+
+class PatternTranscoder {
+public:
+	PatternTranscoder(const std::string &expr, const SbcsTable *table, std::string &out)
+		: expr(expr), out(out) {
+		this->table = table;
+	}
+
+	bool transcode();
+
+private:
+	bool literal(bool in_class);
+	bool escape(bool in_class, bool &negated);
+	bool group();
+	bool character_class();
+	bool quantifier();
+	bool followed_by_repeat(size_t i);
+	void copy(size_t length);
+
+	const std::string &expr;
+	const SbcsTable *table;
+	std::string &out;
+	size_t i = 0;
+};
+
+void PatternTranscoder::copy(size_t length)
+{
+	this->out.append(this->expr, this->i, length);
+	this->i += length;
+}
+
+/**
+ * Things that match one byte of a multibyte character in the PASE CCSID, like
+ * ., only match the same lines in a single byte CCSID if any number of them
+ * can match, where the count doesn't matter.
+ */
+bool PatternTranscoder::followed_by_repeat(size_t i)
+{
+	return i < this->expr.size() && (this->expr[i] == '*' || this->expr[i] == '+');
+}
+
+/**
+ * Writes the character as an escape for its byte, so it's never mistaken
+ * for a metacharacter, whatever the byte is.
+ */
+bool PatternTranscoder::literal(bool in_class)
+{
+	size_t char_length;
+	int byte = find_native_byte(this->table, this->expr.data() + this->i,
+		this->expr.size() - this->i, char_length);
+	if (byte == -1) {
+		return false;
+	}
+	// Without UTF mode, a multibyte character in a class or before a
+	// quantifier is treated as separate bytes, which we can't mimic
+	if (char_length > 1) {
+		if (in_class) {
+			return false;
+		}
+		size_t next = this->i + char_length;
+		if (next < this->expr.size() && strchr("*+?{", this->expr[next]) != nullptr) {
+			return false;
+		}
+	}
+	fmt::format_to(std::back_inserter(this->out), "\\x{{{:02X}}}", byte);
+	this->i += char_length;
+	return true;
+}
+
+bool PatternTranscoder::escape(bool in_class, bool &negated)
+{
+	if (this->i + 1 >= this->expr.size()) {
+		return false;
+	}
+	char e = this->expr[this->i + 1];
+	// These are looked up in the character tables
+	if (strchr("dsw", e) != nullptr) {
+		copy(2);
+		return true;
+	} else if (strchr("DSW", e) != nullptr) {
+		if (!in_class && !followed_by_repeat(this->i + 2)) {
+			return false;
+		}
+		negated = true;
+		copy(2);
+		return true;
+	} else if (!in_class && strchr("bBAzZGK", e) != nullptr) {
+		copy(2);
+		return true;
+	} else if (!in_class && e >= '1' && e <= '9'
+			&& !(this->i + 2 < this->expr.size() && isdigit((unsigned char)this->expr[this->i + 2]))) {
+		copy(2); // backreference
+		return true;
+	} else if (isascii((unsigned char)e) && ispunct((unsigned char)e)) {
+		this->i++;
+		return literal(in_class);
+	}
+	// Things like \n and \x are character values, which mean something
+	// else in another CCSID
+	return false;
+}
+
+bool PatternTranscoder::group()
+{
+	const std::string &expr = this->expr;
+	size_t j = this->i + 1;
+	if (j >= expr.size() || expr[j] == '*') {
+		return false; // verbs like (*CR) change how the pattern works
+	} else if (expr[j] != '?') {
+		copy(1);
+		return true;
+	}
+	j++;
+	if (j >= expr.size()) {
+		return false;
+	}
+	if (strchr(":=!>|", expr[j]) != nullptr) {
+		copy(j + 1 - this->i);
+		return true;
+	} else if (expr[j] == '<' && j + 1 < expr.size() && strchr("=!", expr[j + 1]) != nullptr) {
+		copy(j + 2 - this->i);
+		return true;
+	} else if (expr[j] == '<' || expr[j] == '\'' || expr[j] == 'P') {
+		// PCRE2 checks group names with the character tables, which
+		// would be for the other CCSID
+		return false;
+	}
+	// Option settings like (?i) or (?i:...)
+	size_t k = j;
+	while (k < expr.size() && (isalpha((unsigned char)expr[k]) || expr[k] == '-' || expr[k] == '^')) {
+		// Extended mode makes the whitespace we escape significant
+		if (expr[k] == 'x') {
+			return false;
+		}
+		k++;
+	}
+	if (k == j || k >= expr.size() || (expr[k] != ')' && expr[k] != ':')) {
+		return false;
+	}
+	copy(k + 1 - this->i);
+	return true;
+}
+
+bool PatternTranscoder::character_class()
+{
+	const std::string &expr = this->expr;
+	bool negated = false, first = true;
+	copy(1);
+	if (this->i < expr.size() && expr[this->i] == '^') {
+		negated = true;
+		copy(1);
+	}
+	while (true) {
+		if (this->i >= expr.size()) {
+			return false;
+		}
+		char c = expr[this->i];
+		if (c == ']' && !first) {
+			copy(1);
+			break;
+		}
+		first = false;
+		if (c == '[' && this->i + 1 < expr.size() && expr[this->i + 1] == ':') {
+			// POSIX classes are looked up in the character tables
+			size_t end = expr.find(":]", this->i + 2);
+			if (end == std::string::npos) {
+				return false;
+			}
+			if (expr[this->i + 2] == '^') {
+				negated = true;
+			}
+			copy(end + 2 - this->i);
+			continue;
+		} else if (c == '[' && this->i + 1 < expr.size() && strchr(".=", expr[this->i + 1]) != nullptr) {
+			return false;
+		} else if (c == '\\') {
+			if (!escape(true, negated)) {
+				return false;
+			}
+		} else if (!literal(true)) {
+			return false;
+		}
+		// Ranges cover different characters in different CCSIDs
+		if (this->i + 1 < expr.size() && expr[this->i] == '-' && expr[this->i + 1] != ']') {
+			return false;
+		}
+	}
+	return !negated || followed_by_repeat(this->i);
+}
+
+/**
+ * Copies a {n,m} quantifier, or returns false if the brace is a literal.
+ */
+bool PatternTranscoder::quantifier()
+{
+	const std::string &expr = this->expr;
+	size_t j = this->i + 1;
+	bool digits = false;
+	while (j < expr.size() && isdigit((unsigned char)expr[j])) {
+		j++;
+		digits = true;
+	}
+	if (j < expr.size() && expr[j] == ',') {
+		j++;
+		while (j < expr.size() && isdigit((unsigned char)expr[j])) {
+			j++;
+			digits = true;
+		}
+	}
+	if (!digits || j >= expr.size() || expr[j] != '}') {
+		return false;
+	}
+	copy(j + 1 - this->i);
+	return true;
+}
+
+bool PatternTranscoder::transcode()
+{
+	bool negated = false;
+	while (this->i < this->expr.size()) {
+		char c = this->expr[this->i];
+		bool ok = true;
+		switch (c) {
+		case '\\':
+			ok = escape(false, negated);
+			break;
+		case '.':
+			ok = followed_by_repeat(this->i + 1);
+			if (ok) {
+				copy(1);
+			}
+			break;
+		case '[':
+			ok = character_class();
+			break;
+		case '(':
+			ok = group();
+			break;
+		case '^':
+		case '$':
+		case '|':
+		case ')':
+		case '*':
+		case '+':
+		case '?':
+			copy(1);
+			break;
+		case '{':
+			if (!quantifier()) {
+				ok = literal(false);
+			}
+			break;
+		default:
+			ok = literal(false);
+			break;
+		}
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Rewrites a pattern in the PASE CCSID so it matches the same lines in text
+ * of a single byte CCSID, without converting the text. Literal characters
+ * become escapes for their bytes, and the rest is kept as is. Returns false
+ * if the pattern has anything that could match differently, like ranges or
+ * character values, in which case the text has to be converted instead.
+ */
+bool transcode_pattern(const std::string &expr, const SbcsTable *table, bool fixed, std::string &out)
+{
+	out.clear();
+	if (!fixed) {
+		PatternTranscoder transcoder(expr, table, out);
+		return transcoder.transcode();
+	}
+	// Literal patterns are just converted
+	for (size_t i = 0; i < expr.size();) {
+		size_t char_length;
+		int byte = find_native_byte(table, expr.data() + i, expr.size() - i, char_length);
+		if (byte == -1) {
+			return false;
+		}
+		out.push_back((char)byte);
+		i += char_length;
+	}
+	return true;
+}
+
+/**
+ * Makes PCRE2 character tables for a single byte CCSID out of the ones for
+ * the PASE CCSID, so i.e. \w and caseless matching cover the same characters
+ * in both. Characters that are multibyte in the PASE CCSID get no classes,
+ * like each of their bytes would have.
+ */
+unsigned char *make_native_tables(const unsigned char *base, const SbcsTable *table)
+{
+	int reverse[256];
+	for (int i = 0; i < 256; i++) {
+		reverse[i] = -1;
+	}
+	for (int i = 0; i < 256; i++) {
+		if (table->length[i] == 1 && reverse[table->single[i]] == -1) {
+			reverse[table->single[i]] = i;
+		}
+	}
+
+	unsigned char *tables = (unsigned char*)calloc(1, PCRE2_TABLES_LENGTH);
+	if (tables == nullptr) {
+		return nullptr;
+	}
+	for (int i = 0; i < 256; i++) {
+		tables[PCRE2_TABLES_LCC + i] = i;
+		tables[PCRE2_TABLES_FCC + i] = i;
+		if (table->length[i] != 1) {
+			continue;
+		}
+		unsigned char c = table->single[i];
+		int lower = reverse[base[PCRE2_TABLES_LCC + c]];
+		if (lower != -1) {
+			tables[PCRE2_TABLES_LCC + i] = lower;
+		}
+		int flipped = reverse[base[PCRE2_TABLES_FCC + c]];
+		if (flipped != -1) {
+			tables[PCRE2_TABLES_FCC + i] = flipped;
+		}
+		for (int map = 0; map < PCRE2_TABLES_CBITS_COUNT; map++) {
+			const unsigned char *base_bits = base + PCRE2_TABLES_CBITS + (map * 32);
+			unsigned char *bits = tables + PCRE2_TABLES_CBITS + (map * 32);
+			if (base_bits[c / 8] & (1 << (c % 8))) {
+				bits[i / 8] |= 1 << (i % 8);
+			}
+		}
+		tables[PCRE2_TABLES_CTYPES + i] = base[PCRE2_TABLES_CTYPES + c];
+	}
+	return tables;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <sys/errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+}
+
+#include <cstring>
+#include <string>
+
+#include "common.hxx"
+
+OutputSink::OutputSink(int fd)
+{
+	this->fd = fd;
+	// Someone watching wants to see each file as soon as it's done
+	this->flush_each_file = isatty(fd);
+	this->pending.reserve(OUTPUT_BUFFER_SIZE);
+}
+
+OutputSink::~OutputSink()
+{
+	flush();
+}
+
+/**
+ * Writes out what's pending, then the data given, in one call if possible.
+ * Once writing fails (i.e. the reader went away), everything else is dropped.
+ */
+void OutputSink::write_out(const char *data, size_t length)
+{
+	struct iovec iov[2];
+	int count = 0;
+	if (!this->pending.empty()) {
+		iov[count].iov_base = &this->pending[0];
+		iov[count].iov_len = this->pending.size();
+		count++;
+	}
+	if (length > 0) {
+		iov[count].iov_base = (void*)data;
+		iov[count].iov_len = length;
+		count++;
+	}
+	struct iovec *next = iov;
+	while (count > 0 && !this->failed) {
+		ssize_t written = writev(this->fd, next, count);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		} else if (written < 0) {
+			this->failed = true;
+			this->error = errno;
+			break;
+		}
+		// Skip over what was written, which can end partway through
+		while (count > 0 && (size_t)written >= next->iov_len) {
+			written -= next->iov_len;
+			next++;
+			count--;
+		}
+		if (count > 0) {
+			next->iov_base = (char*)next->iov_base + written;
+			next->iov_len -= written;
+		}
+	}
+	this->pending.clear();
+}
+
+/**
+ * Adds to what gets written out. Small pieces are gathered up; anything that
+ * doesn't fit is written out right away along with them, without a copy.
+ */
+void OutputSink::write(const char *data, size_t length)
+{
+	if (this->pending.size() + length <= OUTPUT_BUFFER_SIZE) {
+		this->pending.append(data, length);
+		return;
+	}
+	write_out(data, length);
+}
+
+void OutputSink::write(const std::string &text)
+{
+	write(text.data(), text.size());
+}
+
+/**
+ * Called once all of a file's output has been added, or as much of it as
+ * there is so far, for output written while the file is still being read.
+ */
+void OutputSink::end_file()
+{
+	if (this->flush_each_file) {
+		flush();
+	}
+}
+
+void OutputSink::flush()
+{
+	if (!this->pending.empty()) {
+		write_out(nullptr, 0);
+	}
+}
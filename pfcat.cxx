@@ -5,6 +5,8 @@
  */
 
 extern "C" {
+#include <unistd.h>
+
 #include "errc.h"
 }
 
@@ -15,34 +17,81 @@ extern "C" {
 class pfcat : public pfbase {
 public:
 	int do_action(File &file) override;
+	pfbase *make_worker() const override;
 };
 
 static void usage(char *argv0)
 {
-	fprintf(stderr, "usage: %s [-prtV] files\n", argv0);
+	fprintf(stderr, "usage: %s [-j jobs] [-prtV] [--no-mmap] [--metadata-cache file] [--stats] [--newer-than time] [--older-than time] files\n", argv0);
+}
+
+pfbase *pfcat::make_worker() const
+{
+	auto worker = new pfcat(*this);
+	worker->init_worker();
+	return worker;
 }
 
 int pfcat::do_action(File &file)
 {
-	if (file.record_length == 0) {
-		if (file.ccsid == this->pase_ccsid) {
-			printf("%s", this->read_buffer);
+	Window window;
+	int rc;
+	while ((rc = next_window(file, window)) > 0) {
+		// Without workers, nothing else can be written before us, so
+		// write as we go instead of holding the whole file
+		if (!this->is_worker) {
+			this->sink->write(window.data, window.length);
+		} else if (file.is_mapped && window.data == file.map) {
+			// The whole file, already in our CCSID; rather than copy
+			// it, it stays mapped until it's our turn to write it
+			file.keep_map = true;
 		} else {
-			printf("%s", this->conv_buffer);
+			this->output.append(window.data, window.length);
 		}
-	} else {
-		printf("%s", this->conv_buffer);
 	}
-	return 0;
+	return rc < 0 ? -1 : 0;
 }
 
+static const LongOption long_options[] = {
+	{"no-mmap", false, OptionNoMmap},
+	{"metadata-cache", true, OptionMetadataCache},
+	{"newer-than", true, OptionNewerThan},
+	{"older-than", true, OptionOlderThan},
+	{"stats", false, OptionStats},
+	{nullptr, false, 0},
+};
+
 int main(int argc, char **argv)
 {
 	auto state = pfcat();
 
 	int ch;
-	while ((ch = getopt(argc, argv, "prtV")) != -1) {
+	while ((ch = get_option(argc, argv, "j:prtV", long_options)) != -1) {
 		switch (ch) {
+		case OptionNoMmap:
+			state.use_mmap = false;
+			break;
+		case OptionStats:
+			state.stats = std::make_shared<Stats>();
+			break;
+		case OptionMetadataCache:
+			state.open_metadata_cache(optarg);
+			break;
+		case OptionNewerThan:
+			if (!state.parse_time(optarg, state.newer_than)) {
+				return 3;
+			}
+			state.filter_newer = true;
+			break;
+		case OptionOlderThan:
+			if (!state.parse_time(optarg, state.older_than)) {
+				return 3;
+			}
+			state.filter_older = true;
+			break;
+		case 'j':
+			state.worker_count = parse_worker_count(optarg);
+			break;
 		case 'p':
 			state.search_non_source_files = true;
 			break;
@@ -71,6 +120,8 @@ int main(int argc, char **argv)
 			any_error = true;
 		}
 	}
+	state.finish_jobs(any_match, any_error);
+	state.print_stats("pfcat");
 
 	return any_error ? 2 : (any_match ? 0 : 1);
 }
@@ -8,15 +8,21 @@ extern "C" {
 #include <unistd.h>
 
 #define PCRE2_CODE_UNIT_WIDTH 8
+#ifdef _AIX
 #include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
 #include <pcre2.h>
 
 #include "errc.h"
 }
 
-#include <fmt/base.h>
+#include <fmt/format.h>
 
 #include <deque>
+#include <iterator>
+#include <memory>
 #if defined(__cpp_lib_optional)
 #include <optional>
 #else
@@ -28,10 +34,12 @@ extern "C" {
 #else
 #include <experimental/string_view>
 #endif
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "common.hxx"
+#include "search.hxx"
 
 // XXX: Remove when we can assume C++17 minimum
 // We should also use .has_value() instead for C++
@@ -48,20 +56,14 @@ using std::string_view;
 using std::experimental::string_view;
 #endif
 
-class Pattern {
+// Patterns rewritten to search text in a single byte CCSID as it is
+class NativePatterns {
 public:
-	Pattern(const std::string &expr, pcre2_code *re, bool can_jit) : expr(expr) {
-		this->re = re;
-		this->can_jit = can_jit;
-	}
-
-	// Lifetime is that of pattern_strings
-	const std::string &expr;
-	// Don't handle destruction in this, since we can get copied by
-	// collections. Free at the end instead.
-	// XXX: Probably use *_ptr...
-	pcre2_code *re;
-	bool can_jit;
+	// False if any pattern couldn't be rewritten
+	bool usable = false;
+	std::vector<Pattern> patterns;
+	unsigned char *tables = nullptr;
+	pcre2_compile_context *compile_context = nullptr;
 };
 
 class Match {
@@ -82,6 +84,22 @@ public:
 		this->substrings = {};
 	}
 
+	/**
+	 * Copies the line, so the match outlives the window of the file that
+	 * it points into.
+	 */
+	void own() {
+		if (this->owned) {
+			return;
+		}
+		this->owned = std::make_shared<std::string>(this->line, this->length);
+		const char *old_line = this->line;
+		this->line = this->owned->data();
+		for (auto& substring : this->substrings) {
+			substring = string_view(this->line + (substring.data() - old_line), substring.size());
+		}
+	}
+
 	// This is an offset into the file; alive as long as the match
 	const char *line;
 	size_t length;
@@ -89,15 +107,22 @@ public:
 	bool context;
 	// XXX: Right type for this?
 	std::vector<string_view> substrings;
+	// Set if the line has been copied out of the window
+	std::shared_ptr<std::string> owned;
 };
 
-class PCRE2Error {
+// Line state that carries over from one window of a file to the next
+class SearchState {
 public:
-	PCRE2Error(int rc) {
-		this->rc = rc;
-	}
-
-	int rc;
+	int matches = 0;
+	int lineno = 0;
+	int last_printed_line = -1;
+	int current_after_lines = 0;
+	std::deque<Match> before_queue;
+	// Lines are converted into a buffer that's reused for the next line
+	bool lines_are_scratch = false;
+	// Where in the window each pattern's required literal is next found
+	std::vector<size_t> candidates;
 };
 
 enum PrintMode {
@@ -113,20 +138,36 @@ class pfgrep : public pfbase {
 public:
 	~pfgrep();
 	int do_action(File &file) override;
+	pfbase *make_worker() const override;
+	void commit_job(Job &job) override;
+	bool rule_out(const File &file) override;
 	void print_version(const char *tool_name);
 	bool compile_pattern(const std::string &expr);
+	void load_index();
 	bool add_patterns_from_file(const char *path);
 	uint32_t get_compile_flags();
 	uint32_t get_extra_compile_flags();
+	std::shared_ptr<LiteralMatcher> make_literal(const std::string &needle, const unsigned char *tables);
+	void find_required(Pattern &pattern);
+	void compile_buffer_pattern(Pattern &pattern);
 
 	/* Pattern */
 	std::vector<std::string> pattern_strings;
 	std::vector<Pattern> patterns;
 	pcre2_general_context *general_context = nullptr;
 	pcre2_compile_context *compile_context = nullptr;
+	pcre2_compile_context *buffer_compile_context = nullptr;
 	pcre2_match_data *match_data = nullptr;
 	uint32_t biggest_capture_count = 0;
 	bool can_jit = false;
+	// Character tables for the PASE CCSID, which native ones are made from
+	const uint8_t *base_tables = nullptr;
+	// From pfindex, with which files in it could match the patterns
+	std::shared_ptr<const TrigramIndex> index;
+	std::shared_ptr<const std::vector<bool>> index_candidates;
+	// Each thread compiles its own native patterns, like iconv handles
+	std::unordered_map<uint16_t, NativePatterns> native_patterns;
+	std::string native_line;
 	/* Options */
 	PrintMode mode = ModeNormal;
 	bool case_insensitive = false;
@@ -138,33 +179,96 @@ public:
 	bool match_line = false;
 	bool fixed = false;
 	bool search_descriptions = false;
+	bool native_search = true;
 	int max_matches = 0;
 	int after_lines = 0;
 	unsigned int before_lines = 0;
+	const char *index_path = nullptr;
 	/* Current cross-file state */
 	bool has_printed = false;
+	/* What starts each match and context line of the current file */
+	std::string match_prefix;
+	std::string context_prefix;
 
 private:
+	template <typename... T>
+	inline void print(fmt::format_string<T...> format, T&&... args);
+	template <typename... T>
+	inline void println(fmt::format_string<T...> format, T&&... args);
 	inline const char *maybe_colour(const char *colour);
 	inline void print_separator();
+	void flush_output();
 	void print_filename(const std::string &filename, int count);
-	inline void print_line_beginning(const File &file, const Match &match);
-	bool print_line(const File &file, const Match &match);
-	optional<Match> try_patterns(const char *line, size_t line_size, int line_no);
+	void set_line_prefixes(const File &file);
+	inline void print_line_beginning(const Match &match);
+	bool print_line(const Match &match);
+	bool jit_compile(pcre2_code *re);
+	const NativePatterns &get_native_patterns(const File &file);
+	void free_native_patterns();
+	optional<Match> try_patterns(const std::vector<Pattern> &patterns, const char *line, size_t line_size, int line_no);
+	bool find_match(const std::vector<Pattern> &patterns, const char *line, size_t line_size, int line_no, optional<Match> &match);
+	bool handle_line(const char *line, size_t line_size, const optional<Match> &match, SearchState &state);
+	bool can_skip_lines(const SearchState &state);
+	bool needs_line_numbers();
+	bool search_window(const Window &window, SearchState &state);
+	bool search_records(const File &file, const Window &window, SearchState &state, const std::vector<Pattern> &patterns);
 };
 
 pfgrep::~pfgrep()
 {
+	// Workers only own their match data and native patterns, the
+	// patterns are shared
+	if (this->is_worker) {
+		pcre2_match_data_free(this->match_data);
+		free_native_patterns();
+		return;
+	}
 #ifdef DEBUG
+	free_native_patterns();
 	pcre2_match_data_free(this->match_data);
 	for (const auto& pattern : patterns) {
 		pcre2_code_free(pattern.re);
+		pcre2_code_free(pattern.buffer_re);
 	}
 	pcre2_compile_context_free(compile_context);
+	pcre2_compile_context_free(buffer_compile_context);
 	pcre2_general_context_free(general_context);
 #endif
 }
 
+pfbase *pfgrep::make_worker() const
+{
+	auto worker = new pfgrep(*this);
+	worker->init_worker();
+	// Compiled patterns are safe to share, but match data isn't
+	worker->match_data = pcre2_match_data_create(this->biggest_capture_count + 1, this->general_context);
+	worker->native_patterns.clear();
+	return worker;
+}
+
+void pfgrep::free_native_patterns()
+{
+	for (auto& entry : this->native_patterns) {
+		NativePatterns &native = entry.second;
+		for (const auto& pattern : native.patterns) {
+			pcre2_code_free(pattern.re);
+		}
+		pcre2_compile_context_free(native.compile_context);
+		free(native.tables);
+	}
+	this->native_patterns.clear();
+}
+
+void pfgrep::commit_job(Job &job)
+{
+	// The file didn't know if anything was printed before it; we do now
+	if (job.wants_separator && this->has_printed) {
+		this->sink->write(fmt::format("{}--\n", maybe_colour(PFGREP_COLON_COLOUR)));
+	}
+	pfbase::commit_job(job);
+	this->has_printed |= job.printed;
+}
+
 void pfgrep::print_version(const char *tool_name)
 {
 	pfbase::print_version(tool_name);
@@ -183,8 +287,8 @@ void pfgrep::print_version(const char *tool_name)
 
 static void usage(char *argv0)
 {
-	fmt::println(stderr, "usage: {} [-A num] [-B num] [-C num] [-m matches] [-cFHhiLlnopqrstwVvx] pattern files...", argv0);
-	fmt::println(stderr, "usage: {} [-A num] [-B num] [-C num] [-m matches] [-cFHhiLlnopqrstwVvx] [-e pattern] [-f file] files...", argv0);
+	fmt::println(stderr, "usage: {} [-A num] [-B num] [-C num] [-j jobs] [-m matches] [-cFHhiLlnopqrstwVvx] [--no-mmap] [--metadata-cache file] [--stats] [--newer-than time] [--older-than time] [--no-native] [--index file] pattern files...", argv0);
+	fmt::println(stderr, "usage: {} [-A num] [-B num] [-C num] [-j jobs] [-m matches] [-cFHhiLlnopqrstwVvx] [--no-mmap] [--metadata-cache file] [--stats] [--newer-than time] [--older-than time] [--no-native] [--index file] [-e pattern] [-f file] files...", argv0);
 }
 
 uint32_t pfgrep::get_compile_flags()
@@ -193,9 +297,8 @@ uint32_t pfgrep::get_compile_flags()
 	if (this->case_insensitive) {
 		flags |= PCRE2_CASELESS;
 	}
-	// XXX: We might consider using i.e. str(case)str instead, since it's
-	// possibly faster than using PCRE, but it does work w/ the other PCRE
-	// flags like matching words/lines, so...
+	// Fixed strings are matched by LiteralMatcher, but are still compiled
+	// to check them and in case we can't use it
 	if (this->fixed) {
 		flags |= PCRE2_LITERAL;
 	}
@@ -214,6 +317,38 @@ uint32_t pfgrep::get_extra_compile_flags()
 	return flags;
 }
 
+/**
+ * Makes a matcher for a fixed string, if we can use one. The tables are what
+ * PCRE2 would use for case folding and word characters.
+ */
+std::shared_ptr<LiteralMatcher> pfgrep::make_literal(const std::string &needle, const unsigned char *tables)
+{
+	// An empty string matches everywhere, which PCRE2 handles fine
+	if (!this->fixed || needle.empty() || tables == nullptr) {
+		return nullptr;
+	}
+	return std::make_shared<LiteralMatcher>(needle, tables, this->case_insensitive,
+		this->match_word, this->match_line);
+}
+
+/**
+ * Formats into the output for the current file. On a worker, it's written
+ * out once the file is done, in the order files were found; otherwise it's
+ * written after each window by flush_output.
+ */
+template <typename... T>
+inline void pfgrep::print(fmt::format_string<T...> format, T&&... args)
+{
+	fmt::format_to(std::back_inserter(this->output), format, std::forward<T>(args)...);
+}
+
+template <typename... T>
+inline void pfgrep::println(fmt::format_string<T...> format, T&&... args)
+{
+	fmt::format_to(std::back_inserter(this->output), format, std::forward<T>(args)...);
+	this->output.push_back('\n');
+}
+
 inline const char *pfgrep::maybe_colour(const char *colour)
 {
 	if (this->colourize == ColourizeAlways) {
@@ -225,61 +360,93 @@ inline const char *pfgrep::maybe_colour(const char *colour)
 inline void pfgrep::print_separator()
 {
 	// Don't worry about reseting it, as colour output will always follow
-	fmt::println("{}--", maybe_colour(PFGREP_COLON_COLOUR));
+	println("{}--", maybe_colour(PFGREP_COLON_COLOUR));
+}
+
+/**
+ * Without workers, nothing else can be written before us, so write what the
+ * file has printed so far instead of holding all of it until it's done.
+ */
+void pfgrep::flush_output()
+{
+	if (this->is_worker || this->output.empty()) {
+		return;
+	}
+	// Like commit_job would, but it's known now if an earlier file printed
+	if (this->output_wants_separator && this->has_printed) {
+		this->sink->write(fmt::format("{}--\n", maybe_colour(PFGREP_COLON_COLOUR)));
+	}
+	this->output_wants_separator = false;
+	this->sink->write(this->output);
+	this->sink->end_file();
+	this->output.clear();
+	this->has_printed |= this->output_printed;
 }
 
 void pfgrep::print_filename(const std::string &filename, int count)
 {
-	fmt::print("{}{}", maybe_colour(PFGREP_FILNAM_COLOUR), filename);
+	print("{}{}", maybe_colour(PFGREP_FILNAM_COLOUR), filename);
 	if (count > -1) {
-		fmt::println("{}:{}{}", maybe_colour(PFGREP_COLON_COLOUR),
+		println("{}:{}{}", maybe_colour(PFGREP_COLON_COLOUR),
 			maybe_colour(PFGREP_NORMAL_COLOUR), count);
 	} else {
-		fmt::println("{}", maybe_colour(PFGREP_NORMAL_COLOUR));
+		println("{}", maybe_colour(PFGREP_NORMAL_COLOUR));
 	}
 }
 
-inline void pfgrep::print_line_beginning(const File &file, const Match &match)
+/**
+ * Formats the filename part of each line once for the file, instead of for
+ * every line printed.
+ */
+void pfgrep::set_line_prefixes(const File &file)
 {
-	const char *colon = match.context ? "-" : ":";
+	this->match_prefix.clear();
+	this->context_prefix.clear();
 	if ((this->file_count > 1 && !this->never_print_filename) || this->always_print_filename) {
-		fmt::print("{}{}{}{}", maybe_colour(PFGREP_FILNAM_COLOUR),
-			file.full_filename, maybe_colour(PFGREP_COLON_COLOUR),
-			colon);
+		this->match_prefix = fmt::format("{}{}{}:", maybe_colour(PFGREP_FILNAM_COLOUR),
+			file.full_filename, maybe_colour(PFGREP_COLON_COLOUR));
+		this->context_prefix = fmt::format("{}{}{}-", maybe_colour(PFGREP_FILNAM_COLOUR),
+			file.full_filename, maybe_colour(PFGREP_COLON_COLOUR));
 	}
+}
+
+inline void pfgrep::print_line_beginning(const Match &match)
+{
+	const char *colon = match.context ? "-" : ":";
+	this->output.append(match.context ? this->context_prefix : this->match_prefix);
 	if (this->print_line_numbers) {
-		fmt::print("{}{}{}{}", maybe_colour(PFGREP_LINENO_COLOUR),
+		print("{}{}{}{}", maybe_colour(PFGREP_LINENO_COLOUR),
 			match.lineno, maybe_colour(PFGREP_COLON_COLOUR),
 			colon);
 	}
 }
 
-bool pfgrep::print_line(const File &file, const Match &match)
+bool pfgrep::print_line(const Match &match)
 {
 	if (this->mode == ModeSubstrings && match.substrings.size()) {
 		for (const auto& substring : match.substrings) {
-			print_line_beginning(file, match);
-			fmt::println("{}{}{}", maybe_colour(PFGREP_MATCH_COLOUR),
+			print_line_beginning(match);
+			println("{}{}{}", maybe_colour(PFGREP_MATCH_COLOUR),
 				substring, maybe_colour(PFGREP_NORMAL_COLOUR));
 		}
 		return true;
 	} else if (this->mode == ModeNormal) {
-		print_line_beginning(file, match);
+		print_line_beginning(match);
 		if (this->colourize == ColourizeAlways && match.substrings.size()) {
 			size_t last_substring_end = 0;
 			for (const auto& substring : match.substrings) {
 				auto before = string_view(match.line + last_substring_end,
 					(substring.data() - match.line) - last_substring_end);
-				fmt::print("{}{}{}{}",
+				print("{}{}{}{}",
 					maybe_colour(PFGREP_NORMAL_COLOUR), before,
 					maybe_colour(PFGREP_MATCH_COLOUR), substring);
 				last_substring_end = (substring.data() - match.line) + substring.size();
 			}
 			auto after = string_view(match.line + last_substring_end,
 				match.length - last_substring_end);
-			fmt::println("{}{}", maybe_colour(PFGREP_NORMAL_COLOUR), after);
+			println("{}{}", maybe_colour(PFGREP_NORMAL_COLOUR), after);
 		} else {
-			fmt::println("{}{}", maybe_colour(PFGREP_NORMAL_COLOUR),
+			println("{}{}", maybe_colour(PFGREP_NORMAL_COLOUR),
 				string_view(match.line, match.length));
 		}
 		return true;
@@ -289,75 +456,275 @@ bool pfgrep::print_line(const File &file, const Match &match)
 	return false;
 }
 
-optional<Match> pfgrep::try_patterns(const char *line, size_t line_size, int line_no)
+optional<Match> pfgrep::try_patterns(const std::vector<Pattern> &patterns, const char *line, size_t line_size, int line_no)
 {
-	uint32_t offset = 0, flags = 0;
-	int rc = 0;
 	// XXX: Enable scan_more for structured output too
-	bool scan_more = this->colourize == ColourizeAlways, matched = false;
+	bool scan_more = this->colourize == ColourizeAlways;
 	std::vector<string_view> substrings;
-	size_t last_substring_end = 0;
-	// We can have multiple expressions. Find the first match.
-	for (const auto& pattern : this->patterns) {
-		pcre2_code *re = pattern.re;
+	if (!match_patterns(patterns, this->match_data, line, line_size, scan_more, substrings)) {
+		return nullopt;
+	}
+	return Match(line, line_size, line_no, std::move(substrings));
+}
 
-again:
-		// As long as we checked that the pattern successfully was JIT
-		// compiled, it should be safe to use pcre2_jit_match instead.
-		if (pattern.can_jit) {
-			rc = pcre2_jit_match(re, (PCRE2_SPTR)line, line_size, offset, flags, this->match_data, nullptr);
+/**
+ * Matches a line, printing the error if matching failed. Returns false if
+ * there's no point in searching any further.
+ */
+bool pfgrep::find_match(const std::vector<Pattern> &patterns, const char *line, size_t line_size, int line_no, optional<Match> &match)
+{
+	int rc = 0;
+	try {
+		match = try_patterns(patterns, line, line_size, line_no);
+	} catch (PCRE2Error pcre2error) {
+		if (!this->silent) {
+			PCRE2_UCHAR buffer[256];
+			pcre2_get_error_message(rc, buffer, sizeof(buffer));
+			fmt::print(stderr, "failed match error: {} ({})", (const char*)buffer, pcre2error.rc);
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Prints a line that was just matched (or not) as needed, along with any
+ * context. Returns false if there's no need to keep searching the file.
+ */
+bool pfgrep::handle_line(const char *line, size_t line_size, const optional<Match> &match, SearchState &state)
+{
+	bool matched = match != nullopt;
+	if ((matched && !this->invert) || (!matched && this->invert)) {
+		state.matches++;
+		state.current_after_lines = this->after_lines;
+
+		const bool has_context_lines = this->after_lines || before_lines;
+		const bool first_in_file = state.last_printed_line <= 0;
+		const bool separator_for_file = this->output_printed && first_in_file;
+		const bool separator_for_group = state.last_printed_line >= 0 && (state.last_printed_line < state.lineno - 1);
+		if (has_context_lines && (separator_for_file || separator_for_group)) {
+			print_separator();
+		} else if (has_context_lines && first_in_file && !this->output_printed) {
+			// Whether an earlier file printed is decided at commit
+			this->output_wants_separator = true;
+		}
+		state.last_printed_line = state.lineno;
+		// Drain the queue of before items
+		for (const auto& queued_match : state.before_queue) {
+			print_line(queued_match);
+		}
+		state.before_queue.clear();
+
+		if (matched) {
+			this->output_printed |= print_line(*match);
+			// Early return if we just need one match
+			// (the case for -q and -l flags)
+			if (this->mode == ModeQuiet || this->mode == ModeMatchingFilenames) {
+				return false;
+			}
 		} else {
-			rc = pcre2_match(re, (PCRE2_SPTR)line, line_size, offset, flags, this->match_data, nullptr);
-		}
-
-		if (rc > 0) {
-			matched = true;
-			size_t* ovector = pcre2_get_ovector_pointer(this->match_data);
-			size_t substring_length = ovector[1] - ovector[0];
-			// Cheap way to avoid overlap and having to do more
-			// complicated substring coalescing
-			if ((ovector[0] > last_substring_end) || substrings.size() == 0) {
-				substrings.emplace_back(line + ovector[0], substring_length);
-			} else if ((ovector[0] == last_substring_end) && substrings.size()) {
-				// If the two substrings run into each other
-				const char *old_string = substrings.back().data();
-				size_t new_length = substrings.back().size() + substring_length;
-				substrings.back() = string_view(old_string, new_length);
+			this->output_printed |= print_line(Match(line, line_size, state.lineno, false));
+		}
+	} else if (state.current_after_lines-- > 0) {
+		state.last_printed_line = state.lineno;
+		print_line({line, line_size, state.lineno, true});
+	} else if (this->before_lines) {
+		// Push into the queue; make sure we don't go over
+		state.before_queue.emplace_back(line, line_size, state.lineno, true);
+		if (state.lines_are_scratch) {
+			state.before_queue.back().own();
+		}
+		if (state.before_queue.size() > this->before_lines) {
+			state.before_queue.pop_front();
+		}
+	}
+
+	if (this->max_matches > 0 && state.matches >= this->max_matches) {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * If line numbers are shown, or needed to tell if context is next to the
+ * last line printed. Otherwise they aren't counted for lines skipped over.
+ */
+bool pfgrep::needs_line_numbers()
+{
+	return this->print_line_numbers || this->before_lines || this->after_lines;
+}
+
+/**
+ * If lines that can't match can go by without being looked at. Otherwise,
+ * they're printed as inverted matches or after context. Lines for before
+ * context are only needed right before a match, so those are backed up to.
+ */
+bool pfgrep::can_skip_lines(const SearchState &state)
+{
+	return !this->invert && state.current_after_lines <= 0;
+}
+
+/**
+ * Searches the lines in a window of the file. Returns false if there's no
+ * need to keep searching the file.
+ */
+bool pfgrep::search_window(const Window &window, SearchState &state)
+{
+	WindowLines lines(this->patterns, this->match_data, window.data, window.length, state.candidates);
+	while (lines.next(can_skip_lines(state), this->before_lines, needs_line_numbers() ? &state.lineno : nullptr)) {
+		state.lineno++;
+		optional<Match> match;
+		if (lines.could_match && !find_match(this->patterns, lines.line, lines.line_size, state.lineno, match)) {
+			return false;
+		}
+		if (!handle_line(lines.line, lines.line_size, match, state)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Searches a window of records in their own single byte CCSID, with patterns
+ * rewritten for it. Only lines that get printed are converted. Returns false
+ * if there's no need to keep searching the file.
+ */
+bool pfgrep::search_records(const File &file, const Window &window, SearchState &state, const std::vector<Pattern> &patterns)
+{
+	const bool prints_lines = this->mode == ModeNormal || this->mode == ModeSubstrings;
+	size_t candidate = first_candidate(patterns, this->match_data, window.data, window.length, state.candidates);
+
+	for (size_t offset = 0; offset < window.length; offset += file.record_length) {
+		if (!state.candidates.empty() && candidate < offset) {
+			candidate = next_candidate(patterns, this->match_data, window.data, window.length, offset, state.candidates);
+		}
+		// Go straight to the record the next match could be in
+		if (!state.candidates.empty() && candidate > offset && can_skip_lines(state)) {
+			size_t target = window.length;
+			if (candidate != std::string::npos) {
+				target = candidate - (candidate % file.record_length);
 			}
-			// Scan more in this string; be careful not to loop
-			// XXX: Use pcre2_next_match when we get newer PCRE2
-			if (ovector[0] == ovector[1]) {
-				break; // i.e. if empty string is pattern
+			size_t context = this->before_lines * file.record_length;
+			target = target - offset > context ? target - context : offset;
+			state.lineno += (target - offset) / file.record_length;
+			offset = target;
+			if (offset >= window.length) {
+				break;
 			}
-			last_substring_end = ovector[1];
-			offset = ovector[1];
-			goto again;
 		}
+		const char *record = window.data + offset;
+		size_t record_size = file.record_length;
+		if (!this->dont_trim_ending_whitespace) {
+			record_size = sbcs_trimmed_length(file.sbcs, record, record_size);
+		}
+		state.lineno++;
 
-		if (rc > 0 && !scan_more) {
-			break;
-		} else if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
-			throw PCRE2Error(rc);
+		optional<Match> match;
+		bool could_match = state.candidates.empty() || candidate < offset + file.record_length;
+		if (could_match && !find_match(patterns, record, record_size, state.lineno, match)) {
+			return false;
+		}
+		const bool selected = (match != nullopt) != this->invert;
+		if (!prints_lines || !(selected || state.current_after_lines > 0 || this->before_lines)) {
+			// Nothing from this line gets printed, so don't convert it
+			if (!handle_line(record, record_size, match, state)) {
+				return false;
+			}
+			continue;
+		}
+
+		// Converting a prefix gives where a substring starts in the text
+		this->native_line.resize((record_size * 4) + 1);
+		char *line = &this->native_line[0];
+		size_t line_size = sbcs_convert(file.sbcs, record, record_size, line);
+		if (match != nullopt) {
+			std::vector<string_view> substrings;
+			for (const auto& substring : match->substrings) {
+				size_t start = 0, length = 0;
+				const char *native_start = substring.data();
+				for (const char *c = record; c < native_start; c++) {
+					start += file.sbcs->length[(unsigned char)*c];
+				}
+				for (size_t i = 0; i < substring.size(); i++) {
+					length += file.sbcs->length[(unsigned char)native_start[i]];
+				}
+				substrings.emplace_back(line + start, length);
+			}
+			match.emplace(line, line_size, state.lineno, std::move(substrings));
+		}
+		if (!handle_line(line, line_size, match, state)) {
+			return false;
 		}
 	}
-	if (!matched) {
-		return nullopt;
+	return true;
+}
+
+/**
+ * Gets the patterns rewritten for the file's CCSID, compiling them the first
+ * time the CCSID is seen.
+ */
+const NativePatterns &pfgrep::get_native_patterns(const File &file)
+{
+	auto found = this->native_patterns.find(file.ccsid);
+	if (found != this->native_patterns.end()) {
+		return found->second;
 	}
-	return Match(line, line_size, line_no, std::move(substrings));
+	NativePatterns &native = this->native_patterns[file.ccsid];
+	if (this->base_tables == nullptr) {
+		return native;
+	}
+	native.tables = make_native_tables(this->base_tables, file.sbcs);
+	if (native.tables == nullptr) {
+		return native;
+	}
+	native.compile_context = pcre2_compile_context_copy(this->compile_context);
+	if (native.compile_context == nullptr) {
+		return native;
+	}
+	pcre2_set_character_tables(native.compile_context, native.tables);
+
+	std::string transcoded;
+	for (const auto& pattern_string : this->pattern_strings) {
+		if (!transcode_pattern(pattern_string, file.sbcs, this->fixed, transcoded)) {
+			return native;
+		}
+		int errornumber;
+		PCRE2_SIZE erroroffset;
+		pcre2_code *re = pcre2_compile((PCRE2_SPTR)transcoded.data(),
+				transcoded.size(),
+				get_compile_flags(),
+				&errornumber,
+				&erroroffset,
+				native.compile_context);
+		if (re == nullptr) {
+			return native;
+		}
+		native.patterns.emplace_back(pattern_string, re, jit_compile(re));
+		Pattern &pattern = native.patterns.back();
+		pattern.literal = make_literal(transcoded, native.tables);
+
+		const Pattern &converted = this->patterns[native.patterns.size() - 1];
+		std::string required;
+		if (!converted.required.empty()
+				&& transcode_pattern(converted.required, file.sbcs, true, required)) {
+			pattern.required = required;
+			pattern.required_caseless = converted.required_caseless;
+			pattern.prefilter = std::make_shared<LiteralMatcher>(required,
+				native.tables, pattern.required_caseless, false, false);
+		}
+	}
+	native.usable = true;
+	return native;
 }
 
 int pfgrep::do_action(File &file)
 {
-	int matches = 0, rc = 0;
-	int lineno = 0;
-	int last_printed_line = -1;
-	int current_after_lines = 0;
-	char *line = this->conv_buffer, *next = nullptr;
-	std::deque<Match> before_queue;
-	// If same CCSID, use read buffer, otherwise if EBCDIC/diff ASCII, conv
-	if (file.ccsid == this->pase_ccsid) {
-		line = this->read_buffer;
-	}
+	int rc = 0;
+	SearchState state;
+	Window window;
+	const std::vector<Pattern> *native = nullptr;
+
+	set_line_prefixes(file);
 
 	// For search descriptions (special behaviour where we match,
 	// but treat it as a non-line for i.e. context purposes)
@@ -371,7 +738,7 @@ int pfgrep::do_action(File &file)
 		}
 		optional<Match> match;
 		try {
-			match = try_patterns(file.description, desc_size, 0);
+			match = try_patterns(this->patterns, file.description, desc_size, 0);
 		} catch (PCRE2Error pcre2error) {
 			if (!this->silent) {
 				PCRE2_UCHAR buffer[256];
@@ -384,97 +751,60 @@ int pfgrep::do_action(File &file)
 		bool matched = match != nullopt;
 		if ((matched && !this->invert) || (!matched && this->invert)) {
 			const bool has_context_lines = this->after_lines || before_lines;
-			if (has_context_lines && this->has_printed) {
-				print_separator();
-			}
-			this->has_printed |= print_line(file, *match);
-			last_printed_line = 0;
-			matches = 1;
-		}
-	}
-
-	while (line && *line) {
-		bool matched = false;
-		lineno++;
-		// Handle CRLF newlines (could be better)
-		size_t conv_size = 0;
-		next = strpbrk(line, "\r\n");
-		if (next) {
-			conv_size = (size_t)(next - line);
-			if (next[0] == '\r') {
-				next++;
-			}
-			next++;
-		} else {
-			conv_size = strlen(line);
+			// Whether an earlier file printed is decided at commit
+			this->output_wants_separator = has_context_lines;
+			this->output_printed |= print_line(*match);
+			state.last_printed_line = 0;
+			state.matches = 1;
 		}
+	}
 
-		optional<Match> match;
-		try {
-			match = try_patterns(line, conv_size, lineno);
-		} catch (PCRE2Error pcre2error) {
-			if (!this->silent) {
-				PCRE2_UCHAR buffer[256];
-				pcre2_get_error_message(rc, buffer, sizeof(buffer));
-				fmt::print(stderr, "failed match error: {} ({})", (const char*)buffer, pcre2error.rc);
-			}
-			goto fail;
+	// Single byte members can be searched without converting them
+	if (this->native_search && file.record_length > 0 && file.sbcs != nullptr
+			&& file.format == nullptr) {
+		const NativePatterns &native_patterns = get_native_patterns(file);
+		if (native_patterns.usable) {
+			native = &native_patterns.patterns;
 		}
+	}
 
-		matched = match != nullopt;
-		if ((matched && !this->invert) || (!matched && this->invert)) {
-			matches++;
-			current_after_lines = this->after_lines;
-
-			const bool has_context_lines = this->after_lines || before_lines;
-			const bool separator_for_file = this->has_printed && last_printed_line <= 0;
-			const bool separator_for_group = last_printed_line >= 0 && (last_printed_line < lineno - 1);
-			if (has_context_lines && (separator_for_file || separator_for_group)) {
-				print_separator();
+	if (native != nullptr) {
+		state.lines_are_scratch = true;
+		while ((rc = next_raw_records(file, window)) > 0) {
+			if (!search_records(file, window, state, *native)) {
+				break;
 			}
-			last_printed_line = lineno;
-			// Drain the queue of before items
-			for (const auto& queued_match : before_queue) {
-				print_line(file, queued_match);
-			}
-			before_queue.clear();
-
-			if (matched) {
-				this->has_printed |= print_line(file, *match);
-				// Early return if we just need one match
-				// (the case for -q and -l flags)
-				if (this->mode == ModeQuiet || this->mode == ModeMatchingFilenames) {
-					break;
-				}
-			} else {
-				this->has_printed |= print_line(file, Match(line, conv_size, lineno, false));
+			flush_output();
+		}
+	} else {
+		while ((rc = next_window(file, window)) > 0) {
+			if (!search_window(window, state)) {
+				break;
 			}
-		} else if (current_after_lines-- > 0) {
-			last_printed_line = lineno;
-			print_line(file, {line, conv_size, lineno, true});
-		} else if (this->before_lines) {
-			// Push into the queue; make sure we don't go over
-			before_queue.emplace_back(line, conv_size, lineno, true);
-			if (before_queue.size() > this->before_lines) {
-				before_queue.pop_front();
+			flush_output();
+			// The next window reuses the buffer the queued lines point into
+			for (auto& queued_match : state.before_queue) {
+				queued_match.own();
 			}
 		}
-
-		if (this->max_matches > 0 && matches >= this->max_matches) {
-			break;
-		}
-
-		line = next;
+	}
+	if (rc < 0) {
+		// Error printed by next_window; don't leave half a file behind,
+		// at least of what hasn't been written already
+		this->output.clear();
+		this->output_printed = false;
+		this->output_wants_separator = false;
+		return -1;
 	}
 fail:
-	if (matches == 0 && this->mode == ModeNonmatchingFilenames) {
+	if (state.matches == 0 && this->mode == ModeNonmatchingFilenames) {
 		print_filename(file.full_filename, -1);
-	} else if (matches > 0 && this->mode == ModeMatchingFilenames) {
+	} else if (state.matches > 0 && this->mode == ModeMatchingFilenames) {
 		print_filename(file.full_filename, -1);
 	} else if (this->mode == ModeLineCount) {
-		print_filename(file.full_filename, matches);
+		print_filename(file.full_filename, state.matches);
 	}
-	return matches;
+	return state.matches;
 }
 
 bool pfgrep::compile_pattern(const std::string &expr)
@@ -505,6 +835,137 @@ bool pfgrep::compile_pattern(const std::string &expr)
 		this->biggest_capture_count = capture_count;
 	}
 
+	this->patterns.emplace_back(expr, re, jit_compile(re));
+	this->patterns.back().literal = make_literal(expr, this->base_tables);
+	find_required(this->patterns.back());
+	compile_buffer_pattern(this->patterns.back());
+	return true;
+}
+
+/**
+ * Compiles the pattern again to be run over a whole window of lines at
+ * once, if that can find every line it would match on its own. Lines are
+ * split on CR, LF, or both, so that's what ^ and $ need to see as newlines.
+ */
+void pfgrep::compile_buffer_pattern(Pattern &pattern)
+{
+	if (this->fixed || !matches_within_lines(pattern.expr)) {
+		return; // fixed strings are found with their literal
+	}
+	if (this->buffer_compile_context == nullptr) {
+		this->buffer_compile_context = pcre2_compile_context_copy(this->compile_context);
+		if (this->buffer_compile_context == nullptr) {
+			return;
+		}
+		pcre2_set_newline(this->buffer_compile_context, PCRE2_NEWLINE_ANYCRLF);
+	}
+	int errornumber;
+	PCRE2_SIZE erroroffset;
+	pattern.buffer_re = pcre2_compile((PCRE2_SPTR)pattern.expr.c_str(),
+			PCRE2_ZERO_TERMINATED,
+			get_compile_flags() | PCRE2_MULTILINE,
+			&errornumber,
+			&erroroffset,
+			this->buffer_compile_context);
+	if (pattern.buffer_re != nullptr) {
+		pattern.buffer_can_jit = jit_compile(pattern.buffer_re);
+	}
+}
+
+/**
+ * Loads the index pfindex made and works out which files in it could match
+ * any pattern, from the literals they need. Files that aren't in it, or have
+ * changed since, are searched as usual. Inverted matches and descriptions
+ * aren't in the text that's indexed, so it isn't used for those.
+ */
+void pfgrep::load_index()
+{
+	if (this->invert || this->search_descriptions) {
+		return;
+	}
+	auto index = std::make_shared<TrigramIndex>();
+	if (!index->load(this->index_path, false)) {
+		if (!this->silent) {
+			std::string msg = fmt::format("loading index {}", this->index_path);
+			perror(msg.c_str());
+		}
+		return;
+	}
+	std::vector<std::vector<uint32_t>> queries;
+	for (const auto& pattern : this->patterns) {
+		// Without a literal, any file could match
+		if (pattern.required.empty()) {
+			return;
+		}
+		queries.push_back(literal_trigrams(pattern.required, pattern.required_caseless));
+	}
+	this->index_candidates = std::make_shared<std::vector<bool>>(index->candidates(queries));
+	this->index = index;
+}
+
+/**
+ * Files the index says can't match aren't opened at all. There's nothing to
+ * print for them but the filename with -L and -c, which do_action would have.
+ */
+bool pfgrep::rule_out(const File &file)
+{
+	if (!this->index) {
+		return false;
+	}
+	int id = this->index->find_current(file.full_filename, file.mtime, file.file_size);
+	if (id == -1 || (*this->index_candidates)[id]) {
+		return false;
+	}
+	count_skip(SkipIndex);
+	if (this->mode == ModeNonmatchingFilenames) {
+		print_filename(file.full_filename, -1);
+	} else if (this->mode == ModeLineCount) {
+		print_filename(file.full_filename, 0);
+	}
+	return true;
+}
+
+/**
+ * Works out a literal every match of the pattern has to contain, so lines
+ * without it can be skipped without running the pattern.
+ */
+void pfgrep::find_required(Pattern &pattern)
+{
+	bool caseless = this->case_insensitive;
+	std::string required;
+	if (this->fixed) {
+		required = pattern.expr;
+	} else {
+		required = required_literal(pattern.expr, caseless);
+	}
+	if (required.empty() && !this->fixed) {
+		// PCRE2 might still know a single code unit every match has
+		uint32_t type = 0, unit = 0;
+		if (pcre2_pattern_info(pattern.re, PCRE2_INFO_LASTCODETYPE, &type) == 0 && type == 1) {
+			pcre2_pattern_info(pattern.re, PCRE2_INFO_LASTCODEUNIT, &unit);
+		} else if (pcre2_pattern_info(pattern.re, PCRE2_INFO_FIRSTCODETYPE, &type) == 0 && type == 1) {
+			pcre2_pattern_info(pattern.re, PCRE2_INFO_FIRSTCODEUNIT, &unit);
+		} else {
+			type = 0;
+		}
+		if (type == 1 && unit != '\r' && unit != '\n') {
+			required.push_back((char)unit);
+		}
+	}
+	if (required.empty() || this->base_tables == nullptr) {
+		return;
+	}
+	pattern.required = required;
+	pattern.required_caseless = caseless;
+	pattern.prefilter = std::make_shared<LiteralMatcher>(required, this->base_tables,
+		caseless, false, false);
+}
+
+/**
+ * JIT compiles a pattern if we can. Returns if the JIT can be used with it.
+ */
+bool pfgrep::jit_compile(pcre2_code *re)
+{
 	bool pattern_can_jit = false;
 	if (this->can_jit) {
 		size_t jit_size = 0;
@@ -514,9 +975,7 @@ bool pfgrep::compile_pattern(const std::string &expr)
 			pattern_can_jit = jit_size > 0;
 		}
 	}
-
-	this->patterns.emplace_back(expr, re, pattern_can_jit);
-	return true;
+	return pattern_can_jit;
 }
 
 bool pfgrep::add_patterns_from_file(const char *path)
@@ -561,6 +1020,17 @@ extern "C" void pfgrep_wrapped_free(void *ptr, void*)
 #endif
 }
 
+static const LongOption long_options[] = {
+	{"no-mmap", false, OptionNoMmap},
+	{"metadata-cache", true, OptionMetadataCache},
+	{"newer-than", true, OptionNewerThan},
+	{"older-than", true, OptionOlderThan},
+	{"no-native", false, OptionNoNative},
+	{"index", true, OptionIndex},
+	{"stats", false, OptionStats},
+	{nullptr, false, 0},
+};
+
 int main(int argc, char **argv)
 {
 	pfgrep state;
@@ -569,6 +1039,8 @@ int main(int argc, char **argv)
 	// memory efficient and don't alloc. But if we do change allocators in
 	// the future, make that easily possible.
 	state.general_context = pcre2_general_context_create(pfgrep_wrapped_malloc, pfgrep_wrapped_free, nullptr);
+	// We don't set a locale, so these are the same as the built-in tables
+	state.base_tables = pcre2_maketables(state.general_context);
 
 	// TODO: Decide to warn the user if JIT is disabled, or if JIT is on but
 	// the expression couldn't be compiled. For now, silently ignore errors.
@@ -577,8 +1049,35 @@ int main(int argc, char **argv)
 	state.can_jit = can_jit;
 
 	int ch;
-	while ((ch = getopt(argc, argv, "A:B:C:cde:Ff:HhLlim:nopqrstwVvx")) != -1) {
+	while ((ch = get_option(argc, argv, "A:B:C:cde:Ff:HhLlij:m:nopqrstwVvx", long_options)) != -1) {
 		switch (ch) {
+		case OptionNoMmap:
+			state.use_mmap = false;
+			break;
+		case OptionStats:
+			state.stats = std::make_shared<Stats>();
+			break;
+		case OptionMetadataCache:
+			state.open_metadata_cache(optarg);
+			break;
+		case OptionNewerThan:
+			if (!state.parse_time(optarg, state.newer_than)) {
+				return 3;
+			}
+			state.filter_newer = true;
+			break;
+		case OptionOlderThan:
+			if (!state.parse_time(optarg, state.older_than)) {
+				return 3;
+			}
+			state.filter_older = true;
+			break;
+		case OptionNoNative:
+			state.native_search = false;
+			break;
+		case OptionIndex:
+			state.index_path = optarg;
+			break;
 		case 'A':
 			state.after_lines = atoi(optarg);
 			break;
@@ -621,6 +1120,9 @@ int main(int argc, char **argv)
 		case 'i':
 			state.case_insensitive = true;
 			break;
+		case 'j':
+			state.worker_count = parse_worker_count(optarg);
+			break;
 		case 'm':
 			state.max_matches = atoi(optarg);
 			break;
@@ -693,6 +1195,10 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (state.index_path != nullptr) {
+		state.load_index();
+	}
+
 	// One big match data that can handle all possible;
 	// uses capture count + 1 like pcre2_match_data_create_from_pattern
 	state.match_data = pcre2_match_data_create(state.biggest_capture_count + 1, state.general_context);
@@ -713,6 +1219,8 @@ int main(int argc, char **argv)
 			any_error = true;
 		}
 	}
+	state.finish_jobs(any_match, any_error);
+	state.print_stats("pfgrep");
 
 	return any_error ? 2 : (any_match ? 0 : 1);
 }
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <sys/errno.h>
+#include <unistd.h>
+
+#include "errc.h"
+}
+
+#include <fmt/format.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common.hxx"
+
+class pfindex : public pfbase {
+public:
+	int do_action(File &file) override;
+	pfbase *make_worker() const override;
+	void commit_job(Job &job) override;
+
+	/* The index as it was, which workers only read, and the new one */
+	std::shared_ptr<const TrigramIndex> previous;
+	TrigramIndex next;
+	/* What happened, for -v */
+	size_t files_unchanged = 0;
+	size_t files_indexed = 0;
+	bool verbose = false;
+};
+
+static void usage(char *argv0)
+{
+	fmt::print(stderr, "usage: {} [-j jobs] [-prsvV] [--no-mmap] [--metadata-cache file] [--stats] index_file files\n", argv0);
+}
+
+pfbase *pfindex::make_worker() const
+{
+	auto worker = new pfindex(*this);
+	worker->init_worker();
+	return worker;
+}
+
+/**
+ * Collects the trigrams of a file's text, unless the old index has the file
+ * as it is now. They're handed to commit_job in the output, like pfzip does
+ * with the text, since only one thread can add to the index.
+ */
+int pfindex::do_action(File &file)
+{
+	if (this->previous->find_current(file.full_filename, file.mtime, file.file_size) != -1) {
+		return 0;
+	}
+	TrigramCollector collector;
+	Window window;
+	int rc;
+	while ((rc = next_window(file, window)) > 0) {
+		collector.add(window.data, window.length);
+	}
+	if (rc < 0) {
+		return -1;
+	}
+	std::vector<uint32_t> trigrams = collector.finish();
+	this->output.assign((const char*)trigrams.data(), trigrams.size() * sizeof(uint32_t));
+	return 1;
+}
+
+void pfindex::commit_job(Job &job)
+{
+	const File &file = job.file;
+	if (job.result < 0) {
+		return; // left out, so it's searched like any other file
+	}
+	IndexEntry entry;
+	entry.key = file.full_filename;
+	entry.mtime = file.mtime;
+	entry.size = file.file_size;
+	if (job.result == 0) {
+		entry.trigrams = this->previous->find(entry.key)->trigrams;
+		this->files_unchanged++;
+	} else {
+		entry.trigrams.resize(job.output.size() / sizeof(uint32_t));
+		memcpy(entry.trigrams.data(), job.output.data(), job.output.size());
+		this->files_indexed++;
+		if (this->verbose) {
+			fmt::println(stderr, "{}", file.full_filename);
+		}
+	}
+	this->next.add(std::move(entry));
+	// Not written to stdout
+	job.output.clear();
+}
+
+static const LongOption long_options[] = {
+	{"no-mmap", false, OptionNoMmap},
+	{"metadata-cache", true, OptionMetadataCache},
+	{"stats", false, OptionStats},
+	{nullptr, false, 0},
+};
+
+int main(int argc, char **argv)
+{
+	auto state = pfindex();
+	// Padding is indexed too, so the index works whether pfgrep trims or not
+	state.dont_trim_ending_whitespace = true;
+
+	int ch;
+	while ((ch = get_option(argc, argv, "j:prsvV", long_options)) != -1) {
+		switch (ch) {
+		case OptionNoMmap:
+			state.use_mmap = false;
+			break;
+		case OptionStats:
+			state.stats = std::make_shared<Stats>();
+			break;
+		case OptionMetadataCache:
+			state.open_metadata_cache(optarg);
+			break;
+		case 'j':
+			state.worker_count = parse_worker_count(optarg);
+			break;
+		case 'p':
+			state.search_non_source_files = true;
+			break;
+		case 'r':
+			state.recurse = true;
+			break;
+		case 's':
+			state.silent = true;
+			break;
+		case 'v':
+			state.verbose = true;
+			break;
+		case 'V':
+			state.print_version("pfindex");
+			return 0;
+		default:
+			usage(argv[0]);
+			return 3;
+		}
+	}
+
+	if (optind + 1 >= argc) {
+		usage(argv[0]);
+		return 3;
+	}
+	const char *index_file = argv[optind++];
+	state.file_count = argc - optind;
+
+	// Start from scratch if there's no usable index yet
+	auto previous = std::make_shared<TrigramIndex>();
+	if (!previous->load(index_file, true)) {
+		if (errno != ENOENT && !state.silent) {
+			std::string msg = fmt::format("loading index {}; rebuilding it", index_file);
+			perror(msg.c_str());
+		}
+		*previous = TrigramIndex();
+	}
+	state.previous = previous;
+
+	bool any_match = false, any_error = false;
+	for (int i = optind; i < argc; i++) {
+		int ret = state.do_thing(argv[i], false);
+		if (ret > 0) {
+			any_match = true;
+		} else if (ret < 0) {
+			any_error = true;
+		}
+	}
+	state.finish_jobs(any_match, any_error);
+
+	// Files that weren't seen this time are dropped
+	bool saved;
+	{
+		StatsTimer timer(state.stats.get(), PhaseOutput);
+		saved = state.next.save(index_file);
+	}
+	state.print_stats("pfindex");
+	if (!saved) {
+		if (!state.silent) {
+			std::string msg = fmt::format("saving index {}", index_file);
+			perror(msg.c_str());
+		}
+		return 4;
+	}
+	if (state.verbose) {
+		fmt::println(stderr, "{} files indexed, {} unchanged", state.files_indexed,
+			state.files_unchanged);
+	}
+
+	return any_error ? 2 : 0;
+}
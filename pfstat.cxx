@@ -5,21 +5,33 @@
  */
 
 extern "C" {
+#include <unistd.h>
+
 #include "errc.h"
 }
 
-#include <fmt/base.h>
+#include <fmt/format.h>
+
+#include <iterator>
 
 #include "common.hxx"
 
 class pfstat : public pfbase {
 public:
 	int do_action(File &file) override;
+	pfbase *make_worker() const override;
 };
 
 static void usage(char *argv0)
 {
-	fmt::print(stderr, "usage: {} [-prV] files\n", argv0);
+	fmt::print(stderr, "usage: {} [-j jobs] [-prV] [--metadata-cache file] [--stats] [--newer-than time] [--older-than time] files\n", argv0);
+}
+
+pfbase *pfstat::make_worker() const
+{
+	auto worker = new pfstat(*this);
+	worker->init_worker();
+	return worker;
 }
 
 int pfstat::do_action(File &file)
@@ -32,7 +44,7 @@ int pfstat::do_action(File &file)
 		}
 		return -1;
 	}
-	fmt::println("{}\t{}\t{}\t{}\t{}\t{}",
+	fmt::format_to(std::back_inserter(this->output), "{}\t{}\t{}\t{}\t{}\t{}\n",
 		file.full_filename,
 		file.file_size,
 		file.source_type,
@@ -42,14 +54,43 @@ int pfstat::do_action(File &file)
 	return 0;
 }
 
+static const LongOption long_options[] = {
+	{"metadata-cache", true, OptionMetadataCache},
+	{"newer-than", true, OptionNewerThan},
+	{"older-than", true, OptionOlderThan},
+	{"stats", false, OptionStats},
+	{nullptr, false, 0},
+};
+
 int main(int argc, char **argv)
 {
 	auto state = pfstat();
 	state.dont_read_file = true;
 
 	int ch;
-	while ((ch = getopt(argc, argv, "prV")) != -1) {
+	while ((ch = get_option(argc, argv, "j:prV", long_options)) != -1) {
 		switch (ch) {
+		case OptionStats:
+			state.stats = std::make_shared<Stats>();
+			break;
+		case OptionMetadataCache:
+			state.open_metadata_cache(optarg);
+			break;
+		case OptionNewerThan:
+			if (!state.parse_time(optarg, state.newer_than)) {
+				return 3;
+			}
+			state.filter_newer = true;
+			break;
+		case OptionOlderThan:
+			if (!state.parse_time(optarg, state.older_than)) {
+				return 3;
+			}
+			state.filter_older = true;
+			break;
+		case 'j':
+			state.worker_count = parse_worker_count(optarg);
+			break;
 		case 'p':
 			state.search_non_source_files = true;
 			break;
@@ -75,6 +116,8 @@ int main(int argc, char **argv)
 			any_error = true;
 		}
 	}
+	state.finish_jobs(any_match, any_error);
+	state.print_stats("pfstat");
 
 	return any_error ? 2 : (any_match ? 0 : 1);
 }
@@ -5,7 +5,13 @@
  */
 
 extern "C" {
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <zip.h>
+#include <zlib.h>
 
 #include "errc.h"
 }
@@ -13,33 +19,91 @@ extern "C" {
 #include <fmt/format.h>
 
 #include <cstring>
+#include <memory>
 #include <string>
 
 #include "common.hxx"
 
+enum ArchiveFormat {
+	FormatDefault,
+	FormatZip,
+	FormatTar,
+	FormatTarGz,
+};
+
 class pfzip : public pfbase {
 public:
+	~pfzip();
 	int do_action(File &file) override;
+	pfbase *make_worker() const override;
+	void commit_job(Job &job) override;
 	void print_version(const char *tool_name);
+	bool open_spool();
 
 	/* Archive */
 	zip_t *archive;
+	/* Entries waiting for zip_close, so they don't all stay in memory */
+	int spool_fd = -1;
+	off_t spool_size = 0;
+	/* Or the archive being written as it goes, instead of with libzip */
+	std::shared_ptr<ArchiveWriter> writer;
+	bool writer_failed = false;
 	/* Archive options */
 	bool overwrite : 1;
 	bool dont_replace_extension : 1;
+	ArchiveFormat format = FormatDefault;
+	bool compress_entries = true;
+	zip_int32_t compression_method = ZIP_CM_DEFLATE;
+	int compression_level = 0; // the method's default
+	bool compression_given = false;
 private:
 	std::string normalize_path(const File &file);
+	std::string make_comment(const File &file);
+	void write_entry(Job &job);
+	bool compress(const std::string &input);
+	/* Text of the file being compressed, and the stream doing it */
+	std::string text;
+	z_stream *deflater = nullptr;
 };
 
+pfzip::~pfzip()
+{
+	if (this->deflater != nullptr) {
+		deflateEnd(this->deflater);
+		delete this->deflater;
+	}
+	if (this->spool_fd != -1 && !this->is_worker) {
+		close(this->spool_fd);
+	}
+}
+
+/**
+ * Makes the file entries are written to as they're added, and read back from
+ * by zip_close. It's gone as soon as it's made, so it goes away when we do.
+ */
+bool pfzip::open_spool()
+{
+	const char *tmpdir = getenv("TMPDIR");
+	std::string path = fmt::format("{}/pfzip.XXXXXX",
+		tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp");
+	this->spool_fd = mkstemp(&path[0]);
+	if (this->spool_fd == -1) {
+		return false;
+	}
+	unlink(path.c_str());
+	return true;
+}
+
 void pfzip::print_version(const char *tool_name)
 {
 	pfbase::print_version(tool_name);
 	fmt::print(stderr, "\tusing libzip {}\n", zip_libzip_version());
+	fmt::print(stderr, "\tusing zlib {}\n", zlibVersion());
 }
 
 static void usage(char *argv0)
 {
-	fmt::print(stderr, "usage: {} [-EprstWV] output_file.zip files\n", argv0);
+	fmt::print(stderr, "usage: {} [-j jobs] [-EprstWV] [-Z method[:level]] [--format zip|tar|tgz] [--no-mmap] [--metadata-cache file] [--stats] [--newer-than time] [--older-than time] output_file.zip|- files\n", argv0);
 }
 
 /**
@@ -74,51 +138,273 @@ std::string pfzip::normalize_path(const File &file)
 	return new_path;
 }
 
+pfbase *pfzip::make_worker() const
+{
+	auto worker = new pfzip(*this);
+	worker->init_worker();
+	worker->text.clear();
+	worker->deflater = nullptr;
+	return worker;
+}
+
+/**
+ * Deflates input into the output, like libzip would, so the work is done on
+ * the worker instead of all at once in zip_close. Returns false if it can't
+ * be or wouldn't be any smaller, in which case it's stored as is.
+ */
+bool pfzip::compress(const std::string &input)
+{
+	if (this->deflater == nullptr) {
+		this->deflater = new z_stream();
+		// Negative window bits for raw deflate, without a zlib header
+		int level = this->compression_level == 0 ? Z_DEFAULT_COMPRESSION : this->compression_level;
+		if (deflateInit2(this->deflater, level, Z_DEFLATED,
+				-MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			delete this->deflater;
+			this->deflater = nullptr;
+			return false;
+		}
+	} else if (deflateReset(this->deflater) != Z_OK) {
+		return false;
+	}
+	this->output.resize(deflateBound(this->deflater, input.size()));
+	ptrdiff_t length = deflate_all(this->deflater, input.data(), input.size(),
+		&this->output[0], this->output.size());
+	if (length < 0 || (size_t)length >= input.size()) {
+		return false;
+	}
+	this->output.resize(length);
+	return true;
+}
+
+/**
+ * Converting and compressing happen on the worker; keep the result for when
+ * it's our turn to add to the archive, since libzip can only be used from one
+ * thread. The archive ends up in the same order no matter who finishes first.
+ */
 int pfzip::do_action(File &file)
 {
-	zip_int64_t index = -1;
-	int nonfatal_ret;
-	const char *buf = this->conv_buffer;
-	if (file.record_length == 0 && file.ccsid == this->pase_ccsid) {
-		buf = this->read_buffer;
-	}
-	size_t len = strlen(buf);
-	// we must keep a copy around until zip_close, and we reread the buffer
-	// therefore make a copy (NBD) and tell libzip to free (last parm)
-	char *buf_copy = strdup(buf);
-	zip_source_t *s = zip_source_buffer(this->archive, buf_copy, len, 1);
-	if (s == NULL && !this->silent) {
-		fmt::print(stderr, "zip_source_buffer({}): {}\n",
-			file.full_filename,
-			zip_strerror(this->archive));
+	Window window;
+	int rc;
+	this->text.clear();
+	while ((rc = next_window(file, window)) > 0) {
+		this->text.append(window.data, window.length);
+	}
+	if (rc < 0) {
 		return -1;
 	}
+	// crc32 takes 32-bit lengths; this one doesn't cut off big entries
+	this->output_crc = crc32_z(crc32_z(0, Z_NULL, 0), (const Bytef*)this->text.data(), this->text.size());
+	this->output_uncompressed_size = this->text.size();
+	this->output_compressed = this->compress_entries && compress(this->text);
+	if (!this->output_compressed) {
+		this->output.swap(this->text);
+	}
+	return 1;
+}
 
-	auto path = normalize_path(file);
-	index = zip_file_add(this->archive, path.c_str(), s, 0);
-	if (index == -1 && !this->silent) {
-		fmt::println(stderr, "zip_file_add({}): {}",
-			file.full_filename,
-			zip_strerror(this->archive));
-		zip_source_free(s);
+/**
+ * An entry in the spool. If it was deflated already, libzip copies it into
+ * the archive as is, since its stat says so.
+ */
+typedef struct pfzip_spooled {
+	int fd;
+	off_t start;
+	zip_uint64_t length;
+	zip_uint64_t offset;
+	zip_uint64_t uncompressed_size;
+	zip_uint32_t crc;
+	bool compressed;
+	zip_error_t error;
+} Spooled;
+
+static zip_int64_t spooled_callback(void *userdata, void *data, zip_uint64_t len, zip_source_cmd_t cmd)
+{
+	Spooled *spooled = (Spooled*)userdata;
+	switch (cmd) {
+	case ZIP_SOURCE_OPEN:
+		spooled->offset = 0;
+		return 0;
+	case ZIP_SOURCE_READ: {
+		zip_uint64_t left = spooled->length - spooled->offset;
+		if (len > left) {
+			len = left;
+		}
+		ssize_t bytes_read = pread(spooled->fd, data, len, spooled->start + spooled->offset);
+		if (bytes_read < 0 || (len > 0 && bytes_read == 0)) {
+			zip_error_set(&spooled->error, ZIP_ER_READ, errno);
+			return -1;
+		}
+		spooled->offset += bytes_read;
+		return bytes_read;
+	}
+	case ZIP_SOURCE_CLOSE:
+		return 0;
+	case ZIP_SOURCE_STAT: {
+		zip_stat_t *st = (zip_stat_t*)data;
+		zip_stat_init(st);
+		st->size = spooled->uncompressed_size;
+		st->comp_size = spooled->length;
+		st->comp_method = spooled->compressed ? ZIP_CM_DEFLATE : ZIP_CM_STORE;
+		st->crc = spooled->crc;
+		st->valid |= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+		return sizeof(*st);
+	}
+	case ZIP_SOURCE_ERROR:
+		return zip_error_to_data(&spooled->error, data, len);
+	case ZIP_SOURCE_FREE:
+		zip_error_fini(&spooled->error);
+		delete spooled;
+		return 0;
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ,
+			ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE,
+			(zip_source_cmd_t)-1);
+	default:
+		zip_error_set(&spooled->error, ZIP_ER_OPNOTSUPP, 0);
 		return -1;
 	}
+}
+
+static bool write_all(int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		length -= written;
+	}
+	return true;
+}
 
-	// Put the member description as a comment.
-	// The other metdata is there too; may not be best place for it
-	std::string comment;
+/**
+ * Put the member description as a comment.
+ * The other metdata is there too; may not be best place for it
+ */
+std::string pfzip::make_comment(const File &file)
+{
 	if (file.record_length == 0) {
-		comment = fmt::format("(original streamfile CCSID {})", file.ccsid);
+		return fmt::format("(original streamfile CCSID {})", file.ccsid);
 	} else if (*file.description) {
-		comment = fmt::format("{} (original PF record length {} CCSID {})",
+		return fmt::format("{} (original PF record length {} CCSID {})",
 			file.description,
 			file.record_length,
 			file.ccsid);
 	} else {
-		comment = fmt::format("(original PF record length {} CCSID {})",
+		return fmt::format("(original PF record length {} CCSID {})",
 			file.record_length,
 			file.ccsid);
 	}
+}
+
+/**
+ * Writes the file out to the archive right away when streaming. Once a write
+ * fails, the rest would too, so only say so once.
+ */
+void pfzip::write_entry(Job &job)
+{
+	File &file = job.file;
+	if (this->writer_failed) {
+		job.result = -1;
+		return;
+	}
+	ArchiveEntry entry;
+	entry.path = normalize_path(file);
+	entry.comment = make_comment(file);
+	entry.mtime = file.mtime;
+	entry.data = &job.output;
+	entry.compressed = job.compressed;
+	entry.crc = job.crc;
+	entry.uncompressed_size = job.uncompressed_size;
+	if (!this->writer->add(entry)) {
+		if (!this->silent) {
+			std::string msg = fmt::format("write({})", file.full_filename);
+			perror(msg.c_str());
+		}
+		this->writer_failed = true;
+		job.result = -1;
+	}
+	std::string().swap(job.output);
+}
+
+void pfzip::commit_job(Job &job)
+{
+	File &file = job.file;
+	zip_int64_t index = -1;
+	int nonfatal_ret;
+	if (job.result < 0) {
+		return;
+	}
+	if (this->writer) {
+		write_entry(job);
+		return;
+	}
+	// libzip doesn't read the data until zip_close, so rather than keep every
+	// file in memory until then, write it to the spool and let it go now
+	if (!write_all(this->spool_fd, job.output.data(), job.output.size())) {
+		if (!this->silent) {
+			std::string msg = fmt::format("write({})", file.full_filename);
+			perror(msg.c_str());
+		}
+		job.result = -1;
+		return;
+	}
+	Spooled *spooled = new Spooled();
+	spooled->fd = this->spool_fd;
+	spooled->start = this->spool_size;
+	spooled->length = job.output.size();
+	spooled->uncompressed_size = job.uncompressed_size;
+	spooled->crc = job.crc;
+	spooled->compressed = job.compressed;
+	zip_error_init(&spooled->error);
+	this->spool_size += job.output.size();
+	std::string().swap(job.output);
+
+	zip_source_t *s = zip_source_function(this->archive, spooled_callback, spooled);
+	if (s == NULL) {
+		if (!this->silent) {
+			fmt::println(stderr, "zip_source_function({}): {}",
+				file.full_filename,
+				zip_strerror(this->archive));
+		}
+		zip_error_fini(&spooled->error);
+		delete spooled;
+		job.result = -1;
+		return;
+	}
+
+	auto path = normalize_path(file);
+	index = zip_file_add(this->archive, path.c_str(), s, 0);
+	if (index == -1) {
+		if (!this->silent) {
+			fmt::println(stderr, "zip_file_add({}): {}",
+				file.full_filename,
+				zip_strerror(this->archive));
+		}
+		zip_source_free(s);
+		job.result = -1;
+		return;
+	}
+	// Deflated files are as they should be already. The rest are stored,
+	// if they didn't get any smaller deflated, or left to zip_close to
+	// compress with a method we don't do ourselves.
+	if (!job.compressed) {
+		zip_int32_t method = this->compression_method == ZIP_CM_DEFLATE
+			? ZIP_CM_STORE
+			: this->compression_method;
+		nonfatal_ret = zip_set_file_compression(this->archive, index, method, this->compression_level);
+		if (nonfatal_ret && !this->silent) {
+			fmt::println(stderr, "zip_set_file_compression: Can't set compression method for {}",
+				file.full_filename);
+		}
+	}
+
+	std::string comment = make_comment(file);
 	// not critical if these fail, but do warn
 	nonfatal_ret = zip_file_set_comment(this->archive, index, comment.c_str(), comment.size(), 0);
 	if (nonfatal_ret && !this->silent) {
@@ -131,7 +417,121 @@ int pfzip::do_action(File &file)
 			file.mtime,
 			file.full_filename);
 	}
-	return 1;
+}
+
+static const LongOption long_options[] = {
+	{"no-mmap", false, OptionNoMmap},
+	{"metadata-cache", true, OptionMetadataCache},
+	{"newer-than", true, OptionNewerThan},
+	{"older-than", true, OptionOlderThan},
+	{"format", true, OptionFormat},
+	{"stats", false, OptionStats},
+	{nullptr, false, 0},
+};
+
+static const struct {
+	const char *name;
+	zip_int32_t method;
+	int max_level;
+} compression_methods[] = {
+	{"store", ZIP_CM_STORE, 0},
+	{"deflate", ZIP_CM_DEFLATE, 9},
+	{"bzip2", ZIP_CM_BZIP2, 9},
+	{"xz", ZIP_CM_XZ, 9},
+#ifdef ZIP_CM_ZSTD
+	{"zstd", ZIP_CM_ZSTD, 22},
+#endif
+};
+
+/**
+ * Parses a compression method, optionally followed by a colon and a level
+ * (i.e. "deflate:1"), for the files in the archive.
+ */
+static bool parse_compression(const char *argv0, const char *arg, pfzip &state)
+{
+	const char *colon = strchr(arg, ':');
+	size_t name_length = colon != nullptr ? (size_t)(colon - arg) : strlen(arg);
+	for (const auto &m : compression_methods) {
+		if (strlen(m.name) != name_length || strncmp(arg, m.name, name_length) != 0) {
+			continue;
+		}
+		int level = 0;
+		if (colon != nullptr) {
+			char *end;
+			level = strtol(colon + 1, &end, 10);
+			if (*end != '\0' || colon[1] == '\0' || level < 1 || level > m.max_level) {
+				if (m.max_level == 0) {
+					fmt::println(stderr, "{}: {} doesn't take a level", argv0, m.name);
+				} else {
+					fmt::println(stderr, "{}: level for {} must be 1 to {}", argv0, m.name, m.max_level);
+				}
+				return false;
+			}
+		}
+		if (!zip_compression_method_supported(m.method, 1)) {
+			fmt::println(stderr, "{}: libzip doesn't support {}", argv0, m.name);
+			return false;
+		}
+		state.compression_method = m.method;
+		state.compression_level = level;
+		state.compression_given = true;
+		return true;
+	}
+	fmt::println(stderr, "{}: unknown compression method {}", argv0, arg);
+	return false;
+}
+
+static bool ends_with(const std::string &s, const char *suffix)
+{
+	size_t length = strlen(suffix);
+	return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+}
+
+static ArchiveFormat parse_format(const char *arg)
+{
+	if (strcmp(arg, "zip") == 0) {
+		return FormatZip;
+	} else if (strcmp(arg, "tar") == 0) {
+		return FormatTar;
+	} else if (strcmp(arg, "tgz") == 0 || strcmp(arg, "tar.gz") == 0) {
+		return FormatTarGz;
+	}
+	return FormatDefault;
+}
+
+/**
+ * Opens where the archive is written to as it goes, which is standard output
+ * for "-". Pipes and such are opened as they are; a file is only replaced with
+ * -W, since unlike a zip file, there's no adding to it.
+ */
+static int open_stream(const pfzip &state, const char *output_file)
+{
+	if (strcmp(output_file, "-") == 0) {
+		if (isatty(STDOUT_FILENO)) {
+			if (!state.silent) {
+				fmt::println(stderr, "won't write an archive to a terminal");
+			}
+			return -1;
+		}
+		return STDOUT_FILENO;
+	}
+	struct stat s;
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	if (stat(output_file, &s) == 0) {
+		if (!S_ISREG(s.st_mode)) {
+			flags = O_WRONLY;
+		} else if (!state.overwrite) {
+			if (!state.silent) {
+				fmt::println(stderr, "{}: already exists; use -W to replace it", output_file);
+			}
+			return -1;
+		}
+	}
+	int fd = open(output_file, flags, 0666);
+	if (fd == -1 && !state.silent) {
+		perror(output_file);
+	}
+	return fd;
 }
 
 int main(int argc, char **argv)
@@ -139,11 +539,47 @@ int main(int argc, char **argv)
 	auto state = pfzip();
 
 	int ch;
-	while ((ch = getopt(argc, argv, "EprstWV")) != -1) {
+	while ((ch = get_option(argc, argv, "Ej:prstWVZ:", long_options)) != -1) {
 		switch (ch) {
+		case OptionNoMmap:
+			state.use_mmap = false;
+			break;
+		case OptionStats:
+			state.stats = std::make_shared<Stats>();
+			break;
+		case OptionMetadataCache:
+			state.open_metadata_cache(optarg);
+			break;
+		case OptionNewerThan:
+			if (!state.parse_time(optarg, state.newer_than)) {
+				return 3;
+			}
+			state.filter_newer = true;
+			break;
+		case OptionOlderThan:
+			if (!state.parse_time(optarg, state.older_than)) {
+				return 3;
+			}
+			state.filter_older = true;
+			break;
+		case OptionFormat:
+			state.format = parse_format(optarg);
+			if (state.format == FormatDefault) {
+				fmt::println(stderr, "{}: unknown archive format {}", argv[0], optarg);
+				return 3;
+			}
+			break;
+		case 'Z':
+			if (!parse_compression(argv[0], optarg, state)) {
+				return 3;
+			}
+			break;
 		case 'E':
 			state.dont_replace_extension = true;
 			break;
+		case 'j':
+			state.worker_count = parse_worker_count(optarg);
+			break;
 		case 'p':
 			state.search_non_source_files = true;
 			break;
@@ -179,19 +615,80 @@ int main(int argc, char **argv)
 		return 5;
 	}
 
-	int zerrno;
-	int open_flags = ZIP_CREATE;
-	if (state.overwrite) {
-		open_flags |= ZIP_TRUNCATE;
+	// Tar files and anything that can't be seeked are written as we go;
+	// only zip files go through libzip
+	std::string output_path(output_file);
+	if (state.format == FormatDefault) {
+		if (ends_with(output_path, ".tar")) {
+			state.format = FormatTar;
+		} else if (ends_with(output_path, ".tar.gz") || ends_with(output_path, ".tgz")) {
+			state.format = FormatTarGz;
+		} else {
+			state.format = FormatZip;
+		}
 	}
-	state.archive = zip_open(output_file, open_flags, &zerrno);
-	if (state.archive == NULL && !state.silent) {
-		zip_error_t error;
-		zip_error_init_with_code(&error, zerrno);
-		fmt::println(stderr, "zip_open: {}",
-        		zip_error_strerror(&error));
-		zip_error_fini(&error);
-		return 6;
+	struct stat output_stat;
+	bool streaming = state.format != FormatZip || output_path == "-"
+		|| (stat(output_file, &output_stat) == 0 && !S_ISREG(output_stat.st_mode));
+
+	// Only deflate is done on the workers; anything else is up to libzip
+	state.compress_entries = state.compression_method == ZIP_CM_DEFLATE;
+	state.archive = NULL;
+	if (streaming) {
+		if (state.compression_method != ZIP_CM_STORE
+				&& state.compression_method != ZIP_CM_DEFLATE) {
+			if (!state.silent) {
+				fmt::println(stderr, "{}: only store and deflate can be used when streaming", argv[0]);
+			}
+			return 3;
+		}
+		if (state.format == FormatTar && state.compression_given
+				&& state.compression_method == ZIP_CM_DEFLATE) {
+			if (!state.silent) {
+				fmt::println(stderr, "{}: a plain tar file can't be deflated; use tgz instead", argv[0]);
+			}
+			return 3;
+		}
+		int fd = open_stream(state, output_file);
+		if (fd == -1) {
+			return 6;
+		}
+		if (state.format == FormatZip) {
+			state.writer = std::make_shared<ZipStreamWriter>(fd);
+		} else {
+			int level = state.compression_method == ZIP_CM_STORE ? Z_NO_COMPRESSION
+				: state.compression_level == 0 ? Z_DEFAULT_COMPRESSION
+				: state.compression_level;
+			state.writer = std::make_shared<TarWriter>(fd,
+				state.format == FormatTarGz, level);
+		}
+		// A plain tar file has everything as is
+		if (state.format == FormatTar) {
+			state.compress_entries = false;
+		}
+	} else {
+		int zerrno;
+		int open_flags = ZIP_CREATE;
+		if (state.overwrite) {
+			open_flags |= ZIP_TRUNCATE;
+		}
+		state.archive = zip_open(output_file, open_flags, &zerrno);
+		if (state.archive == NULL && !state.silent) {
+			zip_error_t error;
+			zip_error_init_with_code(&error, zerrno);
+			fmt::println(stderr, "zip_open: {}",
+        			zip_error_strerror(&error));
+			zip_error_fini(&error);
+			return 6;
+		}
+
+		if (!state.open_spool()) {
+			if (!state.silent) {
+				perror("mkstemp");
+			}
+			zip_discard(state.archive);
+			return 6;
+		}
 	}
 
 	bool any_match = false, any_error = false;
@@ -203,11 +700,28 @@ int main(int argc, char **argv)
 			any_error = true;
 		}
 	}
+	state.finish_jobs(any_match, any_error);
 
-	if (zip_close(state.archive) == -1 && !state.silent) {
-		fmt::println(stderr, "zip_close: {}", zip_strerror(state.archive));
-		return 4;
+	int ret = any_error ? 2 : (any_match ? 0 : 1);
+	{
+		// libzip compresses anything the workers didn't when closing
+		StatsTimer timer(state.stats.get(), PhaseOutput);
+		if (state.writer) {
+			// A failed write was already reported
+			if (state.writer_failed) {
+				ret = 4;
+			} else if (!state.writer->finish()) {
+				if (!state.silent) {
+					perror(output_file);
+				}
+				ret = 4;
+			}
+		} else if (zip_close(state.archive) == -1 && !state.silent) {
+			fmt::println(stderr, "zip_close: {}", zip_strerror(state.archive));
+			ret = 4;
+		}
 	}
+	state.print_stats("pfzip");
 
-	return any_error ? 2 : (any_match ? 0 : 1);
+	return ret;
 }
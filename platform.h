@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * What the process is like, for the conversions: ibmi.cxx asks PASE and the
+ * job, host.cxx answers the same for anywhere else.
+ */
+
+/* The CCSID text is converted to, i.e. what the terminal wants */
+int platform_text_ccsid(void);
+/* For descriptions with no CCSID of their own */
+int platform_job_ccsid(void);
+/* The name iconv_open knows a CCSID by */
+const char *platform_ccsid_name(int ccsid);
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#ifdef _AIX
+#include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+}
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hxx"
+
+// How many files can be opened but not yet written out per worker. This
+// bounds open descriptors and the output held for files finished out of order.
+#define JOBS_IN_FLIGHT_PER_WORKER 16
+
+/**
+ * Each worker has its own queue; the traversal thread deals out files to them
+ * in turn, and a worker that runs out takes from the others. Both take from
+ * the front, since the oldest file is the one holding up the output.
+ */
+struct WorkerQueue {
+	std::mutex lock;
+	std::deque<Job*> jobs;
+};
+
+class pfpool {
+public:
+	pfpool(pfbase *owner, unsigned int worker_count);
+	void submit(const File &file, int file_count);
+	void submit_unread(const File &file, int file_count, std::string &output);
+	void finish(bool &any_match, bool &any_error);
+
+private:
+	void work(unsigned int index, pfbase *worker);
+	Job *next_job(unsigned int index);
+	Job *take_job(unsigned int index);
+	void complete(Job *job, pfbase *worker);
+	void commit_done(pfbase *committer);
+
+	pfbase *owner;
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	size_t next_queue = 0;
+	/* Workers sleep on this when all queues are empty */
+	std::mutex work_lock;
+	std::condition_variable work_cv;
+	size_t queued = 0;
+	bool shutting_down = false;
+	/* Jobs in traversal order, written out as the front finishes */
+	std::mutex commit_lock;
+	std::condition_variable commit_cv;
+	std::deque<Job*> in_flight;
+	size_t max_in_flight;
+	bool any_match = false;
+	bool any_error = false;
+};
+
+/**
+ * Copies a file, making sure the short filename refers to the new copy of
+ * the full filename instead of the old one.
+ */
+void copy_file(File &dest, const File &src)
+{
+	size_t short_offset = src.short_filename.data() - src.full_filename.c_str();
+	dest = src;
+	dest.short_filename = string_view(dest.full_filename.c_str() + short_offset);
+}
+
+pfpool::pfpool(pfbase *owner, unsigned int worker_count)
+{
+	this->owner = owner;
+	this->max_in_flight = worker_count * JOBS_IN_FLIGHT_PER_WORKER;
+	for (unsigned int i = 0; i < worker_count; i++) {
+		this->queues.emplace_back(new WorkerQueue());
+	}
+	// Copy the state before any threads start, since they'll read it
+	for (unsigned int i = 0; i < worker_count; i++) {
+		pfbase *worker = owner->make_worker();
+		this->threads.emplace_back(&pfpool::work, this, i, worker);
+	}
+}
+
+void pfpool::submit(const File &file, int file_count)
+{
+	Job *job = new Job();
+	copy_file(job->file, file);
+	job->file_count = file_count;
+
+	{
+		std::unique_lock<std::mutex> guard(this->commit_lock);
+		this->commit_cv.wait(guard, [this] {
+			return this->in_flight.size() < this->max_in_flight;
+		});
+		this->in_flight.push_back(job);
+	}
+
+	WorkerQueue &queue = *this->queues[this->next_queue];
+	this->next_queue = (this->next_queue + 1) % this->queues.size();
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.jobs.push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> guard(this->work_lock);
+		this->queued++;
+	}
+	this->work_cv.notify_one();
+}
+
+/**
+ * Puts the output for a file that wasn't read in line with the others. It's
+ * already done, so it's written out as soon as the files before it are.
+ */
+void pfpool::submit_unread(const File &file, int file_count, std::string &output)
+{
+	Job *job = new Job();
+	copy_file(job->file, file);
+	job->file_count = file_count;
+	job->output.swap(output);
+	job->done = true;
+
+	std::unique_lock<std::mutex> guard(this->commit_lock);
+	this->commit_cv.wait(guard, [this] {
+		return this->in_flight.size() < this->max_in_flight;
+	});
+	this->in_flight.push_back(job);
+	commit_done(this->owner);
+}
+
+/**
+ * Takes a job from this worker's queue, or failing that, another worker's.
+ */
+Job *pfpool::take_job(unsigned int index)
+{
+	size_t queue_count = this->queues.size();
+	for (size_t i = 0; i < queue_count; i++) {
+		WorkerQueue &queue = *this->queues[(index + i) % queue_count];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (!queue.jobs.empty()) {
+			Job *job = queue.jobs.front();
+			queue.jobs.pop_front();
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+Job *pfpool::next_job(unsigned int index)
+{
+	std::unique_lock<std::mutex> guard(this->work_lock);
+	this->work_cv.wait(guard, [this] {
+		return this->queued > 0 || this->shutting_down;
+	});
+	if (this->queued == 0) {
+		return nullptr; // shutting down with nothing left
+	}
+	// Claim one job now, so we're guaranteed to find one in some queue
+	this->queued--;
+	guard.unlock();
+	Job *job = nullptr;
+	while (job == nullptr) {
+		job = take_job(index);
+	}
+	return job;
+}
+
+/**
+ * Marks a job done, then writes out every job at the front that's done.
+ */
+void pfpool::complete(Job *job, pfbase *worker)
+{
+	std::lock_guard<std::mutex> guard(this->commit_lock);
+	job->done = true;
+	commit_done(worker);
+}
+
+/**
+ * Writes out every job at the front that's done, with the commit lock held.
+ * The writing is counted as the committer's, since it's on its thread.
+ */
+void pfpool::commit_done(pfbase *committer)
+{
+	while (!this->in_flight.empty() && this->in_flight.front()->done) {
+		Job *front = this->in_flight.front();
+		{
+			StatsTimer timer(committer->stats.get(), PhaseOutput);
+			this->owner->commit_job(*front);
+		}
+		if (front->result > 0) {
+			this->any_match = true;
+		} else if (front->result < 0) {
+			this->any_error = true;
+		}
+		this->in_flight.pop_front();
+		delete front;
+	}
+	this->commit_cv.notify_all();
+}
+
+void pfpool::work(unsigned int index, pfbase *worker)
+{
+	Job *job;
+	while ((job = next_job(index)) != nullptr) {
+		worker->run_job(*job);
+		complete(job, worker);
+	}
+	if (worker->stats) {
+		std::lock_guard<std::mutex> guard(this->commit_lock);
+		this->owner->stats->merge(*worker->stats);
+	}
+	delete worker;
+	// The iconv cache is per-thread, so it has to be cleaned up here
+	free_cached_iconv();
+}
+
+void pfpool::finish(bool &any_match, bool &any_error)
+{
+	{
+		std::lock_guard<std::mutex> guard(this->work_lock);
+		this->shutting_down = true;
+	}
+	this->work_cv.notify_all();
+	for (auto &thread : this->threads) {
+		thread.join();
+	}
+	any_match |= this->any_match;
+	any_error |= this->any_error;
+}
+
+pfpool *pool_create(pfbase *owner, unsigned int worker_count)
+{
+	return new pfpool(owner, worker_count);
+}
+
+void pool_submit(pfpool *pool, const File &file, int file_count)
+{
+	pool->submit(file, file_count);
+}
+
+void pool_submit_unread(pfpool *pool, const File &file, int file_count, std::string &output)
+{
+	pool->submit_unread(file, file_count, output);
+}
+
+void pool_finish(pfpool *pool, bool &any_match, bool &any_error)
+{
+	pool->finish(any_match, any_error);
+	delete pool;
+}
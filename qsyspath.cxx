@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string>
+#include <vector>
+
+#include "common.hxx"
+
+/*
+ * Splits canonical QSYS.LIB paths into names without asking the system, so
+ * this works (and can be tried out) anywhere. Anything it isn't sure about
+ * is left to Qp0lCvtPathToQSYSObjName, which knows about symlinks, IASPs,
+ * relative paths, and the rest.
+ */
+
+static inline char upper(char c)
+{
+	return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+static bool equals_caseless(const std::string &a, const char *b)
+{
+	size_t i = 0;
+	for (; i < a.size() && b[i] != '\0'; i++) {
+		if (upper(a[i]) != b[i]) {
+			return false;
+		}
+	}
+	return i == a.size() && b[i] == '\0';
+}
+
+/**
+ * Checks and normalizes one object name. Names not in quotes are upper cased,
+ * like the file system does; only characters that are the same in every
+ * CCSID are taken, since $, #, and @ aren't. Quoted names keep their quotes
+ * and case, like they do in QSYS.
+ */
+static bool parse_name(const std::string &text, std::string &name)
+{
+	if (text.empty() || text.size() > 10) {
+		return false;
+	}
+	name.clear();
+	if (text[0] == '"') {
+		if (text.size() < 3 || text.back() != '"') {
+			return false;
+		}
+		bool needs_quotes = !(text[1] >= 'A' && text[1] <= 'Z');
+		for (size_t i = 1; i + 1 < text.size(); i++) {
+			char c = text[i];
+			// These can't be in a quoted name, or aren't ASCII
+			if (c <= ' ' || c > '~' || c == '"' || c == '\'' || c == '*' || c == '?') {
+				return false;
+			}
+			if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.')) {
+				needs_quotes = true;
+			}
+		}
+		// The system drops quotes that aren't needed, so "ABC" is ABC
+		name = needs_quotes ? text : text.substr(1, text.size() - 2);
+		return true;
+	}
+	char first = upper(text[0]);
+	if (!(first >= 'A' && first <= 'Z')) {
+		return false;
+	}
+	for (char c : text) {
+		c = upper(c);
+		if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.')) {
+			return false;
+		}
+		name.push_back(c);
+	}
+	return true;
+}
+
+static bool has_type(const std::string &component, const char *type)
+{
+	size_t dot = component.rfind('.');
+	return dot != std::string::npos && equals_caseless(component.substr(dot + 1), type);
+}
+
+/**
+ * Splits a path component into its name and type (i.e. "ABC.MBR" into ABC
+ * and MBR). The type is after the last dot that isn't in quotes.
+ */
+static bool split_component(const std::string &component, std::string &name, std::string &type)
+{
+	size_t dot = component.rfind('.');
+	if (dot == std::string::npos || dot == 0) {
+		return false;
+	}
+	size_t quote = component.rfind('"');
+	if (quote != std::string::npos && quote > dot) {
+		return false;
+	}
+	name = component.substr(0, dot);
+	type = component.substr(dot + 1);
+	return true;
+}
+
+/**
+ * Parses a path like /QSYS.LIB/LIB.LIB/FILE.FILE/MBR.MBR into its object,
+ * library, and member names, still in the PASE CCSID. The library is QSYS if
+ * the file is right under QSYS.LIB, and the member is empty if the path is
+ * to a file. %LIBL% and %CURLIB% become *LIBL and *CURLIB. Returns false if
+ * the path should be resolved by the system instead.
+ */
+bool parse_qsys_path(const std::string &path, std::string &object, std::string &library, std::string &member)
+{
+	std::vector<std::string> components;
+	if (path.empty() || path[0] != '/') {
+		return false; // relative to wherever we are
+	}
+	size_t start = 1;
+	while (start <= path.size()) {
+		size_t slash = path.find('/', start);
+		if (slash == std::string::npos) {
+			slash = path.size();
+		}
+		std::string component = path.substr(start, slash - start);
+		if (component.empty() || component == "." || component == "..") {
+			return false;
+		}
+		components.push_back(std::move(component));
+		start = slash + 1;
+	}
+	if (components.size() < 2 || components.size() > 4 || !equals_caseless(components[0], "QSYS.LIB")) {
+		return false;
+	}
+
+	std::string name, type;
+	size_t next = 1;
+	library = "QSYS";
+	// /QSYS.LIB/FILE.FILE/MBR.MBR is a file in QSYS; otherwise a library is next
+	bool in_library = components.size() == 4
+		|| (components.size() == 3 && !has_type(components[2], "MBR"));
+	if (in_library) {
+		if (!split_component(components[next], name, type) || !equals_caseless(type, "LIB")) {
+			return false;
+		}
+		if (equals_caseless(name, "%LIBL%")) {
+			library = "*LIBL";
+		} else if (equals_caseless(name, "%CURLIB%")) {
+			library = "*CURLIB";
+		} else if (!parse_name(name, library)) {
+			return false;
+		}
+		next++;
+	}
+
+	if (!split_component(components[next], name, type) || !equals_caseless(type, "FILE")
+			|| !parse_name(name, object)) {
+		return false;
+	}
+	next++;
+
+	member.clear();
+	if (next < components.size()) {
+		if (!split_component(components[next], name, type) || !equals_caseless(type, "MBR")
+				|| !parse_name(name, member)) {
+			return false;
+		}
+		next++;
+	}
+	return next == components.size();
+}
@@ -24,6 +24,7 @@ extern "C" {
 using namespace pase_cpp;
 
 #include <map>
+#include <memory>
 #include <string>
 
 EbcdicFixedString<10> _FIRST("*FIRST");
@@ -31,8 +32,12 @@ EbcdicFixedString<10> _FILETYPE("*FILETYPE");
 EbcdicFixedString<10> _INT("*INT");
 
 static PGMFunction<char*, int, char*, const char*, const char*, const char*, const char, const char*, const char*, ERRC0100*> QDBRTVFD("QSYS", "QDBRTVFD", PGMCALL_EXCP_NOSIGNAL);
+static PGMFunction<const char*, const char*, const char*, const char, ERRC0100*> QUSLRCD("QSYS", "QUSLRCD", PGMCALL_EXCP_NOSIGNAL);
+static PGMFunction<const char*, const char*, const char*, const char*, const char, ERRC0100*> QUSLFLD("QSYS", "QUSLFLD", PGMCALL_EXCP_NOSIGNAL);
 
 static std::map<std::string, int> cached_record_sizes;
+// Files that don't need decoding are kept as nullptr
+static std::map<std::string, std::unique_ptr<RecordFormat>> cached_record_formats;
 
 /**
  * Gets information about a physical file. Returns the record length as a
@@ -98,3 +103,56 @@ extern "C" int get_pf_info(const File &file)
 
 	return ret;
 }
+
+/**
+ * Gets the fields of a non-source physical file, if its records need to be
+ * decoded a field at a time to be searched (i.e. they have packed numbers).
+ * Returns nullptr if the records can be converted whole, like before, or if
+ * the fields couldn't be listed.
+ */
+extern "C" const RecordFormat *get_record_format(const File &file)
+{
+	std::string filename(file.libobj, 20);
+	auto cached = cached_record_formats.find(filename);
+	if (cached != cached_record_formats.end()) {
+		return cached->second.get();
+	}
+	std::unique_ptr<RecordFormat> &format = cached_record_formats[filename];
+
+	const char *space = get_list_space();
+	if (space == nullptr) {
+		return nullptr;
+	}
+	ERRC0100 errc = {};
+	errc.bytes_avail = sizeof(ERRC0100);
+
+	// Physical files have a single record format; get its name
+	QUSLRCD(space, "RCDL0100"_e, filename.data(), '0'_e, &errc);
+	std::string entries;
+	size_t entry_size;
+	if (errc.exception_id[0] != '\0' || !read_list_space(entries, entry_size)
+			|| entries.size() < 10) {
+		return nullptr;
+	}
+	// Record format name (first field of RCDL0100)
+	std::string format_name = entries.substr(0, 10);
+
+	QUSLFLD(space, "FLDL0100"_e, filename.data(), format_name.data(), '0'_e, &errc);
+	if (errc.exception_id[0] != '\0' || !read_list_space(entries, entry_size)) {
+		return nullptr;
+	}
+	std::unique_ptr<RecordFormat> parsed(new RecordFormat());
+	if (!parse_field_list(entries, entry_size, *parsed)) {
+		return nullptr;
+	}
+	// Don't trust a list that doesn't fit the records we'll read
+	int record_length = get_pf_info(file);
+	record_length = record_length < 0 ? -record_length : record_length;
+	for (const auto& field : parsed->fields) {
+		if (field.offset + field.length > record_length) {
+			return nullptr;
+		}
+	}
+	format = std::move(parsed);
+	return format.get();
+}
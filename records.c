@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _AIX
+#include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+
+#include "sbcs.h"
+#include "records.h"
+
+/**
+ * Converts each record and puts a newline after it, trimming the padding
+ * first if asked, as source PFs are fixed length and space padded, so $
+ * works like expected. Single byte CCSIDs use the table, so only the text
+ * gets converted; the rest go through iconv, and need out to have room for
+ * the worst case of UTF-8 from each byte. Returns how long the text is, or
+ * -1 if iconv failed.
+ */
+ptrdiff_t records_convert(const SbcsTable *sbcs, iconv_t conv, const char *records,
+	size_t record_count, size_t record_length, bool trim, char *out, size_t out_size)
+{
+	char *start = out;
+	size_t outleft = out_size;
+	for (size_t record_num = 0; record_num < record_count; record_num++) {
+		const char *record = records + (record_num * record_length);
+		if (sbcs != NULL) {
+			size_t converted = sbcs_convert_record(sbcs, record, record_length, out, trim);
+			out += converted;
+			outleft -= converted;
+			continue;
+		}
+		char *in = (char*)record;
+		char *beginning = out;
+		size_t inleft = record_length;
+		if (iconv(conv, &in, &inleft, &out, &outleft) != 0) {
+			return -1;
+		}
+		if (trim) {
+			while (out > beginning && *(out - 1) == ' ') {
+				out--;
+				outleft++;
+			}
+		}
+		*out++ = '\n';
+		outleft--;
+	}
+	return out - start;
+}
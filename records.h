@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Fixed length records into lines, converted to the PASE CCSID. Doesn't
+ * need anything from the system, so it can be benchmarked anywhere.
+ */
+ptrdiff_t records_convert(const SbcsTable *sbcs, iconv_t conv, const char *records,
+	size_t record_count, size_t record_length, bool trim, char *out, size_t out_size);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _AIX
+#include </QOpenSys/usr/include/iconv.h>
+#else
+#include <iconv.h>
+#endif
+
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+#include "sbcs.h"
+
+/**
+ * Builds a lookup table by converting every byte on its own. If any byte
+ * fails to convert, converts to nothing (i.e. a shift character), or needs
+ * the byte after it (a DBCS lead byte), then the CCSID isn't single byte and
+ * iconv has to be used. Returns NULL in that case.
+ */
+SbcsTable *sbcs_table_build(iconv_t conv)
+{
+	SbcsTable *table = calloc(1, sizeof(SbcsTable));
+	if (table == NULL) {
+		return NULL;
+	}
+	bool all_single = true, single_is_ascii = true;
+	table->space = -1;
+	for (int i = 0; i < 256; i++) {
+		char in_byte = (char)i;
+		char *in = &in_byte;
+		size_t inleft = 1;
+		char *out = table->bytes[i];
+		size_t outleft = sizeof(table->bytes[i]);
+		size_t rc = iconv(conv, &in, &inleft, &out, &outleft);
+		size_t length = out - table->bytes[i];
+		// Don't let a failed byte's state leak into the next
+		iconv(conv, NULL, NULL, NULL, NULL);
+		if (rc != 0 || inleft != 0 || length == 0) {
+			free(table);
+			return NULL;
+		}
+		table->length[i] = length;
+		if (length == 1) {
+			table->single[i] = table->bytes[i][0];
+			if (table->bytes[i][0] == ' ' && table->space == -1) {
+				table->space = i;
+			}
+			if ((unsigned char)table->bytes[i][0] >= 0x80) {
+				single_is_ascii = false;
+			}
+		} else {
+			table->single[i] = 0x80;
+			all_single = false;
+			if (((unsigned char)table->bytes[i][0] & 0x80) == 0) {
+				single_is_ascii = false;
+			}
+		}
+	}
+	if (all_single) {
+		table->vector_mode = SBCS_ALL_SINGLE;
+	} else if (single_is_ascii) {
+		table->vector_mode = SBCS_HIGH_BIT_MULTI;
+	} else {
+		table->vector_mode = SBCS_SCALAR_ONLY;
+	}
+	return table;
+}
+
+static inline char *
+convert_scalar(const SbcsTable *table, const unsigned char *in, size_t length, char *out)
+{
+	for (size_t i = 0; i < length; i++) {
+		// Always copy four bytes, and only advance as far as the
+		// character actually is; the rest gets overwritten.
+		memcpy(out, table->bytes[in[i]], 4);
+		out += table->length[in[i]];
+	}
+	return out;
+}
+
+#ifdef __ALTIVEC__
+typedef __vector unsigned char vuc;
+
+/**
+ * Looks up 16 bytes at once. vec_perm can only index 32 bytes, so it's done
+ * for each 32 byte slice of the table, keeping the lanes whose top three bits
+ * select that slice.
+ */
+static inline vuc
+lookup_block(const vuc slices[16], vuc v)
+{
+	const vuc shift = vec_splat_u8(5);
+	vuc slice_index = vec_sr(v, shift);
+	vuc result = vec_perm(slices[0], slices[1], v);
+	for (int i = 1; i < 8; i++) {
+		vuc looked_up = vec_perm(slices[i * 2], slices[(i * 2) + 1], v);
+		vuc wanted = (vuc)vec_cmpeq(slice_index, vec_splats((unsigned char)i));
+		result = vec_sel(result, looked_up, wanted);
+	}
+	return result;
+}
+
+static char *
+convert_vector(const SbcsTable *table, const unsigned char *in, size_t length, char *out)
+{
+	vuc slices[16];
+	for (int i = 0; i < 16; i++) {
+		memcpy(&slices[i], table->single + (i * 16), 16);
+	}
+	const vuc high_bit = vec_splats((unsigned char)0x80);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		// The buffers aren't aligned, and memcpy gets the compiler to
+		// use whatever unaligned load the CPU has.
+		vuc v, result;
+		memcpy(&v, in + i, 16);
+		result = lookup_block(slices, v);
+		if (table->vector_mode == SBCS_HIGH_BIT_MULTI
+				&& vec_any_ge(result, high_bit)) {
+			out = convert_scalar(table, in + i, 16, out);
+			continue;
+		}
+		memcpy(out, &result, 16);
+		out += 16;
+	}
+	return convert_scalar(table, in + i, length - i, out);
+}
+#endif
+
+/**
+ * Converts a buffer with a table, returning how many bytes were written.
+ * The output needs room for four bytes per input byte.
+ */
+size_t sbcs_convert(const SbcsTable *table, const char *in, size_t length, char *out)
+{
+	const unsigned char *uin = (const unsigned char*)in;
+	char *end;
+#ifdef __ALTIVEC__
+	if (table->vector_mode != SBCS_SCALAR_ONLY && length >= 16) {
+		end = convert_vector(table, uin, length, out);
+		return end - out;
+	}
+#endif
+	end = convert_scalar(table, uin, length, out);
+	return end - out;
+}
+
+/**
+ * Finds how much of a record is left after the padding at the end. Spaces are
+ * looked for before converting, a word at a time, since source records are
+ * usually mostly padding.
+ */
+size_t sbcs_trimmed_length(const SbcsTable *table, const char *record, size_t length)
+{
+	const unsigned char *in = (const unsigned char*)record;
+	if (table->space != -1) {
+		uint64_t spaces;
+		memset(&spaces, table->space, sizeof(spaces));
+		while (length >= sizeof(spaces)) {
+			uint64_t word;
+			memcpy(&word, in + length - sizeof(word), sizeof(word));
+			if (word != spaces) {
+				break;
+			}
+			length -= sizeof(word);
+		}
+	}
+	// Anything else that converts to a space is trimmed here too
+	while (length > 0 && table->length[in[length - 1]] == 1
+			&& table->single[in[length - 1]] == ' ') {
+		length--;
+	}
+	return length;
+}
+
+/**
+ * Converts a record, dropping the trailing padding if asked, and ends it with
+ * a newline. Returns how many bytes were written, which needs room for four
+ * bytes per input byte plus one.
+ */
+size_t sbcs_convert_record(const SbcsTable *table, const char *in, size_t length, char *out, bool trim)
+{
+	if (trim) {
+		length = sbcs_trimmed_length(table, in, length);
+	}
+	size_t converted = sbcs_convert(table, in, length, out);
+	out[converted] = '\n';
+	return converted + 1;
+}
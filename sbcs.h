@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* How the vector kernel can tell if a block only has single byte characters */
+typedef enum {
+	SBCS_SCALAR_ONLY = 0,
+	/* Every character converts to a single byte */
+	SBCS_ALL_SINGLE,
+	/* Single byte characters are ASCII, the rest have the high bit set */
+	SBCS_HIGH_BIT_MULTI,
+} SbcsVectorMode;
+
+/*
+ * Conversion for a single byte CCSID, done by looking up each byte instead
+ * of going through iconv. The converted bytes are padded to four, so they
+ * can be copied without looking at the length first.
+ */
+typedef struct sbcs_table {
+	char bytes[256][4];
+	uint8_t length[256];
+	/* The converted byte, or 0x80 if it converts to several */
+	unsigned char single[256];
+	SbcsVectorMode vector_mode;
+	/* The byte that converts to a space, or -1 if none do */
+	int space;
+} SbcsTable;
+
+SbcsTable *sbcs_table_build(iconv_t conv);
+size_t sbcs_convert(const SbcsTable *table, const char *in, size_t length, char *out);
+size_t sbcs_trimmed_length(const SbcsTable *table, const char *record, size_t length);
+size_t sbcs_convert_record(const SbcsTable *table, const char *in, size_t length, char *out, bool trim);
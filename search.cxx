@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2024-2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string>
+#include <vector>
+
+#include "common.hxx"
+#include "search.hxx"
+
+/**
+ * Matches a line against the patterns; the first one that matches wins,
+ * unless scan_more is set, in which case every match of every pattern is
+ * collected into substrings for highlighting. Throws if a pattern couldn't
+ * be run.
+ */
+bool match_patterns(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *line, size_t line_size, bool scan_more, std::vector<string_view> &substrings)
+{
+	uint32_t offset = 0, flags = 0;
+	int rc = 0;
+	bool matched = false;
+	size_t last_substring_end = 0;
+	substrings.clear();
+	// We can have multiple expressions. Find the first match.
+	for (const auto& pattern : patterns) {
+		pcre2_code *re = pattern.re;
+
+again:
+		size_t match_start = 0, match_end = 0;
+		if (pattern.literal) {
+			if (pattern.literal->find(line, line_size, offset, match_start, match_end)) {
+				rc = 1;
+			} else {
+				rc = PCRE2_ERROR_NOMATCH;
+			}
+		} else {
+			// As long as we checked that the pattern successfully
+			// was JIT compiled, it should be safe to use
+			// pcre2_jit_match instead.
+			if (pattern.can_jit) {
+				rc = pcre2_jit_match(re, (PCRE2_SPTR)line, line_size, offset, flags, match_data, nullptr);
+			} else {
+				rc = pcre2_match(re, (PCRE2_SPTR)line, line_size, offset, flags, match_data, nullptr);
+			}
+			if (rc > 0) {
+				size_t* ovector = pcre2_get_ovector_pointer(match_data);
+				match_start = ovector[0];
+				match_end = ovector[1];
+			}
+		}
+
+		if (rc > 0) {
+			matched = true;
+			size_t substring_length = match_end - match_start;
+			// Cheap way to avoid overlap and having to do more
+			// complicated substring coalescing
+			if ((match_start > last_substring_end) || substrings.size() == 0) {
+				substrings.emplace_back(line + match_start, substring_length);
+			} else if ((match_start == last_substring_end) && substrings.size()) {
+				// If the two substrings run into each other
+				const char *old_string = substrings.back().data();
+				size_t new_length = substrings.back().size() + substring_length;
+				substrings.back() = string_view(old_string, new_length);
+			}
+			// Scan more in this string; be careful not to loop
+			// XXX: Use pcre2_next_match when we get newer PCRE2
+			if (match_start == match_end) {
+				break; // i.e. if empty string is pattern
+			}
+			last_substring_end = match_end;
+			offset = match_end;
+			goto again;
+		}
+
+		if (rc > 0 && !scan_more) {
+			break;
+		} else if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
+			throw PCRE2Error(rc);
+		}
+	}
+	return matched;
+}
+
+/**
+ * Finds where in the window a pattern could next match at or after from,
+ * or npos. The line it's on still has to be matched to be sure. Throws if
+ * the pattern couldn't be run over the window.
+ */
+static size_t find_candidate(const Pattern &pattern, pcre2_match_data *match_data,
+	const char *data, size_t length, size_t from)
+{
+	size_t start, end;
+	if (pattern.buffer_re == nullptr) {
+		if (!pattern.prefilter->find(data, length, from, start, end)) {
+			return std::string::npos;
+		}
+		return start;
+	}
+	int rc;
+	if (pattern.buffer_can_jit) {
+		rc = pcre2_jit_match(pattern.buffer_re, (PCRE2_SPTR)data, length, from, 0, match_data, nullptr);
+	} else {
+		rc = pcre2_match(pattern.buffer_re, (PCRE2_SPTR)data, length, from, 0, match_data, nullptr);
+	}
+	if (rc == PCRE2_ERROR_NOMATCH) {
+		return std::string::npos;
+	} else if (rc < 0) {
+		throw PCRE2Error(rc);
+	}
+	return pcre2_get_ovector_pointer(match_data)[0];
+}
+
+/**
+ * Finds where each pattern could first match in a new window. Returns the
+ * earliest, or npos; also npos if any pattern can't be looked for across
+ * lines, which means every line has to be matched.
+ */
+size_t first_candidate(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *data, size_t length, std::vector<size_t> &candidates)
+{
+	candidates.clear();
+	size_t earliest = std::string::npos;
+	for (const auto& pattern : patterns) {
+		if (!pattern.prefilter && pattern.buffer_re == nullptr) {
+			candidates.clear();
+			return std::string::npos;
+		}
+		try {
+			candidates.push_back(find_candidate(pattern, match_data, data, length, 0));
+		} catch (PCRE2Error pcre2error) {
+			candidates.clear();
+			return std::string::npos;
+		}
+		if (candidates.back() < earliest) {
+			earliest = candidates.back();
+		}
+	}
+	return earliest;
+}
+
+/**
+ * Finds the first place at or after from where any pattern could match.
+ * If a pattern fails to run over the window, every line from here on gets
+ * matched on its own instead, which reports the error if it's real.
+ */
+size_t next_candidate(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *data, size_t length, size_t from, std::vector<size_t> &candidates)
+{
+	size_t earliest = std::string::npos;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		size_t &candidate = candidates[i];
+		if (candidate != std::string::npos && candidate < from) {
+			try {
+				candidate = find_candidate(patterns[i], match_data, data, length, from);
+			} catch (PCRE2Error pcre2error) {
+				candidates.clear();
+				return from;
+			}
+		}
+		if (candidate < earliest) {
+			earliest = candidate;
+		}
+	}
+	return earliest;
+}
+
+WindowLines::WindowLines(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *data, size_t length, std::vector<size_t> &candidates)
+	: patterns(patterns), candidates(candidates)
+{
+	this->match_data = match_data;
+	this->data = data;
+	this->end = data + length;
+	this->position = data;
+	// Patterns are run over the whole window to find lines worth matching
+	this->candidate = first_candidate(patterns, match_data, data, length, candidates);
+}
+
+/**
+ * Moves to the next line that needs looking at. If can_skip is set, lines
+ * that can't match are gone past, except for context_lines of them right
+ * before the next one that could; if lineno isn't null, the lines gone past
+ * are counted in it. Returns false at the end of the window.
+ */
+bool WindowLines::next(bool can_skip, size_t context_lines, int *lineno)
+{
+	const char *line = this->position;
+	if (line >= this->end) {
+		return false;
+	}
+	size_t length = this->end - this->data;
+	size_t line_offset = line - this->data;
+	if (!this->candidates.empty() && this->candidate < line_offset) {
+		this->candidate = next_candidate(this->patterns, this->match_data,
+			this->data, length, line_offset, this->candidates);
+	}
+	// Go straight to the line the next match could be on, less the
+	// ones before it that are printed as context
+	if (!this->candidates.empty() && this->candidate > line_offset && can_skip) {
+		const char *target = this->candidate == std::string::npos ? this->end : this->data + this->candidate;
+		target = lines_start_of(line, target);
+		for (size_t i = 0; i < context_lines && target > line; i++) {
+			target = lines_previous(line, target);
+		}
+		if (lineno != nullptr) {
+			*lineno += lines_count(line, target);
+		}
+		line = target;
+		if (line >= this->end) {
+			this->position = line;
+			return false;
+		}
+	}
+	// Handle CRLF newlines (could be better)
+	const char *next = lines_find_break(line, this->end);
+	this->line = line;
+	this->line_size = (size_t)(next - line);
+	if (next < this->end && next[0] == '\r') {
+		next++;
+	}
+	if (next < this->end && next[0] == '\n') {
+		next++;
+	}
+	this->position = next;
+
+	// Lines before the next candidate can't match; one at the very
+	// end is for a last line without a newline
+	size_t next_offset = next - this->data;
+	this->could_match = this->candidates.empty() || this->candidate < next_offset
+		|| (next_offset == length && this->candidate == length);
+	return true;
+}
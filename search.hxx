@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024-2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Matching lines against pfgrep's patterns, and going through the lines of a
+ * window that could match. The benchmarks use the same, so what they time is
+ * what pfgrep runs. Needs common.hxx included first.
+ */
+
+extern "C" {
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+}
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Pattern {
+public:
+	Pattern(const std::string &expr, pcre2_code *re, bool can_jit) : expr(expr) {
+		this->re = re;
+		this->can_jit = can_jit;
+	}
+
+	// Lifetime is that of pattern_strings
+	const std::string &expr;
+	// Don't handle destruction in this, since we can get copied by
+	// collections. Free at the end instead.
+	// XXX: Probably use *_ptr...
+	pcre2_code *re;
+	bool can_jit;
+	// Used instead of re for fixed strings
+	std::shared_ptr<LiteralMatcher> literal;
+	// A literal every match contains, which lines are checked for first
+	std::string required;
+	bool required_caseless = false;
+	std::shared_ptr<LiteralMatcher> prefilter;
+	// The pattern with ^, $, and . taking any newline as a line break,
+	// run over a whole window to find the next line worth matching
+	pcre2_code *buffer_re = nullptr;
+	bool buffer_can_jit = false;
+};
+
+class PCRE2Error {
+public:
+	PCRE2Error(int rc) {
+		this->rc = rc;
+	}
+
+	int rc;
+};
+
+// Goes through the lines of a window, skipping over the ones no pattern can
+// match when the patterns can be looked for across the whole window
+class WindowLines {
+public:
+	WindowLines(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+		const char *data, size_t length, std::vector<size_t> &candidates);
+	bool next(bool can_skip, size_t context_lines, int *lineno);
+
+	// The current line, without its line break
+	const char *line = nullptr;
+	size_t line_size = 0;
+	// If not, no pattern can match it, and it only needs to be printed
+	bool could_match = true;
+
+private:
+	const std::vector<Pattern> &patterns;
+	pcre2_match_data *match_data;
+	const char *data;
+	const char *end;
+	const char *position;
+	// Where each pattern could next match, and the earliest of them
+	std::vector<size_t> &candidates;
+	size_t candidate;
+};
+
+/* search.cxx */
+bool match_patterns(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *line, size_t line_size, bool scan_more, std::vector<string_view> &substrings);
+size_t first_candidate(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *data, size_t length, std::vector<size_t> &candidates);
+size_t next_candidate(const std::vector<Pattern> &patterns, pcre2_match_data *match_data,
+	const char *data, size_t length, size_t from, std::vector<size_t> &candidates);
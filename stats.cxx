@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+}
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "common.hxx"
+
+// Also the keys in the JSON, so keep them as identifiers
+static const char *phase_names[PhaseCount] = {
+	"stat",
+	"readdir",
+	"open",
+	"convert_path",
+	"file_info",
+	"member_info",
+	"member_list",
+	"record_format",
+	"read",
+	"convert",
+	"action",
+	"output",
+};
+
+// What each phase is made of, for the human readable summary
+static const char *phase_descriptions[PhaseCount] = {
+	"statx",
+	"readdir",
+	"open",
+	"Qp0lCvtPathToQSYSObjName",
+	"QDBRTVFD",
+	"QUSRMBRD",
+	"QUSLMBR",
+	"QUSLFLD",
+	"read, mmap",
+	"iconv, tables",
+	"match, compress, etc.",
+	"write",
+};
+
+static const char *skip_names[SkipCount] = {
+	"empty",
+	"filtered",
+	"unsupported",
+	"not_source",
+	"no_record_length",
+	"no_object_name",
+	"stat_failed",
+	"open_failed",
+	"index",
+};
+
+static uint64_t wall_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint64_t cpu_now()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+		return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+	}
+#endif
+	return 0;
+}
+
+static uint64_t timeval_ns(const struct timeval &tv)
+{
+	return ((uint64_t)tv.tv_sec * 1000000000) + ((uint64_t)tv.tv_usec * 1000);
+}
+
+static double ms(uint64_t ns)
+{
+	return ns / 1e6;
+}
+
+Stats::Stats()
+{
+	this->started = wall_now();
+	this->last_wall = this->started;
+	this->last_cpu = cpu_now();
+}
+
+/**
+ * Gives the time since the last change of phase to the phase we're in. Only
+ * the innermost phase is charged, so reading in the middle of an action
+ * doesn't count as both.
+ */
+void Stats::charge()
+{
+	uint64_t wall = wall_now(), cpu = cpu_now();
+	if (this->current != PhaseNone) {
+		this->phases[this->current].wall_ns += wall - this->last_wall;
+		this->phases[this->current].cpu_ns += cpu - this->last_cpu;
+	}
+	this->last_wall = wall;
+	this->last_cpu = cpu;
+}
+
+StatsPhase Stats::enter(StatsPhase phase)
+{
+	charge();
+	StatsPhase previous = this->current;
+	this->current = phase;
+	this->phases[phase].calls++;
+	return previous;
+}
+
+void Stats::leave(StatsPhase previous)
+{
+	charge();
+	this->current = previous;
+}
+
+void Stats::note_buffers(size_t read_buffer, size_t conv_buffer, size_t output)
+{
+	this->peak_read_buffer = std::max(this->peak_read_buffer, read_buffer);
+	this->peak_conv_buffer = std::max(this->peak_conv_buffer, conv_buffer);
+	this->peak_output = std::max(this->peak_output, output);
+}
+
+/**
+ * Adds what a worker counted into these, once it's done.
+ */
+void Stats::merge(const Stats &other)
+{
+	for (int i = 0; i < PhaseCount; i++) {
+		this->phases[i].calls += other.phases[i].calls;
+		this->phases[i].wall_ns += other.phases[i].wall_ns;
+		this->phases[i].cpu_ns += other.phases[i].cpu_ns;
+	}
+	for (int i = 0; i < SkipCount; i++) {
+		this->skipped[i] += other.skipped[i];
+	}
+	this->members += other.members;
+	this->streamfiles += other.streamfiles;
+	this->bytes_read += other.bytes_read;
+	this->bytes_converted += other.bytes_converted;
+	this->text_bytes += other.text_bytes;
+	this->listed_hits += other.listed_hits;
+	this->cache_hits += other.cache_hits;
+	this->cache_misses += other.cache_misses;
+	note_buffers(other.peak_read_buffer, other.peak_conv_buffer, other.peak_output);
+}
+
+/**
+ * Prints a summary to standard error, followed by the same as a line of JSON
+ * for scripts. With workers, phase times are added up across every thread,
+ * so they can add up to more than the time taken.
+ */
+void Stats::print(const char *tool_name) const
+{
+	uint64_t wall = wall_now() - this->started;
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	uint64_t user = timeval_ns(usage.ru_utime), system = timeval_ns(usage.ru_stime);
+
+	fmt::println(stderr, "{}: {:.3f} ms wall, {:.3f} ms user, {:.3f} ms system", tool_name,
+		ms(wall), ms(user), ms(system));
+	fmt::println(stderr, "{:<14} {:>10} {:>12} {:>12}", "phase", "calls", "wall ms", "cpu ms");
+	for (int i = 0; i < PhaseCount; i++) {
+		if (this->phases[i].calls == 0) {
+			continue;
+		}
+		fmt::println(stderr, "{:<14} {:>10} {:>12.3f} {:>12.3f}  {}", phase_names[i],
+			this->phases[i].calls, ms(this->phases[i].wall_ns),
+			ms(this->phases[i].cpu_ns), phase_descriptions[i]);
+	}
+	fmt::println(stderr, "files: {} members, {} streamfiles", this->members, this->streamfiles);
+	fmt::println(stderr, "bytes: {} read, {} converted into {} of text", this->bytes_read,
+		this->bytes_converted, this->text_bytes);
+	std::string skips;
+	for (int i = 0; i < SkipCount; i++) {
+		if (this->skipped[i] > 0) {
+			skips += fmt::format(" {} {}", skip_names[i], this->skipped[i]);
+		}
+	}
+	fmt::println(stderr, "skipped:{}", skips.empty() ? " none" : skips);
+	fmt::println(stderr, "metadata: {} from member lists, {} cache hits, {} cache misses",
+		this->listed_hits, this->cache_hits, this->cache_misses);
+	fmt::println(stderr, "peak buffers: read {}, convert {}, output {}",
+		this->peak_read_buffer, this->peak_conv_buffer, this->peak_output);
+
+	std::string json = fmt::format("{{\"tool\":\"{}\",\"wall_ms\":{:.3f},\"user_ms\":{:.3f},\"system_ms\":{:.3f},\"phases\":{{",
+		tool_name, ms(wall), ms(user), ms(system));
+	for (int i = 0; i < PhaseCount; i++) {
+		json += fmt::format("{}\"{}\":{{\"calls\":{},\"wall_ms\":{:.3f},\"cpu_ms\":{:.3f}}}",
+			i > 0 ? "," : "", phase_names[i], this->phases[i].calls,
+			ms(this->phases[i].wall_ns), ms(this->phases[i].cpu_ns));
+	}
+	json += fmt::format("}},\"members\":{},\"streamfiles\":{},\"bytes_read\":{},\"bytes_converted\":{},\"text_bytes\":{},\"skipped\":{{",
+		this->members, this->streamfiles, this->bytes_read, this->bytes_converted, this->text_bytes);
+	for (int i = 0; i < SkipCount; i++) {
+		json += fmt::format("{}\"{}\":{}", i > 0 ? "," : "", skip_names[i], this->skipped[i]);
+	}
+	json += fmt::format("}},\"metadata\":{{\"listed\":{},\"cache_hits\":{},\"cache_misses\":{}}}",
+		this->listed_hits, this->cache_hits, this->cache_misses);
+	json += fmt::format(",\"peak_buffers\":{{\"read\":{},\"convert\":{},\"output\":{}}}}}",
+		this->peak_read_buffer, this->peak_conv_buffer, this->peak_output);
+	fmt::println(stderr, "{}", json);
+}
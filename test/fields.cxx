@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Field lists as QUSLFLD gives them, and numbers turned into text from them.
+ */
+
+extern "C" {
+#include <stdint.h>
+#include <string.h>
+}
+
+#include <string>
+
+#include "../common.hxx"
+#include "unit.hxx"
+
+// FLDL0100, as far as parse_field_list reads
+#define ENTRY_SIZE 0x120
+
+static void put_int32(std::string &entry, size_t offset, int32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		entry[offset + i] = (char)((uint32_t)value >> (24 - (i * 8)));
+	}
+}
+
+/**
+ * An entry for a field; the type is the EBCDIC letter, i.e. 0xE2 for S.
+ */
+static std::string make_entry(unsigned char type, int32_t position, int32_t length, int32_t digits, int32_t decimals)
+{
+	std::string entry(ENTRY_SIZE, '\0');
+	entry[10] = (char)type;
+	put_int32(entry, 16, position);
+	put_int32(entry, 20, length);
+	put_int32(entry, 24, digits);
+	put_int32(entry, 28, decimals);
+	entry[267] = (char)0xF0;
+	return entry;
+}
+
+static std::string decode(const RecordFormat &format, const std::string &record)
+{
+	std::string text(format.max_text_length, '\0');
+	text.resize(decode_record(format, record.data(), 37, &text[0]));
+	return text;
+}
+
+static void digits_bounded()
+{
+	RecordFormat format;
+	// Zoned and packed can have up to 63 digits, binary up to 18
+	CHECK(parse_field_list(make_entry(0xE2, 1, 63, 63, 2), ENTRY_SIZE, format));
+	CHECK(parse_field_list(make_entry(0xD7, 1, 32, 63, 0), ENTRY_SIZE, format));
+	CHECK(parse_field_list(make_entry(0xC2, 1, 8, 18, 0), ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xE2, 1, 63, 64, 2), ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xD7, 1, 32, 1000000, 0), ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xC2, 1, 8, 19, 0), ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xC2, 1, 8, 0x7FFFFFFF, 0), ENTRY_SIZE, format));
+	// One bad field is enough for the whole record to be converted as text
+	CHECK(!parse_field_list(make_entry(0xE2, 1, 5, 5, 0) + make_entry(0xC2, 6, 4, 99, 0),
+		ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xE2, 1, 5, 5, 6), ENTRY_SIZE, format));
+	CHECK(!parse_field_list(make_entry(0xE2, 1, 5, -1, 0), ENTRY_SIZE, format));
+}
+
+static void biggest_numbers()
+{
+	RecordFormat format;
+	CHECK(parse_field_list(make_entry(0xC2, 1, 8, 18, 18), ENTRY_SIZE, format));
+	// The most negative 64-bit value, with more digits than the field has
+	std::string record("\x80\0\0\0\0\0\0\0", 8);
+	CHECK(decode(format, record) == "-9.223372036854775808");
+
+	CHECK(parse_field_list(make_entry(0xE2, 1, 63, 63, 63), ENTRY_SIZE, format));
+	record = std::string(62, '\xF9') + "\xD9";
+	CHECK(decode(format, record) == "-0." + std::string(63, '9'));
+	CHECK(parse_field_list(make_entry(0xD7, 1, 32, 63, 1), ENTRY_SIZE, format));
+	record = std::string(31, '\x99') + "\x9D";
+	CHECK(decode(format, record) == "-" + std::string(62, '9') + ".9");
+}
+
+static std::string decode_double(double value)
+{
+	RecordFormat format;
+	parse_field_list(make_entry(0xC6, 1, 8, 0, 0), ENTRY_SIZE, format);
+	uint64_t raw;
+	memcpy(&raw, &value, sizeof(raw));
+	std::string record;
+	for (int shift = 56; shift >= 0; shift -= 8) {
+		record.push_back((char)(raw >> shift));
+	}
+	return decode(format, record);
+}
+
+static std::string decode_float(float value)
+{
+	RecordFormat format;
+	parse_field_list(make_entry(0xC6, 1, 4, 0, 0), ENTRY_SIZE, format);
+	uint32_t raw;
+	memcpy(&raw, &value, sizeof(raw));
+	std::string record;
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		record.push_back((char)(raw >> shift));
+	}
+	return decode(format, record);
+}
+
+static void shortest_floats()
+{
+	CHECK(decode_double(0.1) == "0.1");
+	CHECK(decode_double(-2.5) == "-2.5");
+	CHECK(decode_double(100) == "100");
+	CHECK(decode_double(1e300) == "1e+300");
+	CHECK(decode_double(1.5e10) == "15000000000");
+	CHECK(decode_double(1e17) == "1e+17");
+	CHECK(decode_double(0.0001) == "0.0001");
+	CHECK(decode_double(2e-5) == "2e-05");
+	CHECK(decode_double(1.0 / 3) == "0.3333333333333333");
+	CHECK(decode_double(0.1 + 0.2) == "0.30000000000000004");
+	CHECK(decode_double(0) == "0");
+	CHECK(decode_float(0.1f) == "0.1");
+	CHECK(decode_float(3.14159f) == "3.14159");
+	CHECK(decode_float(16777217.0f) == "16777216");
+	CHECK(decode_float(1.0f / 3) == "0.33333334");
+	CHECK(decode_double(1.0 / 0.0) == "inf");
+}
+
+int main()
+{
+	RUN(digits_bounded);
+	RUN(biggest_numbers);
+	RUN(shortest_floats);
+	return unit_result();
+}
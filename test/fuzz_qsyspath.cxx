@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Throws paths made of the pieces QSYS.LIB paths have (and pieces they
+ * shouldn't) at parse_qsys_path. Whatever it takes has to give names QSYS
+ * would, and the same names again when they're put back into a path. It runs
+ * on its own with a fixed seed for make unit; with -DFUZZ_WITH_LIBFUZZER, the
+ * entry point is libFuzzer's instead, i.e.
+ *
+ *   clang++ -std=c++14 -fsanitize=fuzzer,address -DFUZZ_WITH_LIBFUZZER \
+ *     test/fuzz_qsyspath.cxx qsyspath.cxx -o fuzz_qsyspath
+ */
+
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+}
+
+#include <random>
+#include <string>
+
+#include "../common.hxx"
+
+static bool is_plain(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
+
+/**
+ * A name is what QSYS would have: up to ten characters, either plain and
+ * upper case starting with a letter, or in quotes because it needs them.
+ */
+static bool valid_name(const std::string &name)
+{
+	if (name.empty() || name.size() > 10) {
+		return false;
+	}
+	if (name[0] == '"') {
+		return name.size() >= 3 && name.back() == '"'
+			&& name.find('"', 1) == name.size() - 1;
+	}
+	if (!(name[0] >= 'A' && name[0] <= 'Z')) {
+		return false;
+	}
+	for (char c : name) {
+		if (!is_plain(c)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void fail(const std::string &path, const char *why)
+{
+	fprintf(stderr, "%s: %s\n", path.c_str(), why);
+	abort();
+}
+
+/**
+ * Returns if the path was parsed, aborting if it was parsed wrong.
+ */
+static bool check_path(const std::string &path)
+{
+	std::string object, library, member;
+	if (!parse_qsys_path(path, object, library, member)) {
+		return false;
+	}
+	if (!valid_name(object)) {
+		fail(path, "bad object name");
+	}
+	if (library != "*LIBL" && library != "*CURLIB" && !valid_name(library)) {
+		fail(path, "bad library name");
+	}
+	if (!member.empty() && !valid_name(member)) {
+		fail(path, "bad member name");
+	}
+
+	// Put back together the way the system would show it
+	std::string canonical = "/QSYS.LIB/";
+	if (library == "*LIBL") {
+		canonical += "%LIBL%.LIB/";
+	} else if (library == "*CURLIB") {
+		canonical += "%CURLIB%.LIB/";
+	} else if (library != "QSYS") {
+		canonical += library + ".LIB/";
+	}
+	canonical += object + ".FILE";
+	if (!member.empty()) {
+		canonical += "/" + member + ".MBR";
+	}
+	std::string object2, library2, member2;
+	if (!parse_qsys_path(canonical, object2, library2, member2)) {
+		fail(path, "its canonical form isn't taken");
+	}
+	if (object != object2 || library != library2 || member != member2) {
+		fail(path, "its canonical form has other names");
+	}
+	return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	check_path(std::string((const char*)data, size));
+	return 0;
+}
+
+#ifndef FUZZ_WITH_LIBFUZZER
+// Pieces of names, some of which can't be in one
+static const char *name_pieces[] = {
+	"A", "B", "z", "q", "1", "9", "_", ".", "\"", "\"", "$", "#", "@", " ", "-", "'",
+	"*", "?", "/", "%", "MYLIB", "QRPGLESRC", "Src", "LONGERTHANTEN", "\xC3\xA4", "\x80",
+	"\xFF", "\t", "..",
+};
+
+// Names that are fine, so more of the paths are taken
+static const char *good_names[] = {
+	"A", "MYLIB", "qrpglesrc", "A_1.B", "TENCHARSXX", "\"Src\"", "\"ABC\"", "\"a.b\"",
+	"\"1-2\"",
+};
+
+static const char *types[] = {
+	".LIB", ".lib", ".FILE", ".file", ".MBR", ".Mbr", ".PGM", ".", "", ".LIB.FILE",
+};
+
+template <size_t N>
+static const char *pick(std::mt19937 &random, const char *(&from)[N])
+{
+	return from[random() % N];
+}
+
+/**
+ * Builds a path a component at a time, each a name and a type; most start
+ * like a QSYS.LIB path and have the right types, so they get past the first
+ * checks and into the names.
+ */
+static std::string make_path(std::mt19937 &random)
+{
+	static const char *right_types[] = { ".LIB", ".FILE", ".MBR" };
+	std::string path = random() % 8 == 0 ? "/QOpenSys" : "/QSYS.LIB";
+	int components = 1 + random() % 4;
+	// Skip the library sometimes, for files in QSYS
+	int first = components < 3 && random() % 2 == 0 ? 1 : 0;
+	for (int i = first; i < first + components && i < 4; i++) {
+		path += random() % 32 == 0 ? "//" : "/";
+		int choice = random() % 8;
+		if (choice == 0) {
+			path += random() % 2 == 0 ? "%LIBL%" : "%CURLIB%";
+		} else if (choice == 1) {
+			path += random() % 2 == 0 ? "." : "..";
+			continue;
+		} else if (choice < 5) {
+			path += pick(random, good_names);
+		} else {
+			for (int length = 1 + random() % 4; length > 0; length--) {
+				path += pick(random, name_pieces);
+			}
+		}
+		path += random() % 4 == 0 ? pick(random, types) : right_types[i < 3 ? i : 2];
+	}
+	if (random() % 16 == 0) {
+		path += "/";
+	}
+	return path;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+	unsigned long seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+	std::mt19937 random(seed);
+	unsigned long parsed = 0;
+	for (unsigned long i = 0; i < iterations; i++) {
+		parsed += check_path(make_path(random));
+	}
+	printf("ok %lu paths, %lu parsed\n", iterations, parsed);
+	return 0;
+}
+#endif
@@ -0,0 +1,181 @@
+setup() {
+	load 'test_helper/bats-support/load'
+	load 'test_helper/bats-assert/load'
+
+	# get the containing directory of this file
+	# use $BATS_TEST_FILENAME instead of ${BASH_SOURCE[0]} or $0,
+	# as those will point to the bats executable's location or the preprocessed file respectively
+	DIR="$( cd "$( dirname "$BATS_TEST_FILENAME" )" >/dev/null 2>&1 && pwd )"
+	PATH="$DIR/../:$PATH"
+}
+
+# A physical file in the library, laid out like host.cxx reads it (and
+# bench/hostlib.sh makes): name, record length, CCSID, and if it's source
+make_file() {
+	mkdir -p "$TESTLIB_DIR/$1.FILE"
+	{
+		echo "record_length $2"
+		echo "ccsid $3"
+		echo "source $4"
+	} > "$TESTLIB_DIR/$1.FILE/.pfinfo"
+}
+
+# A member from lines on standard input, padded out to the record length
+# and converted to EBCDIC: file, member, and optionally type and description
+make_member() {
+	local length
+	length=$(sed -n 's/^record_length //p' "$TESTLIB_DIR/$1.FILE/.pfinfo")
+	if grep -q '^source 1' "$TESTLIB_DIR/$1.FILE/.pfinfo"; then
+		length=$(( length - 12 ))
+	fi
+	while IFS= read -r line; do
+		printf "%-${length}s" "$line"
+	done | iconv -f UTF-8 -t IBM037 > "$TESTLIB_DIR/$1.FILE/$2.MBR"
+	if [ -n "$3" ]; then
+		echo "member $2 $3 $4" >> "$TESTLIB_DIR/$1.FILE/.pfinfo"
+	fi
+}
+
+setup_file() {
+	# Install test fixtures
+	TESTLIB_DIR="$BATS_FILE_TMPDIR/PFGREPTEST.LIB"
+	export TESTLIB_DIR
+	make_file QTXTSRC 92 37 1
+	make_member QTXTSRC ABC TXT "Alphabet soup" <<EOF
+ABC
+FOO BAR
+EOF
+	make_member QTXTSRC XYZ TXT "Wheat" <<EOF
+chaff
+FOO BAR
+EOF
+	# Enough members that the workers finish out of order
+	make_file QCLSRC 92 273 1
+	for i in $(seq 1 40); do
+		seq 1 $(( (i * 37) % 200 )) | sed "s/^/LINE M$i /" | make_member QCLSRC "M$i" CLLE "Member $i"
+	done
+	make_file QDATA 20 37 0
+	make_member QDATA ROWS <<EOF
+FOO DATA
+EOF
+}
+
+@test "searching members" {
+	run pfgrep -n 'FOO BAR' "$TESTLIB_DIR/QTXTSRC.FILE/ABC.MBR"
+	assert_success
+	assert_output "2:FOO BAR"
+
+	run bash -c "pfgrep -r 'FOO' '$TESTLIB_DIR' | sort"
+	assert_success
+	assert_output - <<EOF
+$TESTLIB_DIR/QTXTSRC.FILE/ABC.MBR:FOO BAR
+$TESTLIB_DIR/QTXTSRC.FILE/XYZ.MBR:FOO BAR
+EOF
+
+	run pfgrep -i 'CHAFF' "$TESTLIB_DIR/QTXTSRC.FILE/ABC.MBR"
+	assert_failure 1
+}
+
+@test "searching data files" {
+	run pfgrep -r 'DATA' "$TESTLIB_DIR/QDATA.FILE"
+	assert_failure 1
+
+	run pfgrep -p -r 'DATA' "$TESTLIB_DIR/QDATA.FILE"
+	assert_success
+	assert_output "$TESTLIB_DIR/QDATA.FILE/ROWS.MBR:FOO DATA"
+}
+
+@test "search descriptions" {
+	run pfgrep -d -r 'Wheat' "$TESTLIB_DIR/QTXTSRC.FILE"
+	assert_success
+	assert_output "$TESTLIB_DIR/QTXTSRC.FILE/XYZ.MBR:Wheat"
+}
+
+@test "parallel recursion matches serial order" {
+	run pfgrep -r -n -C 1 'LINE M[0-9]+ 1[05]$' "$TESTLIB_DIR"
+	serial_output="$output"
+
+	run pfgrep -j 4 -r -n -C 1 'LINE M[0-9]+ 1[05]$' "$TESTLIB_DIR"
+	assert_success
+	assert_output "$serial_output"
+
+	run bash -c "pfcat -r '$TESTLIB_DIR/QCLSRC.FILE' | cksum"
+	serial_output="$output"
+
+	run bash -c "pfcat -j 4 -r '$TESTLIB_DIR/QCLSRC.FILE' | cksum"
+	assert_output "$serial_output"
+}
+
+@test "reading members" {
+	run pfcat "$TESTLIB_DIR/QTXTSRC.FILE/XYZ.MBR"
+	assert_output - <<EOF
+chaff
+FOO BAR
+EOF
+
+	run pfcat "$TESTLIB_DIR/QDATA.FILE/ROWS.MBR"
+	assert_output ""
+
+	run pfcat -p "$TESTLIB_DIR/QDATA.FILE/ROWS.MBR"
+	assert_output "FOO DATA"
+}
+
+@test "searching with an index" {
+	TESTINDEX="$BATS_TEST_TMPDIR/test.idx"
+	run bash -c "pfindex -v -r '$TESTINDEX' '$TESTLIB_DIR' 2>&1 | tail -n 1"
+	assert_output "42 files indexed, 0 unchanged"
+
+	run bash -c "pfgrep --index '$TESTINDEX' -r -c 'FOO BAR' '$TESTLIB_DIR/QTXTSRC.FILE' | sort"
+	assert_output - <<EOF
+$TESTLIB_DIR/QTXTSRC.FILE/ABC.MBR:1
+$TESTLIB_DIR/QTXTSRC.FILE/XYZ.MBR:1
+EOF
+
+	run bash -c "pfgrep --index '$TESTINDEX' -r -L 'chaff' '$TESTLIB_DIR/QTXTSRC.FILE'"
+	assert_output "$TESTLIB_DIR/QTXTSRC.FILE/ABC.MBR"
+
+	run pfgrep --index "$TESTINDEX" -r -n 'LINE M2 1[0-9]$' "$TESTLIB_DIR"
+	indexed_output="$output"
+	run pfgrep -r -n 'LINE M2 1[0-9]$' "$TESTLIB_DIR"
+	assert_output "$indexed_output"
+
+	# Data files are left out without -p, like pfgrep does
+	run pfindex -v -p -j 4 -r "$TESTINDEX" "$TESTLIB_DIR"
+	assert_success
+	assert_output - <<EOF
+$TESTLIB_DIR/QDATA.FILE/ROWS.MBR
+1 files indexed, 42 unchanged
+EOF
+
+	run pfgrep --index "$TESTINDEX" -p -r 'FOO DATA' "$TESTLIB_DIR/QDATA.FILE"
+	assert_output "$TESTLIB_DIR/QDATA.FILE/ROWS.MBR:FOO DATA"
+}
+
+@test "metadata cache" {
+	TESTCACHE="$BATS_TEST_TMPDIR/test.cache"
+	members=("$TESTLIB_DIR"/QTXTSRC.FILE/*.MBR)
+
+	run pfgrep -d 'Alphabet' "${members[@]}"
+	uncached_output="$output"
+
+	run bash -c "pfgrep --stats --metadata-cache '$TESTCACHE' -d 'Alphabet' ${members[*]} 2>&1 > /dev/null | tail -n 1"
+	assert_output --partial '"cache_hits":0,"cache_misses":2'
+
+	run bash -c "pfgrep --stats --metadata-cache '$TESTCACHE' -d 'Alphabet' ${members[*]} 2>&1 > /dev/null | tail -n 1"
+	assert_output --partial '"cache_hits":2,"cache_misses":0'
+
+	run pfgrep --metadata-cache "$TESTCACHE" -d 'Alphabet' "${members[@]}"
+	assert_success
+	assert_output "$uncached_output"
+
+	run pfcat --metadata-cache "$TESTCACHE" "${members[@]}"
+	assert_output - <<EOF
+ABC
+FOO BAR
+chaff
+FOO BAR
+EOF
+
+	run pfindex --metadata-cache "$TESTCACHE" -r "$BATS_TEST_TMPDIR/test.idx" "${members[@]}"
+	assert_success
+}
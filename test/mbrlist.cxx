@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Member lists from a canned backend, and how pfbase uses them when it finds
+ * a member, with a platform that counts the calls it'd make to the system.
+ */
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <memory>
+#include <string>
+
+#include "../common.hxx"
+#include "unit.hxx"
+
+// Where MBRD0200 and MBRL0310 have what load_member_list reads
+#define ENTRY_SIZE 0x100
+#define LIBOBJ "QRPGLESRCTESTLIB   "
+
+static std::string directory;
+
+/**
+ * Just the EBCDIC (CCSID 37) the tests need, so what's checked doesn't come
+ * from the conversions being tested.
+ */
+static std::string ebcdic(const std::string &text)
+{
+	std::string out;
+	for (unsigned char c : text) {
+		if (c >= 'A' && c <= 'I') {
+			out.push_back((char)(0xC1 + (c - 'A')));
+		} else if (c >= 'J' && c <= 'R') {
+			out.push_back((char)(0xD1 + (c - 'J')));
+		} else if (c >= 'S' && c <= 'Z') {
+			out.push_back((char)(0xE2 + (c - 'S')));
+		} else if (c >= 'a' && c <= 'i') {
+			out.push_back((char)(0x81 + (c - 'a')));
+		} else if (c >= 'j' && c <= 'r') {
+			out.push_back((char)(0x91 + (c - 'j')));
+		} else if (c >= 's' && c <= 'z') {
+			out.push_back((char)(0xA2 + (c - 's')));
+		} else if (c >= '0' && c <= '9') {
+			out.push_back((char)(0xF0 + (c - '0')));
+		} else if (c == '$') {
+			out.push_back('\x5B');
+		} else if (c == '#') {
+			out.push_back('\x7B');
+		} else if (c == '@') {
+			out.push_back('\x7C');
+		} else {
+			out.push_back('\x40');
+		}
+	}
+	return out;
+}
+
+static std::string padded(const std::string &text, size_t size)
+{
+	std::string out = ebcdic(text);
+	out.resize(size, '\x40');
+	return out;
+}
+
+static std::string make_entry(const char *libobj, const std::string &member, const std::string &type, const std::string &description, int32_t record_count)
+{
+	std::string entry(ENTRY_SIZE, '\0');
+	std::string fields = padded(libobj, 20);
+	int32_t description_ccsid = 37;
+	entry.replace(0x08, 20, fields);
+	entry.replace(0x1C, 10, padded(member, 10));
+	entry.replace(0x30, 10, padded(type, 10));
+	entry.replace(0x54, 50, padded(description, 50));
+	memcpy(&entry[0x8C], &record_count, sizeof(record_count));
+	memcpy(&entry[0xF0], &description_ccsid, sizeof(description_ccsid));
+	return entry;
+}
+
+class CannedMemberList : public MemberListBackend {
+public:
+	bool list(const char *libobj, std::string &entries, size_t &entry_size) override
+	{
+		this->calls++;
+		this->asked_for = std::string(libobj, 20);
+		entries = this->entries;
+		entry_size = this->entry_size;
+		return this->succeeds;
+	}
+
+	std::string entries;
+	size_t entry_size = ENTRY_SIZE;
+	bool succeeds = true;
+	int calls = 0;
+	std::string asked_for;
+};
+
+static void make_list(MemberList &list)
+{
+	list = MemberList();
+	std::string libobj = padded(LIBOBJ, 20);
+	memcpy(list.libobj, libobj.data(), 20);
+	list.libobj[20] = '\0';
+	list.pf_info = 112;
+}
+
+static void fields_filled_in()
+{
+	CannedMemberList backend;
+	backend.entries = make_entry(LIBOBJ, "ORDERS", "RPGLE", "Order entry", 1234)
+		+ make_entry(LIBOBJ, "X", "SQLRPGLE", "", 0)
+		+ make_entry(LIBOBJ, "$#@LONGNAM", "TXT", "Ten characters long", 7);
+	MemberList list;
+	make_list(list);
+	CHECK(load_member_list(backend, list));
+	CHECK(backend.calls == 1);
+	CHECK(backend.asked_for == std::string(list.libobj, 20));
+	CHECK(list.members.size() == 3);
+
+	// Trimmed and named like readdir has them
+	auto found = list.members.find("ORDERS.MBR");
+	CHECK(found != list.members.end());
+	CHECK(list.members.count("X.MBR") == 1);
+	CHECK(list.members.count("$#@LONGNAM.MBR") == 1);
+	CHECK(list.members.count("ORDERS") == 0);
+	if (found == list.members.end()) {
+		return;
+	}
+	const ListedMember &member = found->second;
+	CHECK(memcmp(member.member, padded("ORDERS", 10).data(), 10) == 0);
+	CHECK(member.metadata.record_count == 1234);
+	CHECK(member.metadata.pf_info == 112);
+	CHECK(member.metadata.description_ccsid == 37);
+	// Still EBCDIC until set_member_info
+	CHECK(memcmp(member.metadata.source_type, padded("RPGLE", 10).data(), 10) == 0);
+	CHECK(memcmp(member.metadata.description, padded("Order entry", 50).data(), 50) == 0);
+	CHECK(list.members["$#@LONGNAM.MBR"].metadata.record_count == 7);
+
+	File file = {};
+	set_member_info(file, member.metadata);
+	CHECK(file.record_count == 1234);
+	CHECK(strncmp(file.source_type, "RPGLE     ", 10) == 0);
+	CHECK(strncmp(file.description, "Order entry ", 12) == 0);
+}
+
+static void mismatched_libobj()
+{
+	CannedMemberList backend;
+	backend.entries = make_entry(LIBOBJ, "ORDERS", "RPGLE", "", 1)
+		+ make_entry("QRPGLESRCOTHERLIB  ", "STRAY", "RPGLE", "", 1);
+	MemberList list;
+	make_list(list);
+	CHECK(!load_member_list(backend, list));
+	CHECK(list.members.empty());
+
+	backend.entries = make_entry("QCLSRC    TESTLIB   ", "ORDERS", "CLLE", "", 1);
+	CHECK(!load_member_list(backend, list));
+	CHECK(list.members.empty());
+}
+
+static void bad_entries()
+{
+	CannedMemberList backend;
+	backend.entries = make_entry(LIBOBJ, "ORDERS", "RPGLE", "", 1);
+	MemberList list;
+	make_list(list);
+
+	// Too short for the description's CCSID at 0xF0
+	backend.entry_size = 0xF0 + 3;
+	CHECK(!load_member_list(backend, list));
+	CHECK(list.members.empty());
+	backend.entry_size = 0;
+	CHECK(!load_member_list(backend, list));
+
+	backend.entry_size = ENTRY_SIZE;
+	backend.succeeds = false;
+	CHECK(!load_member_list(backend, list));
+	CHECK(list.members.empty());
+
+	// A piece of an entry at the end isn't read
+	backend.succeeds = true;
+	backend.entries += make_entry(LIBOBJ, "PARTIAL", "RPGLE", "", 1).substr(0, 0x80);
+	CHECK(load_member_list(backend, list));
+	CHECK(list.members.size() == 1 && list.members.count("ORDERS.MBR") == 1);
+
+	// A physical file with no members still has a list
+	backend.entries.clear();
+	CHECK(load_member_list(backend, list));
+	CHECK(list.members.empty());
+}
+
+/**
+ * Answers for a source file with members of 80 characters, counting how
+ * often it's asked about each member.
+ */
+class CountingPlatform : public Platform {
+public:
+	bool stat(const char *path, FileStatus &status) override
+	{
+		struct stat s;
+		if (::stat(path, &s) == -1) {
+			return false;
+		}
+		status = FileStatus();
+		status.kind = ObjectMember;
+		status.size = s.st_size;
+		status.mtime = s.st_mtime;
+		status.ccsid = 37;
+		return true;
+	}
+	int filename_to_libobj(File &file) override
+	{
+		this->converted++;
+		std::string libobj = padded(LIBOBJ, 20);
+		memcpy(file.libobj, libobj.data(), 20);
+		return 0;
+	}
+	int get_pf_info(const File &) override
+	{
+		this->pf_infos++;
+		return 92;
+	}
+	bool get_member_info(const File &, MemberMetadata &metadata) override
+	{
+		this->member_infos++;
+		metadata.record_count = 2;
+		metadata.description_ccsid = 37;
+		memcpy(metadata.source_type, padded("CLLE", 10).data(), 10);
+		memcpy(metadata.description, padded("Looked up", 50).data(), 50);
+		return true;
+	}
+	const RecordFormat *get_record_format(const File &) override
+	{
+		return nullptr;
+	}
+	std::shared_ptr<MemberListBackend> make_member_lister() override
+	{
+		return std::make_shared<CannedMemberList>();
+	}
+
+	int converted = 0;
+	int pf_infos = 0;
+	int member_infos = 0;
+};
+
+// Remembers what it was given for each file instead of reading it
+class RecordingTool : public pfbase {
+public:
+	int do_action(File &file) override
+	{
+		this->record_length = file.record_length;
+		this->record_count = file.record_count;
+		this->source_type = std::string(file.source_type, 10);
+		this->description = std::string(file.description, 11);
+		return 0;
+	}
+	pfbase *make_worker() const override
+	{
+		return nullptr;
+	}
+
+	int record_length = 0;
+	int record_count = 0;
+	std::string source_type;
+	std::string description;
+};
+
+static bool write_member(const char *name, int records)
+{
+	int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return false;
+	}
+	std::string text(80 * records, '\x40');
+	bool ok = write(fd, text.data(), text.size()) == (ssize_t)text.size();
+	return close(fd) == 0 && ok;
+}
+
+static void listed_or_looked_up()
+{
+	char old_dir[PATH_MAX + 1];
+	CHECK(getcwd(old_dir, sizeof(old_dir)) != nullptr);
+	CHECK(chdir(directory.c_str()) == 0);
+	CHECK(write_member("LISTED.MBR", 3));
+	CHECK(write_member("MISSING.MBR", 2));
+
+	auto platform = std::make_shared<CountingPlatform>();
+	RecordingTool tool;
+	tool.platform = platform;
+	tool.silent = true;
+	CannedMemberList backend;
+	backend.entries = make_entry(LIBOBJ, "LISTED", "RPGLE", "From a list", 3);
+	MemberList list;
+	make_list(list);
+	list.pf_info = 92;
+	CHECK(load_member_list(backend, list));
+	tool.member_list = &list;
+
+	// In the list, so nothing's asked of the system
+	CHECK(tool.do_thing("LISTED.MBR", directory.c_str(), true) == 0);
+	CHECK(platform->converted == 0 && platform->pf_infos == 0 && platform->member_infos == 0);
+	CHECK(tool.record_length == 80);
+	CHECK(tool.record_count == 3);
+	CHECK(tool.source_type == "RPGLE     ");
+	CHECK(tool.description == "From a list");
+
+	// Not in it (i.e. added since it was listed), so looked up on its own
+	CHECK(tool.do_thing("MISSING.MBR", directory.c_str(), true) == 0);
+	CHECK(platform->converted == 1 && platform->pf_infos == 1 && platform->member_infos == 1);
+	CHECK(tool.record_length == 80);
+	CHECK(tool.record_count == 2);
+	CHECK(tool.source_type == "CLLE      ");
+	CHECK(tool.description == "Looked up  ");
+
+	// Without a list, everything is
+	tool.member_list = nullptr;
+	CHECK(tool.do_thing("LISTED.MBR", directory.c_str(), true) == 0);
+	CHECK(platform->converted == 2 && platform->pf_infos == 2 && platform->member_infos == 2);
+	CHECK(tool.source_type == "CLLE      ");
+
+	unlink("LISTED.MBR");
+	unlink("MISSING.MBR");
+	CHECK(chdir(old_dir) == 0);
+}
+
+int main()
+{
+	const char *tmpdir = getenv("TMPDIR");
+	std::string pattern = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/pftest.XXXXXX";
+	if (mkdtemp(&pattern[0]) == nullptr) {
+		perror("mkdtemp");
+		return 1;
+	}
+	directory = pattern;
+
+	RUN(fields_filled_in);
+	RUN(mismatched_libobj);
+	RUN(bad_entries);
+	RUN(listed_or_looked_up);
+
+	rmdir(directory.c_str());
+	return unit_result();
+}
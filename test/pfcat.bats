@@ -90,6 +90,65 @@ FOOBAR FOO
 EOF
 }
 
+@test "reading streamfiles without mapping" {
+	run pfcat --no-mmap "$TESTSTMF_A" "$TESTSTMF_E"
+
+	assert_output - <<EOF
+ABC
+AB
+
+A
+AB
+ABC
+DEF
+FOO BAR
+FOOBAR
+FOOBAR FOO
+ABC
+AB
+
+A
+AB
+ABC
+DEF
+FOO BAR
+FOOBAR
+FOOBAR FOO
+EOF
+}
+
+@test "reading EBCDIC streamfile larger than a window" {
+	BIGSTMF=$(mktemp /tmp/pfgrep_test.XXXXXXX)
+	seq 1 300000 | /usr/bin/iconv -f UTF-8 -t IBM-037 > "$BIGSTMF"
+	setccsid 37 "$BIGSTMF"
+
+	run bash -c "pfcat '$BIGSTMF' | cksum"
+	expected=$(seq 1 300000 | cksum)
+	rm -f "$BIGSTMF"
+
+	assert_output "$expected"
+}
+
+@test "reading streamfiles with NULs on workers" {
+	NULSTMF=$(mktemp /tmp/pfgrep_test.XXXXXXX)
+	printf 'before\0after\n\0\0\nend\n' > "$NULSTMF"
+	setccsid 1208 "$NULSTMF"
+
+	run bash -c "pfcat -j 4 '$NULSTMF' '$TESTSTMF_E' '$NULSTMF' '$TESTSTMF_A' | cksum"
+	expected=$(cat "$NULSTMF" "$TESTSTMF_A" "$NULSTMF" "$TESTSTMF_A" | cksum)
+	rm -f "$NULSTMF"
+
+	assert_output "$expected"
+}
+
+@test "printing stats" {
+	run bash -c "pfcat --stats '/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR' '$TESTSTMF_E' 2>&1 > /dev/null | tail -n 1"
+
+	assert_output --partial '"tool":"pfcat"'
+	assert_output --partial '"members":1,"streamfiles":1,'
+	assert_output --partial '"text_bytes":94,'
+}
+
 teardown_file() {
 	system dltlib "$TESTLIB"
 }
@@ -70,6 +70,19 @@ ABC
 EOF
 }
 
+@test "fixed string options" {
+	run pfgrep -F -i -w -o 'foo' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+
+	assert_output - <<EOF
+FOO
+FOO
+EOF
+
+	run pfgrep -F -x 'FOO BAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+
+	assert_output "FOO BAR"
+}
+
 @test "regular expression" {
 	run pfgrep '^A.C$' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
 	
@@ -287,6 +300,94 @@ EOF
 EOF
 }
 
+@test "parallel recursion matches serial order" {
+	run pfgrep -r -n -C 1 'FOO BAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	serial_output="$output"
+
+	run pfgrep -j 4 -r -n -C 1 'FOO BAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+
+	assert_output "$serial_output"
+}
+
+@test "native search matches converted search" {
+	for pattern in 'FOO\s+BAR' '\bFOO\b' '(?i)foobar' 'A.*C' '[XYZ]' '[A-C]+'; do
+		run pfgrep --no-native -n -o -C 1 "$pattern" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+		converted_output="$output"
+
+		run pfgrep -n -o -C 1 "$pattern" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+
+		assert_output "$converted_output"
+	done
+}
+
+@test "context lines across read windows" {
+	# Enough 80 byte records that the member is read in several pieces
+	system addpfm "$TESTLIB/qtxtsrc" big
+	seq 1 10000 | Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+
+	run pfgrep -n -B 2 -A 1 -x '3277' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+
+	assert_output - <<EOF
+3275-3275
+3276-3276
+3277:3277
+3278-3278
+EOF
+
+	system rmvm "$TESTLIB/qtxtsrc" big
+}
+
+@test "line numbers when skipping lines without the required literal" {
+	system addpfm "$TESTLIB/qtxtsrc" big
+	seq 1 10000 | Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+
+	run pfgrep -c '^9[0-9]*7$' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+	assert_output "111"
+
+	run pfgrep -n '^40[0-9]7$' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+	assert_line --index 0 "4007:4007"
+	assert_line --index 9 "4097:4097"
+
+	system rmvm "$TESTLIB/qtxtsrc" big
+}
+
+@test "regular expressions across a whole window" {
+	system addpfm "$TESTLIB/qtxtsrc" big
+	seq 1 10000 | Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+
+	run pfgrep -c '^[0-9]{3}7$' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+	assert_output "900"
+
+	run pfgrep -n -B 1 -m 2 '^99[5-9]8$' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+	assert_output - <<EOF
+9957-9957
+9958:9958
+--
+9967-9967
+9968:9968
+EOF
+
+	run pfgrep -v -c '[0-9]{2}' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/BIG.MBR"
+	assert_output "9"
+
+	system rmvm "$TESTLIB/qtxtsrc" big
+}
+
+@test "filtering by change time" {
+	run pfgrep -l --newer-than 2000-01-01 'FOOBAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+	assert_output "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+
+	run pfgrep -l --older-than 2000-01-01 'FOOBAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+	assert_output ""
+
+	# A file to compare to can be given instead of a time
+	run pfgrep -l --newer-than "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR" 'FOOBAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+	assert_output ""
+
+	run pfgrep --newer-than yesterday 'FOOBAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+	assert_failure 3
+}
+
 teardown_file() {
 	system dltlib "$TESTLIB"
 }
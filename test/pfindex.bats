@@ -0,0 +1,86 @@
+setup() {
+	load 'test_helper/bats-support/load'
+	load 'test_helper/bats-assert/load'
+
+	# get the containing directory of this file
+	# use $BATS_TEST_FILENAME instead of ${BASH_SOURCE[0]} or $0,
+	# as those will point to the bats executable's location or the preprocessed file respectively
+	DIR="$( cd "$( dirname "$BATS_TEST_FILENAME" )" >/dev/null 2>&1 && pwd )"
+	PATH="$DIR/../:$PATH"
+}
+
+setup_file() {
+	# Install test fixtures
+	system crtlib "$TESTLIB"
+	system crtsrcpf "$TESTLIB/qtxtsrc" "CCSID(37) RCDLEN(92)"
+	system addpfm "$TESTLIB/qtxtsrc" abc
+	Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR" <<EOF
+ABC
+FOO BAR
+EOF
+	system addpfm "$TESTLIB/qtxtsrc" xyz
+	Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/XYZ.MBR" <<EOF
+chaff
+FOO BAR
+EOF
+}
+
+make_index() {
+	TESTINDEX="$BATS_TEST_TMPDIR/test.idx"
+	pfindex -r "$TESTINDEX" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+}
+
+@test "searching with an index" {
+	make_index
+
+	run pfgrep --index "$TESTINDEX" -r 'FOO BAR' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_success
+	assert_output - <<EOF
+/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR:FOO BAR
+/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/XYZ.MBR:FOO BAR
+EOF
+
+	run pfgrep --index "$TESTINDEX" -r -i 'CH[aeiou]FF' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_success
+	assert_output "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/XYZ.MBR:chaff"
+}
+
+@test "files ruled out by an index are still counted" {
+	make_index
+
+	run pfgrep --index "$TESTINDEX" -r -L 'chaff' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_output "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+
+	run pfgrep --index "$TESTINDEX" -r -c 'chaff' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_output - <<EOF
+/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR:0
+/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/XYZ.MBR:1
+EOF
+}
+
+@test "updating an index only reads changed files" {
+	make_index
+
+	run pfindex -v -r "$TESTINDEX" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_success
+	assert_output "0 files indexed, 2 unchanged"
+
+	# Make sure the modification time is different
+	sleep 1
+	Rfile -w "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR" <<EOF
+WHEAT
+EOF
+	run pfindex -v -r "$TESTINDEX" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_success
+	assert_output - <<EOF
+/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR
+1 files indexed, 1 unchanged
+EOF
+
+	run pfgrep --index "$TESTINDEX" -r 'WHEAT' "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE"
+	assert_output "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR:WHEAT"
+}
+
+teardown_file() {
+	system dltlib "$TESTLIB"
+}
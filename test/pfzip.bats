@@ -143,6 +143,52 @@ Sample text file                                   (original PF record length 80
 EOF
 }
 
+@test "streaming archive to standard output" {
+	pfzip - "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR" "$TESTSTMF_A" > "$BATS_TEST_TMPDIR/stream.zip"
+	run unzip -l "$BATS_TEST_TMPDIR/stream.zip"
+
+	assert_output - <<EOF
+Archive:  $BATS_TEST_TMPDIR/stream.zip
+  Length      Date    Time    Name
+---------  ---------- -----   ----
+       47  $MEMBER_MOD_DATE   QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.RPGLE
+Sample text file                                   (original PF record length 80 CCSID 37)
+       47  2025-01-01 12:34   $TESTSTMF_A_NLS
+(original streamfile CCSID 1208)
+---------                     -------
+       94                     2 files
+
+EOF
+}
+
+@test "streaming tar archive" {
+	pfzip --format tar - "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR" "$TESTSTMF_A" > "$BATS_TEST_TMPDIR/stream.tar"
+	run tar -tf "$BATS_TEST_TMPDIR/stream.tar"
+
+	assert_output - <<EOF
+QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.RPGLE
+$TESTSTMF_A_NLS
+EOF
+}
+
+@test "tar archive by name" {
+	pfzip -W "$BATS_TEST_TMPDIR/test.tar.gz" "/QSYS.LIB/$TESTLIB.LIB/QTXTSRC.FILE/ABC.MBR"
+	run sh -c "gzip -dc '$BATS_TEST_TMPDIR/test.tar.gz' | tar -xOf -"
+
+	assert_output - <<EOF
+ABC
+AB
+
+A
+AB
+ABC
+DEF
+FOO BAR
+FOOBAR
+FOOBAR FOO
+EOF
+}
+
 teardown_file() {
 	system dltlib "$TESTLIB"
 }
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Splitting QSYS.LIB paths into names, and which ones are left to the system.
+ */
+
+extern "C" {
+#include <stdio.h>
+}
+
+#include <string>
+
+#include "../common.hxx"
+#include "unit.hxx"
+
+struct PathCase {
+	const char *path;
+	// If not, the rest are ignored, since the system resolves it instead
+	bool parsed;
+	const char *object;
+	const char *library;
+	const char *member;
+};
+
+static const PathCase cases[] = {
+	{"/QSYS.LIB/MYLIB.LIB/QRPGLESRC.FILE/ORDERS.MBR", true, "QRPGLESRC", "MYLIB", "ORDERS"},
+	{"/QSYS.LIB/MYLIB.LIB/QRPGLESRC.FILE", true, "QRPGLESRC", "MYLIB", ""},
+	{"/qsys.lib/mylib.lib/qrpglesrc.file/orders.mbr", true, "QRPGLESRC", "MYLIB", "ORDERS"},
+	{"/QSys.Lib/MyLib.Lib/QRpgLeSrc.File/Orders.Mbr", true, "QRPGLESRC", "MYLIB", "ORDERS"},
+	{"/QSYS.LIB/A_B.LIB/C.D.FILE/E_1.MBR", true, "C.D", "A_B", "E_1"},
+	{"/QSYS.LIB/TENCHARSXX.LIB/TENCHARSYY.FILE/TENCHARSZZ.MBR", true, "TENCHARSYY", "TENCHARSXX", "TENCHARSZZ"},
+
+	// Files right under QSYS.LIB are in QSYS
+	{"/QSYS.LIB/QCLSRC.FILE", true, "QCLSRC", "QSYS", ""},
+	{"/QSYS.LIB/QCLSRC.FILE/ABC.MBR", true, "QCLSRC", "QSYS", "ABC"},
+	{"/QSYS.LIB/QSYS.LIB/QCLSRC.FILE/ABC.MBR", true, "QCLSRC", "QSYS", "ABC"},
+	// A library and a member with no file in between isn't a thing
+	{"/QSYS.LIB/MYLIB.LIB/ABC.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB", false, "", "", ""},
+	{"/QSYS.LIB", false, "", "", ""},
+
+	{"/QSYS.LIB/%LIBL%.LIB/QCLSRC.FILE/ABC.MBR", true, "QCLSRC", "*LIBL", "ABC"},
+	{"/QSYS.LIB/%libl%.lib/QCLSRC.FILE", true, "QCLSRC", "*LIBL", ""},
+	{"/QSYS.LIB/%CURLIB%.LIB/QCLSRC.FILE/ABC.MBR", true, "QCLSRC", "*CURLIB", "ABC"},
+	{"/QSYS.LIB/%CurLib%.LIB/QCLSRC.FILE", true, "QCLSRC", "*CURLIB", ""},
+	{"/QSYS.LIB/%OTHER%.LIB/QCLSRC.FILE", false, "", "", ""},
+
+	// Quotes are kept along with the case when needed, dropped when not
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"abc\".MBR", true, "QCLSRC", "MYLIB", "\"abc\""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"ABC\".MBR", true, "QCLSRC", "MYLIB", "ABC"},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"A.B\".MBR", true, "QCLSRC", "MYLIB", "A.B"},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"1AB\".MBR", true, "QCLSRC", "MYLIB", "\"1AB\""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"A-B\".MBR", true, "QCLSRC", "MYLIB", "\"A-B\""},
+	{"/QSYS.LIB/\"MyLib\".LIB/\"Src\".FILE/\"x\".MBR", true, "\"Src\"", "\"MyLib\"", "\"x\""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"\".MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"A B\".MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"A\"B\".MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"A*\".MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"ABC.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"ABC.MBR\"", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"a\xC3\xA4\".MBR", false, "", "", ""},
+	// Ten with the quotes
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"abcdefgh\".MBR", true, "QCLSRC", "MYLIB", "\"abcdefgh\""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/\"abcdefghi\".MBR", false, "", "", ""},
+
+	// $, #, and @ are different characters in other CCSIDs
+	{"/QSYS.LIB/MY$LIB.LIB/QCLSRC.FILE/ABC.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/#QCLSRC.FILE/ABC.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/A@C.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/1ABC.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/A\xC3\xA4.MBR", false, "", "", ""},
+
+	// Anything that needs resolving against something
+	{"/QSYS.LIB/./MYLIB.LIB/QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/../QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/.", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/..", false, "", "", ""},
+	{"/QSYS.LIB//MYLIB.LIB/QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/", false, "", "", ""},
+	{"QSYS.LIB/MYLIB.LIB/QCLSRC.FILE", false, "", "", ""},
+	{"ABC.MBR", false, "", "", ""},
+	{"", false, "", "", ""},
+	{"/", false, "", "", ""},
+	{"/QOpenSys/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/ABC.MBR/MORE", false, "", "", ""},
+
+	// Too long, or not the type it has to be there
+	{"/QSYS.LIB/ELEVENCHARS.LIB/QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/ELEVENCHARS.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/ELEVENCHARS.MBR", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILEX", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/MYPGM.PGM", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.FILE/QCLSRC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC.FILE/ABC.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/.FILE", false, "", "", ""},
+	{"/QSYS.LIB/MYLIB.LIB/QCLSRC", false, "", "", ""},
+};
+
+static void table()
+{
+	for (const auto &c : cases) {
+		std::string object = "stale", library = "stale", member = "stale";
+		bool parsed = parse_qsys_path(c.path, object, library, member);
+		if (parsed != c.parsed) {
+			fprintf(stderr, "%s: %s\n", c.path, parsed ? "parsed" : "not parsed");
+		} else if (parsed && (object != c.object || library != c.library || member != c.member)) {
+			fprintf(stderr, "%s: %s %s %s\n", c.path, object.c_str(), library.c_str(), member.c_str());
+		} else {
+			continue;
+		}
+		unit_failures++;
+	}
+}
+
+int main()
+{
+	RUN(table);
+	return unit_result();
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * The index pfindex writes and pfgrep reads, through plain files.
+ */
+
+extern "C" {
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+}
+
+#include <string>
+#include <vector>
+
+#include "../common.hxx"
+#include "unit.hxx"
+
+static std::string directory;
+
+static IndexEntry make_entry(const std::string &key, int64_t mtime, const std::string &text)
+{
+	TrigramCollector collector;
+	collector.add(text.data(), text.size());
+	IndexEntry entry;
+	entry.key = key;
+	entry.mtime = mtime;
+	entry.size = text.size();
+	entry.trigrams = collector.finish();
+	return entry;
+}
+
+static void make_index(TrigramIndex &index)
+{
+	index.add(make_entry("/A.LIB/QRPGLESRC.FILE/ORDERS.MBR", 100, "C                   EVAL      CUSTNO = 1\n"));
+	index.add(make_entry("/A.LIB/QCLSRC.FILE/START.MBR", 200, "PGM\nDCL VAR(&CUSTNO)\nENDPGM\n"));
+	index.add(make_entry("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, "int main() { return 0; }\n"));
+	// UTF-8, as pfindex would see text converted to it
+	index.add(make_entry("/home/notes.txt", 400, "Gr\xC3\xBC\xC3\x9F" "e an \xC3\x84RGER\n"));
+}
+
+static std::string read_file(const std::string &path)
+{
+	std::string data;
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		return data;
+	}
+	char buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		data.append(buffer, got);
+	}
+	fclose(f);
+	return data;
+}
+
+static bool write_file(const std::string &path, const std::string &data)
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	return fclose(f) == 0 && ok;
+}
+
+static std::vector<bool> search(const TrigramIndex &index, const std::string &literal, bool caseless)
+{
+	return index.candidates({literal_trigrams(literal, caseless)});
+}
+
+static void round_trip()
+{
+	std::string path = directory + "/round.idx";
+	TrigramIndex index;
+	make_index(index);
+	CHECK(index.save(path));
+
+	TrigramIndex loaded;
+	CHECK(loaded.load(path, false));
+	CHECK(loaded.size() == 4);
+	auto possible = search(loaded, "CUSTNO", false);
+	CHECK(possible.size() == 4);
+	CHECK(possible[0] && possible[1] && !possible[2] && !possible[3]);
+	possible = search(loaded, "return", false);
+	CHECK(!possible[0] && !possible[1] && possible[2] && !possible[3]);
+	// Any pattern's literal could match
+	possible = loaded.candidates({literal_trigrams("EVAL", false), literal_trigrams("main", false)});
+	CHECK(possible[0] && !possible[1] && possible[2] && !possible[3]);
+	// Too short to have a trigram, so it can't rule anything out
+	possible = search(loaded, "Gr", false);
+	CHECK(possible[0] && possible[1] && possible[2] && possible[3]);
+
+	// With the trigrams, it's written back out the same
+	TrigramIndex again;
+	CHECK(again.load(path, true));
+	std::string second = directory + "/again.idx";
+	CHECK(again.save(second));
+	CHECK(read_file(path) == read_file(second));
+	const IndexEntry *entry = again.find("/A.LIB/QCLSRC.FILE/START.MBR");
+	CHECK(entry != nullptr && entry->trigrams == make_entry("", 0, "PGM\nDCL VAR(&CUSTNO)\nENDPGM\n").trigrams);
+	unlink(path.c_str());
+	unlink(second.c_str());
+}
+
+/**
+ * What pfindex does to skip files that haven't changed: unchanged files are
+ * found by find_current and their trigrams kept from the last index.
+ */
+static void incremental()
+{
+	std::string path = directory + "/incremental.idx";
+	TrigramIndex index;
+	make_index(index);
+	CHECK(index.save(path));
+
+	TrigramIndex previous, next;
+	CHECK(previous.load(path, true));
+	int id = previous.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, 25);
+	CHECK(id == 2);
+	// Changed since, or never indexed
+	CHECK(previous.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 301, 25) == -1);
+	CHECK(previous.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, 26) == -1);
+	CHECK(previous.find_current("/A.LIB/QCSRC.FILE/OTHER.MBR", 300, 25) == -1);
+
+	next.add(*previous.find("/A.LIB/QCSRC.FILE/MAIN.MBR"));
+	next.add(make_entry("/A.LIB/QCLSRC.FILE/START.MBR", 250, "PGM\nCHGVAR &X 1\nENDPGM\n"));
+	// Added again replaces what was there
+	next.add(make_entry("/A.LIB/QCLSRC.FILE/START.MBR", 260, "PGM\nENDPGM\n"));
+	CHECK(next.size() == 2);
+	CHECK(next.save(path));
+
+	TrigramIndex loaded;
+	CHECK(loaded.load(path, false));
+	CHECK(loaded.size() == 2);
+	CHECK(loaded.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, 25) == 0);
+	CHECK(loaded.find_current("/A.LIB/QCLSRC.FILE/START.MBR", 260, 11) == 1);
+	CHECK(loaded.find("/A.LIB/QRPGLESRC.FILE/ORDERS.MBR") == nullptr);
+	auto possible = search(loaded, "main", false);
+	CHECK(possible[0] && !possible[1]);
+	possible = search(loaded, "CHGVAR", false);
+	CHECK(!possible[0] && !possible[1]);
+	unlink(path.c_str());
+}
+
+/**
+ * Only ASCII is folded, so caseless literals only use the trigrams that are
+ * all ASCII, and case sensitive ones use all of them.
+ */
+static void caseless_non_ascii()
+{
+	std::string path = directory + "/caseless.idx";
+	TrigramIndex index;
+	make_index(index);
+	CHECK(index.save(path));
+	TrigramIndex loaded;
+	CHECK(loaded.load(path, false));
+
+	// U+00E4 doesn't fold to U+00C4, but "rger" still rules files in or out
+	auto trigrams = literal_trigrams("\xC3\xA4rger", true);
+	CHECK(trigrams.size() == 2);
+	auto possible = search(loaded, "\xC3\xA4rger", true);
+	CHECK(!possible[0] && !possible[1] && !possible[2] && possible[3]);
+	possible = search(loaded, "\xC3\x84RGER", true);
+	CHECK(!possible[0] && !possible[1] && !possible[2] && possible[3]);
+	// Case sensitive, only the same bytes can match
+	possible = search(loaded, "\xC3\xA4rger", false);
+	CHECK(!possible[3]);
+	possible = search(loaded, "\xC3\x84RGER", false);
+	CHECK(possible[3]);
+	// All of it outside of ASCII, so anything could match
+	possible = search(loaded, "\xC3\xBC\xC3\x9F", true);
+	CHECK(possible[0] && possible[1] && possible[2] && possible[3]);
+	possible = search(loaded, "\xC3\xBC\xC3\x9F", false);
+	CHECK(!possible[0] && !possible[1] && !possible[2] && possible[3]);
+	unlink(path.c_str());
+}
+
+/**
+ * A file that has changed since it was indexed has to be searched, even if
+ * the index says it couldn't have matched then.
+ */
+static void stale_entries()
+{
+	std::string path = directory + "/stale.idx";
+	TrigramIndex index;
+	make_index(index);
+	CHECK(index.save(path));
+	TrigramIndex loaded;
+	CHECK(loaded.load(path, false));
+
+	auto possible = search(loaded, "ENDPGM", false);
+	int id = loaded.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, 25);
+	CHECK(id == 2 && !possible[id]);
+	// Like pfgrep::rule_out: only ruled out if it's current and not a candidate
+	id = loaded.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 301, 25);
+	CHECK(id == -1);
+	id = loaded.find_current("/A.LIB/QCSRC.FILE/MAIN.MBR", 300, 40);
+	CHECK(id == -1);
+	unlink(path.c_str());
+}
+
+static bool load_fails(const std::string &path, const std::string &data, bool with_trigrams)
+{
+	TrigramIndex loaded;
+	if (!write_file(path, data)) {
+		return false;
+	}
+	errno = 0;
+	return !loaded.load(path, with_trigrams) && errno == EINVAL;
+}
+
+static void put_u32(std::string &data, size_t offset, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		data[offset + i] = (char)(value >> (24 - (i * 8)));
+	}
+}
+
+static void corrupt()
+{
+	std::string path = directory + "/corrupt.idx";
+	TrigramIndex index;
+	make_index(index);
+	CHECK(index.save(path));
+	std::string good = read_file(path);
+	CHECK(good.size() > 16);
+
+	TrigramIndex missing;
+	errno = 0;
+	CHECK(!missing.load(directory + "/missing.idx", false) && errno == ENOENT);
+	CHECK(load_fails(path, "", false));
+	CHECK(load_fails(path, "not an index at all", false));
+
+	// Every bit of it is needed
+	bool all_rejected = true;
+	for (size_t length = 0; length < good.size(); length++) {
+		all_rejected &= load_fails(path, good.substr(0, length), false);
+		all_rejected &= load_fails(path, good.substr(0, length), true);
+	}
+	CHECK(all_rejected);
+
+	// Counts and lengths far past the end
+	std::string bad = good;
+	put_u32(bad, 8, 0xFFFFFFFF);
+	CHECK(load_fails(path, bad, false));
+	bad = good;
+	put_u32(bad, 12, 0xFFFFFFFF);
+	CHECK(load_fails(path, bad, false));
+	bad = good;
+	put_u32(bad, 16, 0xFFFFFFF0);
+	CHECK(load_fails(path, bad, false));
+
+	// Anything else can be loaded or not, but has to be in bounds, and
+	// the index has to still be usable if it was
+	for (size_t offset = 8; offset < good.size(); offset++) {
+		for (int bit = 0; bit < 8; bit++) {
+			bad = good;
+			bad[offset] ^= (char)(1 << bit);
+			CHECK(write_file(path, bad));
+			for (int with_trigrams = 0; with_trigrams < 2; with_trigrams++) {
+				TrigramIndex loaded;
+				errno = 0;
+				if (loaded.load(path, with_trigrams)) {
+					auto possible = search(loaded, "CUSTNO", false);
+					CHECK(possible.size() == loaded.size());
+				} else {
+					CHECK(errno == EINVAL);
+				}
+			}
+		}
+	}
+	unlink(path.c_str());
+}
+
+int main()
+{
+	const char *tmpdir = getenv("TMPDIR");
+	std::string pattern = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/pftest.XXXXXX";
+	if (mkdtemp(&pattern[0]) == nullptr) {
+		perror("mkdtemp");
+		return 1;
+	}
+	directory = pattern;
+
+	RUN(round_trip);
+	RUN(incremental);
+	RUN(caseless_non_ascii);
+	RUN(stale_entries);
+	RUN(corrupt);
+
+	rmdir(directory.c_str());
+	return unit_result();
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Just enough to check the parts that don't need the system, so they can be
+ * tested anywhere. Each test is a program with a function per case; failed
+ * checks are printed, and the program fails if any did.
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+}
+
+static int unit_failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); \
+		unit_failures++; \
+	} \
+} while (0)
+
+#define RUN(test) do { \
+	int failures_before = unit_failures; \
+	test(); \
+	printf("%s %s\n", unit_failures == failures_before ? "ok" : "FAILED", #test); \
+} while (0)
+
+static inline int unit_result()
+{
+	return unit_failures == 0 ? 0 : 1;
+}
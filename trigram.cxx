@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <errno.h>
+#include <stdio.h>
+}
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.hxx"
+
+// Nothing in here touches the system, so the format works the same anywhere;
+// numbers are written big endian byte by byte, not as they are in memory.
+#define INDEX_MAGIC "PFIDX\0\0\1"
+#define INDEX_MAGIC_LENGTH 8
+
+// Sort and drop duplicates once this many trigrams have been collected
+#define TRIGRAM_COMPACT_THRESHOLD (1024 * 1024)
+
+/**
+ * Trigrams are folded to lower case, so caseless searches can use them too.
+ * Only ASCII is folded; what case means for other bytes depends on the CCSID.
+ */
+static inline unsigned char fold_byte(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+void TrigramCollector::add(const char *text, size_t length)
+{
+	const unsigned char *p = (const unsigned char*)text;
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = p[i];
+		// A literal never spans lines, so neither do trigrams
+		if (c == '\n' || c == '\r') {
+			this->have = 0;
+			continue;
+		}
+		this->last = ((this->last << 8) | fold_byte(c)) & 0xFFFFFF;
+		if (++this->have >= 3) {
+			this->trigrams.push_back(this->last);
+		}
+	}
+	if (this->trigrams.size() > TRIGRAM_COMPACT_THRESHOLD) {
+		compact();
+	}
+}
+
+void TrigramCollector::compact()
+{
+	std::sort(this->trigrams.begin(), this->trigrams.end());
+	this->trigrams.erase(std::unique(this->trigrams.begin(), this->trigrams.end()),
+		this->trigrams.end());
+}
+
+/**
+ * Gives every distinct trigram seen, sorted.
+ */
+std::vector<uint32_t> TrigramCollector::finish()
+{
+	compact();
+	this->have = 0;
+	return std::move(this->trigrams);
+}
+
+/**
+ * Gets the trigrams a line has to have to contain a literal. If the match is
+ * caseless, bytes outside of ASCII could match another byte, so any trigram
+ * with one is left out.
+ */
+std::vector<uint32_t> literal_trigrams(const std::string &literal, bool caseless)
+{
+	TrigramCollector collector;
+	size_t start = 0;
+	for (size_t i = 0; i <= literal.size(); i++) {
+		if (i == literal.size() || (caseless && (unsigned char)literal[i] >= 0x80)) {
+			collector.add(literal.data() + start, i - start);
+			collector.add("\n", 1);
+			start = i + 1;
+		}
+	}
+	return collector.finish();
+}
+
+static void put_u32(std::string &out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		out.push_back((char)(value >> shift));
+	}
+}
+
+static void put_u64(std::string &out, uint64_t value)
+{
+	put_u32(out, (uint32_t)(value >> 32));
+	put_u32(out, (uint32_t)value);
+}
+
+static void put_varint(std::string &out, uint32_t value)
+{
+	while (value >= 0x80) {
+		out.push_back((char)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+// Reads the numbers back out, remembering if it ran off the end.
+class IndexReader {
+public:
+	IndexReader(const std::string &data) : data(data) {}
+
+	uint32_t u32() {
+		if (!need(4)) {
+			return 0;
+		}
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) {
+			value = (value << 8) | (unsigned char)this->data[this->position++];
+		}
+		return value;
+	}
+
+	uint64_t u64() {
+		uint64_t high = u32();
+		return (high << 32) | u32();
+	}
+
+	std::string bytes(size_t length) {
+		if (!need(length)) {
+			return "";
+		}
+		std::string value = this->data.substr(this->position, length);
+		this->position += length;
+		return value;
+	}
+
+	bool need(size_t length) {
+		if (this->data.size() - this->position < length) {
+			this->failed = true;
+		}
+		return !this->failed;
+	}
+
+	const std::string &data;
+	size_t position = 0;
+	bool failed = false;
+};
+
+static bool read_varint(const std::string &data, size_t &position, uint32_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (position >= data.size()) {
+			return false;
+		}
+		unsigned char c = data[position++];
+		value |= (uint32_t)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Loads an index written by save. Files are always loaded, but what each
+ * contains is only worked out per file if with_trigrams is set, which is
+ * needed to write the index back out. Returns false with errno set if the
+ * index can't be read, or EINVAL if it isn't an index.
+ */
+bool TrigramIndex::load(const std::string &path, bool with_trigrams)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		return false;
+	}
+	std::string data;
+	char buffer[65536];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		data.append(buffer, got);
+	}
+	bool read_error = ferror(f);
+	fclose(f);
+	if (read_error) {
+		errno = EIO;
+		return false;
+	}
+
+	IndexReader reader(data);
+	if (reader.bytes(INDEX_MAGIC_LENGTH) != std::string(INDEX_MAGIC, INDEX_MAGIC_LENGTH)) {
+		errno = EINVAL;
+		return false;
+	}
+	uint32_t file_count = reader.u32();
+	uint32_t trigram_count = reader.u32();
+	this->entries.clear();
+	this->by_key.clear();
+	for (uint32_t i = 0; i < file_count && !reader.failed; i++) {
+		IndexEntry entry;
+		entry.key = reader.bytes(reader.u32());
+		entry.mtime = (int64_t)reader.u64();
+		entry.size = (int64_t)reader.u64();
+		add(std::move(entry));
+	}
+	this->directory.clear();
+	for (uint32_t i = 0; i < trigram_count && !reader.failed; i++) {
+		PostingList list;
+		list.trigram = reader.u32();
+		list.count = reader.u32();
+		list.offset = reader.u64();
+		this->directory.push_back(list);
+	}
+	this->postings = reader.bytes(reader.u64());
+	if (reader.failed) {
+		errno = EINVAL;
+		return false;
+	}
+
+	if (with_trigrams) {
+		std::vector<uint32_t> ids;
+		for (size_t i = 0; i < this->directory.size(); i++) {
+			if (!read_postings(i, ids)) {
+				errno = EINVAL;
+				return false;
+			}
+			for (uint32_t id : ids) {
+				this->entries[id].trigrams.push_back(this->directory[i].trigram);
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Decodes which files have the trigram at a place in the directory.
+ */
+bool TrigramIndex::read_postings(size_t list_index, std::vector<uint32_t> &ids) const
+{
+	const PostingList &list = this->directory[list_index];
+	size_t position = list.offset;
+	uint32_t id = 0, delta;
+	ids.clear();
+	for (uint32_t i = 0; i < list.count; i++) {
+		if (!read_varint(this->postings, position, delta)) {
+			return false;
+		}
+		// Stored as the difference from the last, plus one
+		id += delta;
+		if (id == 0 || id > this->entries.size()) {
+			return false;
+		}
+		ids.push_back(id - 1);
+	}
+	return true;
+}
+
+/**
+ * Writes the index out. It goes to a temporary file first, so anyone using
+ * the old index while this runs still sees a whole one.
+ */
+bool TrigramIndex::save(const std::string &path) const
+{
+	// Files are numbered in the order they're in; each trigram lists them
+	std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+	for (size_t id = 0; id < this->entries.size(); id++) {
+		for (uint32_t trigram : this->entries[id].trigrams) {
+			lists[trigram].push_back(id);
+		}
+	}
+	std::vector<uint32_t> trigrams;
+	trigrams.reserve(lists.size());
+	for (const auto& list : lists) {
+		trigrams.push_back(list.first);
+	}
+	std::sort(trigrams.begin(), trigrams.end());
+
+	std::string header, directory, postings;
+	header.append(INDEX_MAGIC, INDEX_MAGIC_LENGTH);
+	put_u32(header, this->entries.size());
+	put_u32(header, trigrams.size());
+	for (const auto& entry : this->entries) {
+		put_u32(header, entry.key.size());
+		header.append(entry.key);
+		put_u64(header, (uint64_t)entry.mtime);
+		put_u64(header, (uint64_t)entry.size);
+	}
+	for (uint32_t trigram : trigrams) {
+		const auto& ids = lists[trigram];
+		put_u32(directory, trigram);
+		put_u32(directory, ids.size());
+		put_u64(directory, postings.size());
+		uint32_t last = 0;
+		for (uint32_t id : ids) {
+			put_varint(postings, (id + 1) - last);
+			last = id + 1;
+		}
+	}
+	put_u64(directory, postings.size());
+
+	std::string temporary = path + ".tmp";
+	FILE *f = fopen(temporary.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+	bool ok = fwrite(header.data(), 1, header.size(), f) == header.size()
+		&& fwrite(directory.data(), 1, directory.size(), f) == directory.size()
+		&& fwrite(postings.data(), 1, postings.size(), f) == postings.size();
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+		int saved_errno = errno;
+		remove(temporary.c_str());
+		errno = saved_errno;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Adds a file, or replaces what's known about it.
+ */
+void TrigramIndex::add(IndexEntry entry)
+{
+	auto found = this->by_key.find(entry.key);
+	if (found != this->by_key.end()) {
+		this->entries[found->second] = std::move(entry);
+		return;
+	}
+	this->by_key.emplace(entry.key, this->entries.size());
+	this->entries.push_back(std::move(entry));
+}
+
+const IndexEntry *TrigramIndex::find(const std::string &key) const
+{
+	auto found = this->by_key.find(key);
+	if (found == this->by_key.end()) {
+		return nullptr;
+	}
+	return &this->entries[found->second];
+}
+
+/**
+ * Finds a file that hasn't changed since it was indexed, returning its
+ * number, or -1 if it isn't in the index or has changed.
+ */
+int TrigramIndex::find_current(const std::string &key, int64_t mtime, int64_t size) const
+{
+	auto found = this->by_key.find(key);
+	if (found == this->by_key.end()) {
+		return -1;
+	}
+	const IndexEntry &entry = this->entries[found->second];
+	if (entry.mtime != mtime || entry.size != size) {
+		return -1;
+	}
+	return (int)found->second;
+}
+
+/**
+ * Works out which files could have a match, by number. Each query is the
+ * trigrams of one pattern's literal, which all have to be in a file for it
+ * to match; a file that has any query's trigrams could match.
+ */
+std::vector<bool> TrigramIndex::candidates(const std::vector<std::vector<uint32_t>> &queries) const
+{
+	std::vector<bool> possible(this->entries.size(), false);
+	std::vector<uint32_t> ids, matching;
+	for (const auto& query : queries) {
+		if (query.empty()) {
+			// Too short to look up, so every file could match
+			return std::vector<bool>(this->entries.size(), true);
+		}
+		std::vector<uint32_t> remaining;
+		bool first = true;
+		for (uint32_t trigram : query) {
+			auto list = std::lower_bound(this->directory.begin(), this->directory.end(), trigram,
+				[](const PostingList &l, uint32_t t) { return l.trigram < t; });
+			if (list == this->directory.end() || list->trigram != trigram) {
+				remaining.clear();
+				break; // no file has it
+			}
+			if (!read_postings(list - this->directory.begin(), ids)) {
+				// Can't tell, so every file could match
+				return std::vector<bool>(this->entries.size(), true);
+			}
+			if (first) {
+				remaining = ids;
+				first = false;
+			} else {
+				matching.clear();
+				std::set_intersection(remaining.begin(), remaining.end(),
+					ids.begin(), ids.end(), std::back_inserter(matching));
+				remaining.swap(matching);
+			}
+			if (remaining.empty()) {
+				break;
+			}
+		}
+		for (uint32_t id : remaining) {
+			possible[id] = true;
+		}
+	}
+	return possible;
+}
+
+size_t TrigramIndex::size() const
+{
+	return this->entries.size();
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 Seiden Group
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+extern "C" {
+#include <as400_protos.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/errno.h>
+
+#include "errc.h"
+}
+
+#include <string>
+
+#include "common.hxx"
+#include "ebcdic.hxx"
+#include "pgmfunc.hxx"
+
+using namespace pase_cpp;
+
+static PGMFunction<const char*, const char*, int, const char, const char*, const char*, const char*, ERRC0100*> QUSCRTUS("QSYS", "QUSCRTUS", PGMCALL_EXCP_NOSIGNAL);
+static PGMFunction<const char*, int, int, char*, ERRC0100*> QUSRTVUS("QSYS", "QUSRTVUS", PGMCALL_EXCP_NOSIGNAL);
+
+// Only the traversal thread calls list APIs, so one user space will do
+static EbcdicFixedString<20> list_space("PFGREPLST QTEMP");
+static bool list_space_created = false;
+
+// List API generic header fields we use
+#define LIST_INFO_STATUS  0x67
+#define LIST_DATA_OFFSET  0x7C
+#define LIST_ENTRY_COUNT  0x84
+#define LIST_ENTRY_SIZE   0x88
+#define LIST_HEADER_SIZE  0x8C
+
+/**
+ * Gets the qualified name of the user space in QTEMP that list APIs put
+ * their lists into, making it the first time. The list APIs extend it as
+ * needed. Returns nullptr if it can't be made.
+ */
+const char *get_list_space()
+{
+	if (!list_space_created) {
+		ERRC0100 errc = {};
+		errc.bytes_avail = sizeof(ERRC0100);
+		EbcdicFixedString<10> attribute("PFGREP");
+		EbcdicFixedString<10> authority("*EXCLUDE");
+		EbcdicFixedString<50> text("pfgrep lists");
+		EbcdicFixedString<10> replace("*YES");
+		QUSCRTUS(list_space, attribute, 64 * 1024, '\0', authority, text, replace, &errc);
+		if (errc.exception_id[0] != '\0') {
+			errno = ENOSYS;
+			return nullptr;
+		}
+		list_space_created = true;
+	}
+	return list_space;
+}
+
+/**
+ * Reads back the entries a list API put in the user space. Partial lists
+ * still have good entries, but incomplete ones can't be trusted.
+ */
+bool read_list_space(std::string &entries, size_t &entry_size)
+{
+	ERRC0100 errc = {};
+	errc.bytes_avail = sizeof(ERRC0100);
+
+	char header[LIST_HEADER_SIZE];
+	QUSRTVUS(list_space, 1, sizeof(header), header, &errc);
+	if (errc.exception_id[0] != '\0') {
+		errno = ENOSYS;
+		return false;
+	}
+	if (header[LIST_INFO_STATUS] == 'I'_e) {
+		errno = EIO;
+		return false;
+	}
+	int32_t data_offset = *(int32_t*)(header + LIST_DATA_OFFSET);
+	int32_t entry_count = *(int32_t*)(header + LIST_ENTRY_COUNT);
+	int32_t size = *(int32_t*)(header + LIST_ENTRY_SIZE);
+	entry_size = size;
+	entries.resize((size_t)entry_count * size);
+	if (entries.empty()) {
+		return true;
+	}
+	// Positions in the user space start at 1
+	QUSRTVUS(list_space, data_offset + 1, entries.size(), &entries[0], &errc);
+	if (errc.exception_id[0] != '\0') {
+		errno = ENOSYS;
+		return false;
+	}
+	return true;
+}